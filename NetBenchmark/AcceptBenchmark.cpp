@@ -0,0 +1,153 @@
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+// only errors of the framework are logged, so the results (written with printf)
+// are not mixed with connection messages
+#ifndef OLC_NET_LOG_LEVEL
+#define OLC_NET_LOG_LEVEL OLC_NET_LOG_LEVEL_ERROR
+#endif
+#include "../NetCommon/olc_net.hpp"
+
+// A connection storm (e.g. every client coming back after a deploy): thousands of clients
+// connect at the same time, over loopback TCP, to
+//
+//   single   - a server_interface run by one thread
+//   pool     - a server_interface run by a thread per shard (one acceptor, shared)
+//   sharded  - a sharded_server (an acceptor, a context and a thread per shard, SO_REUSEPORT)
+//
+// For each it prints how long the server took to accept them all and the accept rate, the
+// connect time seen by the clients (p50/p99/max in ms - a full accept backlog shows up as
+// SYNs sent again, after a second), and how the clients were spread over the shards
+//
+// usage: AcceptBenchmark [connections] [shards]
+
+enum class AcceptMsgTypes : uint32_t {
+    Data
+};
+
+double Seconds(std::chrono::steady_clock::time_point tStart) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - tStart).count();
+}
+
+class AcceptServer : public olc::net::server_interface<AcceptMsgTypes> {
+    public:
+        AcceptServer(uint16_t nPort) : olc::net::server_interface<AcceptMsgTypes>(nPort) {}
+        virtual ~AcceptServer() { Stop(); }
+
+        std::atomic<uint64_t> nConnects = 0;
+
+    protected:
+        virtual bool OnClientConnect(std::shared_ptr<olc::net::connection<AcceptMsgTypes>> client) {
+            nConnects.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+};
+
+class ShardedAcceptServer : public olc::net::sharded_server<AcceptMsgTypes> {
+    public:
+        ShardedAcceptServer(uint16_t nPort, size_t nShards) : olc::net::sharded_server<AcceptMsgTypes>(nPort, nShards) {}
+        virtual ~ShardedAcceptServer() { Stop(); }
+
+        std::atomic<uint64_t> nConnects = 0;
+
+    protected:
+        virtual bool OnClientConnect(std::shared_ptr<olc::net::connection<AcceptMsgTypes>> client) {
+            nConnects.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+};
+
+// Connects nConnections sockets at once, and waits until the server has accepted them all
+// (or 20 s) - the sockets stay open until the results are taken
+template <typename Server>
+void Storm(const char* pScenario, Server& server, size_t nThreads, size_t nConnections, uint16_t nPort) {
+    asio::io_context context;
+    std::vector<std::unique_ptr<asio::ip::tcp::socket>> vSockets;
+    vSockets.reserve(nConnections);
+    for (size_t i = 0; i < nConnections; i++) {
+        vSockets.push_back(std::make_unique<asio::ip::tcp::socket>(context));
+    }
+
+    olc::net::latency_histogram latency;
+    std::atomic<uint64_t> nMaxConnect = 0;
+    std::atomic<uint64_t> nErrors = 0;
+    asio::ip::tcp::endpoint endpoint(asio::ip::make_address("127.0.0.1"), nPort);
+
+    // the client thread runs before the first connect, so each one is timed when it is done
+    auto work = asio::make_work_guard(context);
+    std::thread clientThread([&context]() { context.run(); });
+
+    auto tStart = std::chrono::steady_clock::now();
+    for (auto& pSocket : vSockets) {
+        pSocket->async_connect(endpoint, [&, tStart](std::error_code ec) {
+            if (ec) {
+                nErrors++;
+                return;
+            }
+            uint64_t nTime = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - tStart).count());
+            latency.add(nTime);
+            uint64_t nMax = nMaxConnect.load();
+            while (nTime > nMax && !nMaxConnect.compare_exchange_weak(nMax, nTime)) {}
+        });
+    }
+
+    double dAccept = -1.0;
+    while (Seconds(tStart) < 20.0) {
+        if (server.nConnects.load() + nErrors.load() >= nConnections) {
+            dAccept = Seconds(tStart);
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    work.reset();
+    clientThread.join();
+
+    uint64_t nAccepted = server.nConnects.load();
+    std::printf("{\"scenario\":\"%s\",\"threads\":%zu,\"connections\":%zu,\"accepted\":%llu,\"errors\":%llu,\"accept_ms\":%.1f,"
+        "\"accepts_per_s\":%.0f,\"connect_p50_ms\":%.2f,\"connect_p99_ms\":%.2f,\"connect_max_ms\":%.2f",
+        pScenario, nThreads, nConnections, (unsigned long long)nAccepted, (unsigned long long)nErrors.load(), dAccept * 1000.0,
+        dAccept > 0.0 ? nAccepted / dAccept : 0.0, latency.percentile(0.50) / 1e6, latency.percentile(0.99) / 1e6, nMaxConnect.load() / 1e6);
+    if constexpr (std::is_same_v<Server, ShardedAcceptServer>) {
+        size_t nFewest = std::numeric_limits<size_t>::max(), nMost = 0;
+        for (size_t i = 0; i < server.GetShardCount(); i++) {
+            size_t nClients = server.GetShardStats(i).nConnections;
+            nFewest = std::min(nFewest, nClients);
+            nMost = std::max(nMost, nClients);
+        }
+        std::printf(",\"shard_min\":%zu,\"shard_max\":%zu", nFewest, nMost);
+    }
+    std::printf("}\n");
+    std::fflush(stdout);
+
+    vSockets.clear();
+}
+
+int main(int argc, char* argv[]) {
+    size_t nConnections = argc > 1 ? std::stoul(argv[1]) : 5000;
+    size_t nShards = argc > 2 ? std::stoul(argv[2]) : std::max<size_t>(std::thread::hardware_concurrency(), 2);
+
+    // every run gets a server of its own, on a port of its own
+    {
+        AcceptServer server(64000);
+        server.Start(1);
+        Storm("single", server, 1, nConnections, 64000);
+        server.Stop();
+    }
+    {
+        AcceptServer server(64001);
+        server.Start(nShards);
+        Storm("pool", server, nShards, nConnections, 64001);
+        server.Stop();
+    }
+    {
+        ShardedAcceptServer server(64002, nShards);
+        server.Start();
+        Storm("sharded", server, server.GetShardCount(), nConnections, 64002);
+        server.Stop();
+    }
+
+    return 0;
+}
@@ -0,0 +1,132 @@
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include <ctime>
+#include <random>
+#include "../NetCommon/olc_net.hpp"
+
+// Compression ratio and CPU cost of the LZ codec (net_codec.hpp), on the kind of
+// bodies a game server sends, at several sizes:
+//
+//   snapshot - an array of entity states (id, position, velocity, flags) that change little
+//   text     - chat-like text made of common words
+//   zeros    - a body that is mostly empty
+//   random   - data that doesn't compress at all (the codec gives up, PackBody returns false)
+//
+// For each one it prints the ratio (original / compressed) and the CPU time of the
+// thread per MB of original body, to compress and to decompress
+//
+// usage: CodecBenchmark [seconds per test]
+
+double ThreadCpuTime() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+struct entity_state {
+    uint32_t nID;
+    float vPosition[3];
+    float vVelocity[3];
+    uint16_t nHealth;
+    uint16_t nFlags;
+};
+
+std::vector<uint8_t> MakeBody(const std::string& sKind, size_t nSize) {
+    std::mt19937 rng(42);
+    std::vector<uint8_t> body;
+
+    if (sKind == "snapshot") {
+        olc::net::message<uint32_t> msg;
+        for (uint32_t i = 0; msg.body.size() + sizeof(entity_state) <= nSize; i++) {
+            entity_state e{};
+            e.nID = i;
+            e.vPosition[0] = float(i % 64) * 2.0f;
+            e.vPosition[1] = 0.0f;
+            e.vPosition[2] = float(i / 64) * 2.0f;
+            e.vVelocity[0] = (rng() % 4 == 0) ? 1.5f : 0.0f;
+            e.nHealth = 100;
+            e.nFlags = uint16_t(rng() % 2);
+            msg << e;
+        }
+        body = std::move(msg.body);
+        body.resize(nSize);
+    } else if (sKind == "text") {
+        const char* vWords[] = { "the", "player", "has", "joined", "team", "red", "blue", "score", "is", "now",
+            "gg", "well", "played", "attack", "the", "base", "defend", "flag", "respawn", "in", "seconds" };
+        while (body.size() < nSize) {
+            const char* pWord = vWords[rng() % (sizeof(vWords) / sizeof(vWords[0]))];
+            body.insert(body.end(), pWord, pWord + std::strlen(pWord));
+            body.push_back(rng() % 8 == 0 ? '\n' : ' ');
+        }
+        body.resize(nSize);
+    } else if (sKind == "zeros") {
+        body.resize(nSize);
+        for (size_t i = 0; i < nSize; i += 97) {
+            body[i] = uint8_t(rng());
+        }
+    } else {
+        body.resize(nSize);
+        for (auto& b : body) {
+            b = uint8_t(rng());
+        }
+    }
+    return body;
+}
+
+void Run(const std::string& sKind, size_t nSize, double dSeconds) {
+    std::vector<uint8_t> body = MakeBody(sKind, nSize);
+    std::vector<uint8_t> packed;
+    std::vector<uint8_t> unpacked;
+
+    bool bPacked = olc::net::PackBody(olc::net::codec_id::lz, body.data(), body.size(), packed);
+
+    // compress
+    size_t nRounds = 0;
+    double dStart = ThreadCpuTime();
+    double dCompress = 0.0;
+    do {
+        olc::net::PackBody(olc::net::codec_id::lz, body.data(), body.size(), packed);
+        nRounds++;
+        dCompress = ThreadCpuTime() - dStart;
+    } while (dCompress < dSeconds);
+    double dCompressMsPerMB = dCompress * 1000.0 / (nRounds * nSize / (1024.0 * 1024.0));
+
+    // decompress (only if the codec kept the compressed body)
+    double dDecompressMsPerMB = 0.0;
+    bool bOk = true;
+    if (bPacked) {
+        olc::net::PackBody(olc::net::codec_id::lz, body.data(), body.size(), packed);
+        nRounds = 0;
+        dStart = ThreadCpuTime();
+        double dDecompress = 0.0;
+        do {
+            bOk &= olc::net::UnpackBody(packed.data(), packed.size(), unpacked);
+            nRounds++;
+            dDecompress = ThreadCpuTime() - dStart;
+        } while (dDecompress < dSeconds);
+        dDecompressMsPerMB = dDecompress * 1000.0 / (nRounds * nSize / (1024.0 * 1024.0));
+        bOk &= unpacked == body;
+    }
+
+    std::printf("{\"body\":\"%s\",\"size\":%zu,\"packed\":%s,\"compressed_size\":%zu,\"ratio\":%.2f,"
+        "\"compress_cpu_ms_per_mb\":%.2f,\"compress_mb_per_s\":%.0f,"
+        "\"decompress_cpu_ms_per_mb\":%.2f,\"decompress_mb_per_s\":%.0f,\"roundtrip_ok\":%s}\n",
+        sKind.c_str(), nSize, bPacked ? "true" : "false", bPacked ? packed.size() : nSize,
+        bPacked ? double(nSize) / packed.size() : 1.0,
+        dCompressMsPerMB, dCompressMsPerMB > 0.0 ? 1000.0 / dCompressMsPerMB : 0.0,
+        dDecompressMsPerMB, dDecompressMsPerMB > 0.0 ? 1000.0 / dDecompressMsPerMB : 0.0,
+        bOk ? "true" : "false");
+}
+
+int main(int argc, char* argv[]) {
+    double dSeconds = argc > 1 ? std::stod(argv[1]) : 0.2;
+
+    for (const char* pKind : { "snapshot", "text", "zeros", "random" }) {
+        for (size_t nSize : { 1024, 16 * 1024, 256 * 1024 }) {
+            Run(pKind, nSize, dSeconds);
+        }
+    }
+
+    return 0;
+}
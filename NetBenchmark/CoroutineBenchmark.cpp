@@ -0,0 +1,273 @@
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <thread>
+// only errors of the framework are logged, so the results (written with printf)
+// are not mixed with connection messages
+#ifndef OLC_NET_LOG_LEVEL
+#define OLC_NET_LOG_LEVEL OLC_NET_LOG_LEVEL_ERROR
+#endif
+#include "../NetCommon/olc_net.hpp"
+
+// The same echo written with callbacks (dispatch_mode::direct) and with coroutines
+// (dispatch_mode::coroutine, see net_coro.hpp), over loopback TCP:
+//
+//   callback  - OnMessage of the server sends the message back, OnMessage of the client
+//               sends the next one
+//   coroutine - the server accepts in a loop and runs a session per client that reads and
+//               sends back, the client awaits Request (send, then read the reply) in a loop
+//
+// For each it prints the round trip p50/p99 in us, round trips per second, and the heap
+// allocations per round trip of the whole process (client and server), counted once the
+// connections are warm - the frames of Request come back from the frame_pool
+//
+// pingpong is one client, fanin 16 clients on a server with 2 threads; one message in
+// flight per client
+//
+// needs C++20: g++ -std=c++20 -O2 NetBenchmark/CoroutineBenchmark.cpp -lpthread
+//
+// usage: CoroutineBenchmark [seconds per test] [sizes, comma separated]
+
+#if !OLC_NET_HAS_COROUTINES
+int main() {
+    std::printf("CoroutineBenchmark needs C++20 (-std=c++20)\n");
+    return 1;
+}
+#else
+
+#include "alloc_counter.hpp"
+
+enum class CoroMsgTypes : uint32_t {
+    Echo
+};
+
+int64_t Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// the body: the time it was sent, then a pattern that depends on its sequence number
+// It is written over the body of the previous reply, so the body is reused
+void Fill(olc::net::message<CoroMsgTypes>& msg, size_t nSize, uint64_t nSequence) {
+    msg.header.id = CoroMsgTypes::Echo;
+    msg.body.resize(std::max(nSize, sizeof(int64_t) + sizeof(uint64_t)));
+    int64_t nTime = Now();
+    std::memcpy(msg.body.data(), &nTime, sizeof(nTime));
+    std::memcpy(msg.body.data() + sizeof(nTime), &nSequence, sizeof(nSequence));
+    for (size_t i = sizeof(nTime) + sizeof(nSequence); i < msg.body.size(); i++) {
+        msg.body[i] = uint8_t(nSequence + i);
+    }
+    msg.header.size = uint32_t(msg.size());
+}
+
+bool CheckMessage(const olc::net::message<CoroMsgTypes>& msg) {
+    uint64_t nSequence;
+    std::memcpy(&nSequence, msg.body.data() + sizeof(int64_t), sizeof(nSequence));
+    for (size_t i = sizeof(int64_t) + sizeof(nSequence); i < msg.body.size(); i++) {
+        if (msg.body[i] != uint8_t(nSequence + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// what both kinds of client count
+struct echo_counters {
+    size_t nSize = 0;
+    std::atomic<uint64_t> nReplies = 0;
+    std::atomic<uint64_t> nBad = 0;
+    std::atomic<bool> bRunning = true;
+    // shared by the clients of a run (any thread can add to it)
+    olc::net::latency_histogram* pLatency = nullptr;
+
+    void OnReply(const olc::net::message<CoroMsgTypes>& msg) {
+        int64_t nSent;
+        std::memcpy(&nSent, msg.body.data(), sizeof(nSent));
+        pLatency->add(uint64_t(Now() - nSent));
+        if (!CheckMessage(msg)) {
+            nBad++;
+        }
+        nReplies.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+class EchoServer : public olc::net::server_interface<CoroMsgTypes> {
+    public:
+        EchoServer(uint16_t nPort, olc::net::dispatch_mode mode)
+            : olc::net::server_interface<CoroMsgTypes>(nPort, mode) {
+            if (mode == olc::net::dispatch_mode::coroutine) {
+                Spawn(AcceptLoop());
+            }
+        }
+
+        virtual ~EchoServer() {
+            Stop();
+        }
+
+        size_t ClientCount() {
+            std::scoped_lock lock(muxConnections);
+            return m_connections.size();
+        }
+
+    protected:
+        virtual bool OnClientConnect(std::shared_ptr<olc::net::connection<CoroMsgTypes>> client) {
+            return true;
+        }
+
+        virtual void OnMessage(std::shared_ptr<olc::net::connection<CoroMsgTypes>> client, olc::net::message<CoroMsgTypes>& msg) {
+            client->Send(std::move(msg));
+        }
+
+        olc::net::task<> AcceptLoop() {
+            while (auto client = co_await Accept()) {
+                olc::net::Spawn(client->GetStrand(), Session(client));
+            }
+        }
+
+        static olc::net::task<> Session(std::shared_ptr<olc::net::connection<CoroMsgTypes>> client) {
+            while (auto msg = co_await client->ReadMessage()) {
+                client->Send(std::move(*msg));
+            }
+        }
+};
+
+class CallbackClient : public olc::net::client_interface<CoroMsgTypes>, public echo_counters {
+    public:
+        CallbackClient() : olc::net::client_interface<CoroMsgTypes>(olc::net::dispatch_mode::direct) {}
+        virtual ~CallbackClient() { Disconnect(); }
+
+        void Begin() {
+            olc::net::message<CoroMsgTypes> msg;
+            Fill(msg, nSize, 0);
+            Send(std::move(msg));
+        }
+
+    protected:
+        // every reply sends the next message
+        virtual void OnMessage(olc::net::message<CoroMsgTypes>& msg) {
+            OnReply(msg);
+            if (bRunning.load(std::memory_order_relaxed)) {
+                Fill(msg, nSize, nReplies.load(std::memory_order_relaxed));
+                Send(std::move(msg));
+            }
+        }
+};
+
+class CoroutineClient : public olc::net::client_interface<CoroMsgTypes>, public echo_counters {
+    public:
+        CoroutineClient() : olc::net::client_interface<CoroMsgTypes>(olc::net::dispatch_mode::coroutine) {}
+
+        std::atomic<bool> bDone = false;
+
+        void Begin() {
+            Spawn(Run());
+        }
+
+    protected:
+        // a request and its reply, as a straight line - a coroutine of its own per message
+        olc::net::task<std::optional<olc::net::message<CoroMsgTypes>>> Request(olc::net::message<CoroMsgTypes> msg) {
+            co_await Send(std::move(msg));
+            co_return co_await ReadMessage();
+        }
+
+        olc::net::task<> Run() {
+            olc::net::message<CoroMsgTypes> msg;
+            while (bRunning.load(std::memory_order_relaxed)) {
+                Fill(msg, nSize, nReplies.load(std::memory_order_relaxed));
+                auto reply = co_await Request(std::move(msg));
+                if (!reply) {
+                    break;
+                }
+                OnReply(*reply);
+                msg = std::move(*reply);
+            }
+            bDone = true;
+        }
+};
+
+template <typename Client>
+void Run(olc::net::dispatch_mode mode, const char* pScenario, size_t nClients, size_t nSize, double dSeconds, uint16_t nPort) {
+    EchoServer server(nPort, mode);
+    server.Start(2);
+
+    olc::net::latency_histogram latency;
+    std::vector<std::unique_ptr<Client>> vClients;
+    for (size_t i = 0; i < nClients; i++) {
+        vClients.push_back(std::make_unique<Client>());
+        vClients.back()->nSize = nSize;
+        vClients.back()->pLatency = &latency;
+        vClients.back()->Connect("127.0.0.1", nPort);
+    }
+    // the messages sent before the connection is up would be lost
+    for (int i = 0; i < 400 && server.ClientCount() < nClients; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    for (auto& client : vClients) {
+        client->Begin();
+    }
+    // warm up: the pools fill, and the counters start from there
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    uint64_t nRepliesBefore = 0;
+    for (auto& client : vClients) {
+        nRepliesBefore += client->nReplies.load();
+    }
+    uint64_t nAllocationsBefore = nAllocations.load();
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(dSeconds));
+
+    uint64_t nAllocationsAfter = nAllocations.load();
+    uint64_t nReplies = 0, nBad = 0;
+    for (auto& client : vClients) {
+        nReplies += client->nReplies.load();
+        nBad += client->nBad.load();
+    }
+    nReplies -= nRepliesBefore;
+
+    for (auto& client : vClients) {
+        client->bRunning = false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    std::printf("{\"dispatch\":\"%s\",\"scenario\":\"%s\",\"clients\":%zu,\"size\":%zu,\"msgs_per_s\":%.0f,"
+        "\"rtt_p50_us\":%.1f,\"rtt_p99_us\":%.1f,\"allocs_per_msg\":%.3f,\"bad\":%llu}\n",
+        mode == olc::net::dispatch_mode::coroutine ? "coroutine" : "callback", pScenario, nClients, nSize,
+        nReplies / dSeconds, latency.percentile(0.50) / 1000.0, latency.percentile(0.99) / 1000.0,
+        nReplies ? double(nAllocationsAfter - nAllocationsBefore) / nReplies : 0.0, (unsigned long long)nBad);
+    std::fflush(stdout);
+
+    vClients.clear();
+    // the sessions see their clients go before the server stops
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    server.Stop();
+}
+
+int main(int argc, char* argv[]) {
+    double dSeconds = argc > 1 ? std::stod(argv[1]) : 1.0;
+    std::vector<size_t> vSizes = { 16, 1024 };
+    if (argc > 2) {
+        vSizes.clear();
+        std::string sSizes = argv[2];
+        for (size_t nStart = 0; nStart < sSizes.size(); ) {
+            size_t nEnd = sSizes.find(',', nStart);
+            vSizes.push_back(std::stoul(sSizes.substr(nStart, nEnd - nStart)));
+            nStart = nEnd == std::string::npos ? sSizes.size() : nEnd + 1;
+        }
+    }
+
+    // every run gets a server of its own, on a port of its own
+    uint16_t nPort = 62000;
+    for (size_t nSize : vSizes) {
+        Run<CallbackClient>(olc::net::dispatch_mode::direct, "pingpong", 1, nSize, dSeconds, nPort++);
+        Run<CoroutineClient>(olc::net::dispatch_mode::coroutine, "pingpong", 1, nSize, dSeconds, nPort++);
+        Run<CallbackClient>(olc::net::dispatch_mode::direct, "fanin", 16, nSize, dSeconds, nPort++);
+        Run<CoroutineClient>(olc::net::dispatch_mode::coroutine, "fanin", 16, nSize, dSeconds, nPort++);
+    }
+
+    return 0;
+}
+#endif
@@ -0,0 +1,181 @@
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+// only errors of the framework are logged, so the results (written with printf)
+// are not mixed with connection messages
+#ifndef OLC_NET_LOG_LEVEL
+#define OLC_NET_LOG_LEVEL OLC_NET_LOG_LEVEL_ERROR
+#endif
+#include "../NetCommon/olc_net.hpp"
+
+// The datagram channel (delivery::unreliable) over loopback, with induced loss
+// A client and the server send each other position updates at a fixed rate, as
+// datagrams, while both datagram sockets drop a share of what they send (SetLoss).
+// For each loss rate it prints, for each direction:
+//
+//   sent / received      - position updates
+//   delivered_pct        - received / sent (should be close to 100 - loss)
+//   stale                - updates dropped because a newer one had arrived already
+//   over_tcp             - updates sent over TCP because the channel wasn't ready
+//   p50_us / p99_us      - one-way latency of the updates received
+//
+// and checks that the reliable messages sent alongside (over TCP) all arrived
+//
+// usage: DatagramBenchmark [seconds per test] [updates per second]
+
+enum class DemoMsgTypes : uint32_t {
+    Position,
+    Chat
+};
+
+struct position_update {
+    uint64_t nSequence;
+    int64_t nTime;
+    float vPosition[3];
+};
+
+int64_t Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+olc::net::message<DemoMsgTypes> MakePosition(uint64_t nSequence) {
+    olc::net::message<DemoMsgTypes> msg;
+    msg.header.id = DemoMsgTypes::Position;
+    position_update update{ nSequence, Now(), { float(nSequence), 0.0f, 1.0f } };
+    msg << update;
+    return msg;
+}
+
+olc::net::message<DemoMsgTypes> MakeChat(uint64_t nSequence) {
+    olc::net::message<DemoMsgTypes> msg;
+    msg.header.id = DemoMsgTypes::Chat;
+    msg << nSequence;
+    return msg;
+}
+
+// what one side received
+struct receiver {
+    std::atomic<uint64_t> nPositions = 0;
+    std::atomic<uint64_t> nChats = 0;
+    olc::net::latency_histogram latency;
+
+    void OnMessage(olc::net::message<DemoMsgTypes>& msg) {
+        if (msg.header.id == DemoMsgTypes::Position) {
+            position_update update;
+            olc::net::message_view<DemoMsgTypes> view(msg);
+            if (view >> update) {
+                latency.add(uint64_t(Now() - update.nTime));
+                nPositions++;
+            }
+        } else if (msg.header.id == DemoMsgTypes::Chat) {
+            nChats++;
+        }
+    }
+};
+
+class DemoServer : public olc::net::server_interface<DemoMsgTypes> {
+    public:
+        DemoServer(uint16_t nPort) : olc::net::server_interface<DemoMsgTypes>(nPort, olc::net::dispatch_mode::direct) {}
+        virtual ~DemoServer() { Stop(); }
+
+        receiver received;
+
+    protected:
+        virtual bool OnClientConnect(std::shared_ptr<olc::net::connection<DemoMsgTypes>> client) {
+            return true;
+        }
+
+        virtual void OnMessage(std::shared_ptr<olc::net::connection<DemoMsgTypes>> client, olc::net::message<DemoMsgTypes>& msg) {
+            received.OnMessage(msg);
+        }
+};
+
+class DemoClient : public olc::net::client_interface<DemoMsgTypes> {
+    public:
+        DemoClient() : olc::net::client_interface<DemoMsgTypes>(olc::net::dispatch_mode::direct) {}
+        virtual ~DemoClient() { Disconnect(); }
+
+        receiver received;
+
+    protected:
+        virtual void OnMessage(olc::net::message<DemoMsgTypes>& msg) {
+            received.OnMessage(msg);
+        }
+};
+
+void PrintDirection(const char* pDirection, double dLoss, uint64_t nSent, uint64_t nChatsSent, receiver& r,
+    const olc::net::connection_stats& sender, const olc::net::connection_stats& target) {
+    std::printf("{\"direction\":\"%s\",\"loss\":%.2f,\"sent\":%llu,\"received\":%llu,\"delivered_pct\":%.1f,"
+        "\"stale\":%llu,\"over_tcp\":%llu,\"p50_us\":%.1f,\"p99_us\":%.1f,\"reliable_sent\":%llu,\"reliable_received\":%llu}\n",
+        pDirection, dLoss, (unsigned long long)nSent, (unsigned long long)r.nPositions.load(),
+        nSent ? 100.0 * r.nPositions.load() / nSent : 0.0,
+        (unsigned long long)target.nDatagramsStale, (unsigned long long)sender.nUnreliableOverTcp,
+        r.latency.percentile(0.50) / 1000.0, r.latency.percentile(0.99) / 1000.0,
+        (unsigned long long)nChatsSent, (unsigned long long)r.nChats.load());
+}
+
+void Run(double dLoss, double dSeconds, double dRate, uint16_t nPort) {
+    DemoServer server(nPort);
+    server.SetDelivery(DemoMsgTypes::Position, olc::net::delivery::unreliable);
+    server.EnableDatagrams();
+    server.Start(1);
+
+    DemoClient client;
+    client.SetDelivery(DemoMsgTypes::Position, olc::net::delivery::unreliable);
+    client.EnableDatagrams();
+    client.Connect("127.0.0.1", nPort);
+    for (int i = 0; i < 200 && !client.IsConnected(); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+
+    // the channel is set up (offer over TCP, hellos over UDP) before the loss starts
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    server.GetDatagramSocket()->SetLoss(dLoss);
+    client.GetDatagramSocket()->SetLoss(dLoss);
+
+    uint64_t nSent = 0;
+    uint64_t nChats = 0;
+    auto tStart = std::chrono::steady_clock::now();
+    auto tInterval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / dRate));
+    auto tNext = tStart;
+    while (std::chrono::steady_clock::now() - tStart < std::chrono::duration<double>(dSeconds)) {
+        client.Send(MakePosition(nSent));
+        server.MessageAllClients(MakePosition(nSent));
+        // every tenth update, a reliable message too
+        if (nSent % 10 == 0) {
+            client.Send(MakeChat(nChats));
+            server.MessageAllClients(MakeChat(nChats));
+            nChats++;
+        }
+        nSent++;
+        tNext += tInterval;
+        std::this_thread::sleep_until(tNext);
+    }
+    // what is still on its way
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    olc::net::connection_stats clientStats = client.GetStats();
+    olc::net::server_stats serverStats = server.GetStats();
+
+    PrintDirection("client_to_server", dLoss, nSent, nChats, server.received, clientStats, serverStats.total);
+    PrintDirection("server_to_client", dLoss, nSent, nChats, client.received, serverStats.total, clientStats);
+    std::fflush(stdout);
+
+    client.Disconnect();
+    server.Stop();
+}
+
+int main(int argc, char* argv[]) {
+    double dSeconds = argc > 1 ? std::stod(argv[1]) : 2.0;
+    double dRate = argc > 2 ? std::stod(argv[2]) : 1000.0;
+
+    uint16_t nPort = 60800;
+    for (double dLoss : { 0.0, 0.05, 0.2, 0.5 }) {
+        Run(dLoss, dSeconds, dRate, nPort++);
+    }
+
+    return 0;
+}
@@ -0,0 +1,208 @@
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+// only errors of the framework are logged, so the results (written with printf)
+// are not mixed with connection messages
+#ifndef OLC_NET_LOG_LEVEL
+#define OLC_NET_LOG_LEVEL OLC_NET_LOG_LEVEL_ERROR
+#endif
+#include "../NetCommon/olc_net.hpp"
+
+// The I/O engines (net_uring.hpp) side by side over loopback TCP: the reactor of asio
+// and io_uring, on both the server and the clients. Clients and a server in this process
+// echo messages, and for each engine and body size it prints:
+//
+//   pingpong - one client, one message in flight: rtt p50/p99 in us and round trips per second
+//   stream   - one client, 64 messages in flight: messages and MB per second (each way)
+//   fanin    - 32 clients with 8 messages in flight each, on a server with one thread
+//
+// with the system calls made for it: with the reactor the reads and writes of the
+// connections (the epoll_wait calls come on top), with io_uring every io_uring_enter and
+// every wake up from the eventfd (there is one epoll_wait per wake up), and the io_uring
+// sends that found the socket full and waited for it (write_stalls). It checks every
+// echo has the body it was sent
+//
+// If io_uring can't be used here, its runs say "engine":"reactor" (the fallback)
+//
+// usage: EngineBenchmark [seconds per test] [sizes, comma separated]
+
+enum class EngineMsgTypes : uint32_t {
+    Echo
+};
+
+int64_t Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class EchoServer : public olc::net::server_interface<EngineMsgTypes> {
+    public:
+        EchoServer(uint16_t nPort)
+            : olc::net::server_interface<EngineMsgTypes>(nPort, olc::net::dispatch_mode::direct) {
+
+        }
+
+        virtual ~EchoServer() {
+            Stop();
+        }
+
+        size_t ClientCount() {
+            std::scoped_lock lock(muxConnections);
+            return m_connections.size();
+        }
+
+    protected:
+        virtual bool OnClientConnect(std::shared_ptr<olc::net::connection<EngineMsgTypes>> client) {
+            return true;
+        }
+
+        virtual void OnMessage(std::shared_ptr<olc::net::connection<EngineMsgTypes>> client, olc::net::message<EngineMsgTypes>& msg) {
+            client->Send(std::move(msg));
+        }
+};
+
+// the body: the time it was sent, then a pattern that depends on its sequence number
+olc::net::message<EngineMsgTypes> MakeMessage(size_t nSize, uint64_t nSequence) {
+    olc::net::message<EngineMsgTypes> msg;
+    msg.header.id = EngineMsgTypes::Echo;
+    msg.body.resize(std::max(nSize, sizeof(int64_t) + sizeof(uint64_t)));
+    int64_t nTime = Now();
+    std::memcpy(msg.body.data(), &nTime, sizeof(nTime));
+    std::memcpy(msg.body.data() + sizeof(nTime), &nSequence, sizeof(nSequence));
+    for (size_t i = sizeof(nTime) + sizeof(nSequence); i < msg.body.size(); i++) {
+        msg.body[i] = uint8_t(nSequence + i);
+    }
+    msg.header.size = uint32_t(msg.size());
+    return msg;
+}
+
+bool CheckMessage(const olc::net::message<EngineMsgTypes>& msg) {
+    uint64_t nSequence;
+    std::memcpy(&nSequence, msg.body.data() + sizeof(int64_t), sizeof(nSequence));
+    for (size_t i = sizeof(int64_t) + sizeof(nSequence); i < msg.body.size(); i++) {
+        if (msg.body[i] != uint8_t(nSequence + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+class EchoClient : public olc::net::client_interface<EngineMsgTypes> {
+    public:
+        EchoClient() : olc::net::client_interface<EngineMsgTypes>(olc::net::dispatch_mode::direct) {}
+        virtual ~EchoClient() { Disconnect(); }
+
+        size_t nSize = 0;
+        std::atomic<uint64_t> nReplies = 0;
+        std::atomic<uint64_t> nBad = 0;
+        std::atomic<bool> bRunning = true;
+        // shared by the clients of a run (any thread can add to it)
+        olc::net::latency_histogram* pLatency = nullptr;
+
+    protected:
+        // every reply sends the next message, so the window stays as it was filled
+        virtual void OnMessage(olc::net::message<EngineMsgTypes>& msg) {
+            int64_t nSent;
+            std::memcpy(&nSent, msg.body.data(), sizeof(nSent));
+            pLatency->add(uint64_t(Now() - nSent));
+            if (!CheckMessage(msg)) {
+                nBad++;
+            }
+            uint64_t nReply = nReplies.fetch_add(1, std::memory_order_relaxed);
+            if (bRunning.load(std::memory_order_relaxed)) {
+                Send(MakeMessage(nSize, nReply));
+            }
+        }
+};
+
+// the system calls of an engine (see the top of the file)
+uint64_t Syscalls(olc::net::uring_engine* pUring, const olc::net::connection_stats& stats) {
+    if (pUring) {
+        olc::net::uring_stats uringStats = pUring->GetStats();
+        return uringStats.nEnters + uringStats.nWakeups;
+    }
+    return stats.nReads + stats.nWrites;
+}
+
+void Run(olc::net::io_engine engine, const char* pScenario, size_t nClients, size_t nWindow, size_t nSize, double dSeconds, uint16_t nPort) {
+    EchoServer server(nPort);
+    server.SetIoEngine(engine);
+    server.Start(1);
+
+    olc::net::latency_histogram latency;
+    std::vector<std::unique_ptr<EchoClient>> vClients;
+    for (size_t i = 0; i < nClients; i++) {
+        vClients.push_back(std::make_unique<EchoClient>());
+        vClients.back()->nSize = nSize;
+        vClients.back()->pLatency = &latency;
+        vClients.back()->SetIoEngine(engine);
+        vClients.back()->Connect("127.0.0.1", nPort);
+    }
+    for (int i = 0; i < 400 && server.ClientCount() < nClients; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    for (auto& client : vClients) {
+        for (size_t i = 0; i < nWindow; i++) {
+            client->Send(MakeMessage(nSize, i));
+        }
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(dSeconds));
+    for (auto& client : vClients) {
+        client->bRunning = false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    uint64_t nReplies = 0, nBad = 0, nSyscalls = 0, nStalls = 0;
+    for (auto& client : vClients) {
+        nReplies += client->nReplies.load();
+        nBad += client->nBad.load();
+        nSyscalls += Syscalls(client->GetUringEngine(), client->GetStats());
+        nStalls += client->GetStats().nWriteStalls;
+    }
+    nSyscalls += Syscalls(server.GetUringEngine(), server.GetStats().total);
+    nStalls += server.GetStats().total.nWriteStalls;
+
+    bool bUring = server.GetIoEngine() == olc::net::io_engine::uring;
+    bool bMultishot = bUring && server.GetUringEngine()->GetStats().bMultishot;
+
+    std::printf("{\"engine\":\"%s\",\"multishot\":%s,\"scenario\":\"%s\",\"clients\":%zu,\"size\":%zu,\"msgs_per_s\":%.0f,\"mb_per_s\":%.1f,"
+        "\"rtt_p50_us\":%.1f,\"rtt_p99_us\":%.1f,\"syscalls_per_msg\":%.3f,\"write_stalls\":%llu,\"bad\":%llu}\n",
+        bUring ? "uring" : "reactor", bMultishot ? "true" : "false", pScenario, nClients, nSize,
+        nReplies / dSeconds, nReplies * double(nSize) / dSeconds / 1e6,
+        latency.percentile(0.50) / 1000.0, latency.percentile(0.99) / 1000.0,
+        nReplies ? double(nSyscalls) / nReplies : 0.0, (unsigned long long)nStalls, (unsigned long long)nBad);
+    std::fflush(stdout);
+
+    vClients.clear();
+    server.Stop();
+}
+
+int main(int argc, char* argv[]) {
+    double dSeconds = argc > 1 ? std::stod(argv[1]) : 1.0;
+    std::vector<size_t> vSizes = { 16, 1024, 64 * 1024 };
+    if (argc > 2) {
+        vSizes.clear();
+        std::string sSizes = argv[2];
+        for (size_t nStart = 0; nStart < sSizes.size(); ) {
+            size_t nEnd = sSizes.find(',', nStart);
+            vSizes.push_back(std::stoul(sSizes.substr(nStart, nEnd - nStart)));
+            nStart = nEnd == std::string::npos ? sSizes.size() : nEnd + 1;
+        }
+    }
+
+    // every run gets a server of its own, on a port of its own
+    uint16_t nPort = 61000;
+    for (size_t nSize : vSizes) {
+        for (auto engine : { olc::net::io_engine::reactor, olc::net::io_engine::uring }) {
+            Run(engine, "pingpong", 1, 1, nSize, dSeconds, nPort++);
+            Run(engine, "stream", 1, 64, nSize, dSeconds, nPort++);
+            Run(engine, "fanin", 32, 8, nSize, dSeconds, nPort++);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,146 @@
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+// only errors of the framework are logged, so the results (written with printf)
+// are not mixed with connection messages
+#ifndef OLC_NET_LOG_LEVEL
+#define OLC_NET_LOG_LEVEL OLC_NET_LOG_LEVEL_ERROR
+#endif
+#include "../NetCommon/olc_net.hpp"
+
+// Bandwidth of the two header formats (net_header.hpp) for small messages
+// A client echoes messages with a server over loopback (32 in flight), once with
+// fixed_header and once with varint_header, and for each body size it prints:
+//
+//   wire_bytes_per_msg  - bytes written on the socket per message (header + body)
+//   header_bytes        - bytes of one header
+//   overhead_pct        - header bytes as a percentage of the body
+//   msgs_per_s          - round trips per second
+//   encode_decode_ns    - CPU time to encode and decode one header
+//
+// usage: HeaderBenchmark [seconds per test]
+
+enum class HeaderMsgTypes : uint32_t {
+    Echo,
+    Data
+};
+
+template <typename H>
+class EchoServer : public olc::net::server_interface<HeaderMsgTypes, H> {
+    public:
+        EchoServer(uint16_t nPort)
+            : olc::net::server_interface<HeaderMsgTypes, H>(nPort, olc::net::dispatch_mode::direct) {
+
+        }
+
+        virtual ~EchoServer() {
+            this->Stop();
+        }
+
+    protected:
+        virtual bool OnClientConnect(std::shared_ptr<olc::net::connection<HeaderMsgTypes, H>> client) {
+            return true;
+        }
+
+        virtual void OnMessage(std::shared_ptr<olc::net::connection<HeaderMsgTypes, H>> client, olc::net::message<HeaderMsgTypes>& msg) {
+            client->Send(std::move(msg));
+        }
+};
+
+template <typename H>
+class EchoClient : public olc::net::client_interface<HeaderMsgTypes, H> {
+    public:
+        EchoClient() : olc::net::client_interface<HeaderMsgTypes, H>(olc::net::dispatch_mode::direct) {}
+        virtual ~EchoClient() { this->Disconnect(); }
+
+        std::atomic<uint64_t> nReplies = 0;
+        std::atomic<bool> bRunning = true;
+
+    protected:
+        // every reply sends the next message, so the window stays full
+        virtual void OnMessage(olc::net::message<HeaderMsgTypes>& msg) {
+            nReplies.fetch_add(1, std::memory_order_relaxed);
+            if (bRunning.load(std::memory_order_relaxed)) {
+                this->Send(std::move(msg));
+            }
+        }
+};
+
+olc::net::message<HeaderMsgTypes> MakeMessage(size_t nSize) {
+    olc::net::message<HeaderMsgTypes> msg;
+    msg.header.id = HeaderMsgTypes::Data;
+    msg.body.resize(nSize, 0x5A);
+    msg.header.size = uint32_t(msg.size());
+    return msg;
+}
+
+// CPU cost of writing and reading back one header
+template <typename H>
+double EncodeDecodeNs(size_t nSize) {
+    olc::net::message_header<HeaderMsgTypes> header = MakeMessage(nSize).header;
+    uint8_t vBuffer[H::template max_size<HeaderMsgTypes>()];
+    const size_t nRounds = 10000000;
+    uint64_t nCheck = 0;
+
+    auto tStart = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < nRounds; i++) {
+        header.size = uint32_t(nSize + (i & 7));
+        size_t n = H::encode(header, vBuffer);
+        olc::net::message_header<HeaderMsgTypes> decoded;
+        nCheck += H::decode(vBuffer, n, decoded) + decoded.size;
+    }
+    std::chrono::duration<double, std::nano> dElapsed = std::chrono::steady_clock::now() - tStart;
+
+    // keeps the loop from being optimised away
+    if (nCheck == 0) {
+        std::printf("\n");
+    }
+    return dElapsed.count() / nRounds;
+}
+
+template <typename H>
+void Run(const char* pName, size_t nSize, double dSeconds, uint16_t nPort) {
+    EchoServer<H> server(nPort);
+    server.Start(1);
+
+    EchoClient<H> client;
+    client.Connect("127.0.0.1", nPort);
+    for (int i = 0; i < 200 && !client.IsConnected(); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+
+    for (int i = 0; i < 32; i++) {
+        client.Send(MakeMessage(nSize));
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(dSeconds));
+    client.bRunning = false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    olc::net::connection_stats stats = client.GetStats();
+    uint64_t nReplies = client.nReplies.load();
+    client.Disconnect();
+    server.Stop();
+
+    olc::net::message<HeaderMsgTypes> msg = MakeMessage(nSize);
+    size_t nHeader = H::size(msg.header);
+    double dWire = stats.nMessagesOut ? double(stats.nBytesOut) / stats.nMessagesOut : 0.0;
+
+    std::printf("{\"header\":\"%s\",\"size\":%zu,\"header_bytes\":%zu,\"wire_bytes_per_msg\":%.2f,"
+        "\"overhead_pct\":%.1f,\"msgs_per_s\":%.0f,\"encode_decode_ns\":%.2f}\n",
+        pName, nSize, nHeader, dWire, 100.0 * nHeader / nSize, nReplies / dSeconds, EncodeDecodeNs<H>(nSize));
+}
+
+int main(int argc, char* argv[]) {
+    double dSeconds = argc > 1 ? std::stod(argv[1]) : 1.0;
+
+    uint16_t nPort = 60700;
+    for (size_t nSize : { 8, 16, 64, 256, 4096 }) {
+        Run<olc::net::fixed_header>("fixed", nSize, dSeconds, nPort++);
+        Run<olc::net::varint_header>("varint", nSize, dSeconds, nPort++);
+    }
+
+    return 0;
+}
@@ -0,0 +1,497 @@
+#include <iostream>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <new>
+#include <string>
+// only errors of the framework are logged, so the results (written with printf)
+// are not mixed with connection messages
+#ifndef OLC_NET_LOG_LEVEL
+#define OLC_NET_LOG_LEVEL OLC_NET_LOG_LEVEL_ERROR
+#endif
+#include "../NetCommon/olc_net.hpp"
+
+// Loopback benchmark suite of the NetCommon framework
+// A server_interface and N client_interface instances talk over loopback, in a set
+// of scenarios, for every message size asked for:
+//
+//   pingpong  - every client sends a ServerPing and waits for it to come back (RTT)
+//   echo      - like pingpong, but every client keeps a window of messages in flight
+//   stream    - one client streams messages to the server (one-way latency)
+//   fanin     - every client streams messages to the server at the same time
+//   broadcast - the server sends every message to all clients with MessageAllClients
+//   slowconsumer - broadcast, with one more client that never reads: its outgoing queue
+//               on the server is limited to 1024 messages / 1 MiB, --policy says what
+//               happens to the messages over that (none lets it grow without limit -
+//               careful with big sizes)
+//
+// Each run prints one JSON object per line, so results can be collected and compared:
+// messages/s, MB/s (bodies and headers), latency percentiles in microseconds, heap
+// allocations per message and how many messages the server packs in one write/read
+//
+// usage: LoopbackBenchmark [--scenario all|pingpong|echo|stream|fanin|broadcast|slowconsumer]
+//                          [--threads N] [--clients N] [--seconds S]
+//                          [--sizes 16,256,4096,65536] [--window W]
+//                          [--policy none|drop_oldest|drop_newest|coalesce|disconnect]
+//                          [--dispatch queued|direct]   (how the server calls OnMessage)
+//                          [--profile low_latency|bulk|system]   (socket options, both sides)
+//                          [--cork 0|1]   (stream and fanin send every burst between Cork and Flush)
+
+// every heap allocation of the process is counted (server and clients)
+#include "alloc_counter.hpp"
+
+enum class BenchMsgTypes : uint32_t {
+    ServerPing,
+    Stream,
+    StreamAck,
+    Broadcast,
+    Wake
+};
+
+// Every benchmark message starts with the time it was sent and a sequence number
+struct stamp {
+    int64_t nTime;
+    uint64_t nSequence;
+};
+
+int64_t Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+olc::net::message<BenchMsgTypes> MakeMessage(BenchMsgTypes id, size_t nSize, uint64_t nSequence) {
+    olc::net::message<BenchMsgTypes> msg;
+    msg.header.id = id;
+    msg.body.resize(std::max(nSize, sizeof(stamp)));
+    stamp s = { Now(), nSequence };
+    std::memcpy(msg.body.data(), &s, sizeof(stamp));
+    msg.header.size = msg.size();
+    return msg;
+}
+
+stamp ReadStamp(const olc::net::message<BenchMsgTypes>& msg) {
+    stamp s{};
+    olc::net::message_view<BenchMsgTypes> view(msg);
+    view >> s;
+    return s;
+}
+
+// Latencies in nanoseconds, one recorder per thread, merged at the end
+struct latency_recorder {
+    std::vector<int64_t> vSamples;
+
+    void add(int64_t nSentAt) {
+        vSamples.push_back(Now() - nSentAt);
+    }
+
+    void merge(const latency_recorder& other) {
+        vSamples.insert(vSamples.end(), other.vSamples.begin(), other.vSamples.end());
+    }
+
+    // in microseconds
+    double percentile(double p) {
+        if (vSamples.empty()) {
+            return 0.0;
+        }
+        size_t n = std::min(vSamples.size() - 1, size_t(p * vSamples.size()));
+        std::nth_element(vSamples.begin(), vSamples.begin() + n, vSamples.end());
+        return vSamples[n] / 1000.0;
+    }
+};
+
+class BenchServer : public olc::net::server_interface<BenchMsgTypes> {
+    public:
+        BenchServer(uint16_t nPort, olc::net::dispatch_mode mode) 
+            : olc::net::server_interface<BenchMsgTypes>(nPort, mode), bDirect(mode == olc::net::dispatch_mode::direct) {
+
+        }
+
+        virtual ~BenchServer() {
+            Stop();
+        }
+
+        // messages of the stream scenarios received, and their one-way latency
+        std::atomic<uint64_t> nReceived = 0;
+        latency_recorder latency;
+        // with direct dispatch, OnMessage runs on every thread of the pool
+        bool bDirect = false;
+        std::mutex muxLatency;
+
+        // what OnBackpressure and OnClientDisconnect were told
+        std::atomic<uint64_t> nHighWatermarks = 0;
+        std::atomic<uint64_t> nLowWatermarks = 0;
+        std::atomic<uint64_t> nLimitsReached = 0;
+        std::atomic<uint64_t> nDisconnected = 0;
+
+        size_t ClientCount() {
+            std::scoped_lock lock(muxConnections);
+            return m_connections.size();
+        }
+
+        // Unblocks an Update that is waiting for messages
+        void Wake() {
+            olc::net::owned_message<BenchMsgTypes> msg;
+            msg.msg.header.id = BenchMsgTypes::Wake;
+            m_qMessagesIn.push_back(std::move(msg));
+        }
+
+    protected:
+        virtual bool OnClientConnect(std::shared_ptr<olc::net::connection<BenchMsgTypes>> client) {
+            return true;
+        }
+
+        virtual void OnClientDisconnect(std::shared_ptr<olc::net::connection<BenchMsgTypes>> client) {
+            nDisconnected++;
+        }
+
+        virtual void OnBackpressure(std::shared_ptr<olc::net::connection<BenchMsgTypes>> client, olc::net::backpressure_event event) {
+            switch (event) {
+                case olc::net::backpressure_event::high_watermark: nHighWatermarks++; break;
+                case olc::net::backpressure_event::low_watermark: nLowWatermarks++; break;
+                case olc::net::backpressure_event::limit_reached: nLimitsReached++; break;
+            }
+        }
+
+        virtual void OnMessage(std::shared_ptr<olc::net::connection<BenchMsgTypes>> client, olc::net::message<BenchMsgTypes>& msg) {
+            switch (msg.header.id) {
+                case BenchMsgTypes::ServerPing:
+                {
+                    // simply bounce message back to client - the message is not needed
+                    // anymore, so it is moved rather than copied
+                    client->Send(std::move(msg));
+                    break;
+                }
+                case BenchMsgTypes::Stream:
+                {
+                    stamp s = ReadStamp(msg);
+                    if (bDirect) {
+                        std::scoped_lock lock(muxLatency);
+                        latency.add(s.nTime);
+                    } else {
+                        latency.add(s.nTime);
+                    }
+                    nReceived++;
+                    // every 32 messages the client gets a credit to send more
+                    if (s.nSequence % 32 == 31) {
+                        client->EmplaceSend(BenchMsgTypes::StreamAck, s);
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+};
+
+class BenchClient : public olc::net::client_interface<BenchMsgTypes> {
+
+};
+
+struct config {
+    std::string sScenario = "all";
+    size_t nThreads = 1;
+    size_t nClients = 16;
+    double dSeconds = 2.0;
+    std::vector<size_t> vSizes = { 16, 256, 4096, 65536 };
+    size_t nWindow = 32;
+    std::string sPolicy = "drop_oldest";
+    std::string sDispatch = "queued";
+    std::string sProfile = "low_latency";
+    bool bCork = false;
+};
+
+olc::net::socket_options ParseProfile(const std::string& sProfile) {
+    if (sProfile == "bulk") return olc::net::socket_options::bulk();
+    if (sProfile == "system") return olc::net::socket_options::system();
+    return olc::net::socket_options::low_latency();
+}
+
+olc::net::backpressure_policy ParsePolicy(const std::string& sPolicy) {
+    if (sPolicy == "drop_oldest") return olc::net::backpressure_policy::drop_oldest;
+    if (sPolicy == "drop_newest") return olc::net::backpressure_policy::drop_newest;
+    if (sPolicy == "coalesce") return olc::net::backpressure_policy::coalesce;
+    if (sPolicy == "disconnect") return olc::net::backpressure_policy::disconnect;
+    return olc::net::backpressure_policy::none;
+}
+
+struct result {
+    uint64_t nMessages = 0;
+    double dElapsed = 0.0;
+    latency_recorder latency;
+};
+
+// Runs the server loop on this thread for the duration of the test
+void RunServerLoop(BenchServer& server, double dSeconds, std::atomic<bool>& bRunning) {
+    std::thread timer([&]() {
+        std::this_thread::sleep_for(std::chrono::duration<double>(dSeconds));
+        bRunning = false;
+        server.Wake();
+    });
+    while (bRunning) {
+        server.Update(-1, true);
+    }
+    timer.join();
+}
+
+// Starts a driver thread for every client, fnDrive runs until bRunning is false
+template <typename F>
+std::vector<std::thread> StartDrivers(std::vector<std::unique_ptr<BenchClient>>& vClients, std::vector<latency_recorder>& vLatency, F fnDrive) {
+    std::vector<std::thread> vDrivers;
+    vLatency.resize(vClients.size());
+    for (size_t i = 0; i < vClients.size(); i++) {
+        vDrivers.emplace_back([&, i, fnDrive]() { fnDrive(*vClients[i], vLatency[i]); });
+    }
+    return vDrivers;
+}
+
+// Wakes up the drivers waiting for a message, and waits for them to finish
+void StopDrivers(std::vector<std::unique_ptr<BenchClient>>& vClients, std::vector<std::thread>& vDrivers) {
+    for (auto& client : vClients) {
+        olc::net::owned_message<BenchMsgTypes> msg;
+        msg.msg.header.id = BenchMsgTypes::Wake;
+        client->Incoming().push_back(std::move(msg));
+    }
+    for (auto& driver : vDrivers) {
+        driver.join();
+    }
+}
+
+// pingpong and echo - every client keeps nWindow messages in flight, the server bounces them
+void RunEcho(BenchServer& server, std::vector<std::unique_ptr<BenchClient>>& vClients, const config& cfg, size_t nSize, size_t nWindow, result& res) {
+    std::atomic<bool> bRunning = true;
+    std::atomic<uint64_t> nEchoes = 0;
+    std::vector<latency_recorder> vLatency;
+
+    auto vDrivers = StartDrivers(vClients, vLatency, [&, nSize, nWindow](BenchClient& c, latency_recorder& latency) {
+        for (size_t i = 0; i < nWindow; i++) {
+            c.Send(MakeMessage(BenchMsgTypes::ServerPing, nSize, i));
+        }
+        while (bRunning) {
+            c.Incoming().wait();
+            auto msg = c.Incoming().pop_front();
+            if (msg.msg.header.id != BenchMsgTypes::ServerPing) {
+                continue;
+            }
+            latency.add(ReadStamp(msg.msg).nTime);
+            nEchoes++;
+            if (bRunning) {
+                c.Send(MakeMessage(BenchMsgTypes::ServerPing, nSize, 0));
+            }
+        }
+    });
+
+    auto tStart = std::chrono::steady_clock::now();
+    RunServerLoop(server, cfg.dSeconds, bRunning);
+    res.dElapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - tStart).count();
+    res.nMessages = nEchoes;
+
+    StopDrivers(vClients, vDrivers);
+    for (auto& latency : vLatency) {
+        res.latency.merge(latency);
+    }
+}
+
+// stream and fanin - the clients send to the server, with a credit of nWindow messages
+void RunStream(BenchServer& server, std::vector<std::unique_ptr<BenchClient>>& vClients, const config& cfg, size_t nSize, size_t nWindow, result& res) {
+    std::atomic<bool> bRunning = true;
+    std::vector<latency_recorder> vLatency;
+    nWindow = std::max<size_t>(nWindow, 64);
+
+    auto vDrivers = StartDrivers(vClients, vLatency, [&, nSize, nWindow](BenchClient& c, latency_recorder&) {
+        uint64_t nSent = 0, nAcked = 0;
+        while (bRunning) {
+            if (cfg.bCork) {
+                c.Cork();
+            }
+            while (nSent - nAcked < nWindow) {
+                c.Send(MakeMessage(BenchMsgTypes::Stream, nSize, nSent++));
+            }
+            if (cfg.bCork) {
+                c.Flush();
+            }
+            c.Incoming().wait();
+            auto msg = c.Incoming().pop_front();
+            if (msg.msg.header.id == BenchMsgTypes::StreamAck) {
+                nAcked = std::max(nAcked, ReadStamp(msg.msg).nSequence + 1);
+            }
+        }
+    });
+
+    uint64_t nStart = server.nReceived;
+    auto tStart = std::chrono::steady_clock::now();
+    RunServerLoop(server, cfg.dSeconds, bRunning);
+    res.dElapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - tStart).count();
+    res.nMessages = server.nReceived - nStart;
+
+    StopDrivers(vClients, vDrivers);
+    res.latency.merge(server.latency);
+}
+
+// broadcast - the server sends to all clients, at most nWindow broadcasts in flight
+void RunBroadcast(BenchServer& server, std::vector<std::unique_ptr<BenchClient>>& vClients, const config& cfg, size_t nSize, size_t nWindow, result& res) {
+    std::atomic<bool> bRunning = true;
+    std::atomic<uint64_t> nReceived = 0;
+    std::vector<latency_recorder> vLatency;
+
+    auto vDrivers = StartDrivers(vClients, vLatency, [&](BenchClient& c, latency_recorder& latency) {
+        while (bRunning) {
+            c.Incoming().wait();
+            auto msg = c.Incoming().pop_front();
+            if (msg.msg.header.id == BenchMsgTypes::Broadcast) {
+                latency.add(ReadStamp(msg.msg).nTime);
+                nReceived++;
+            }
+        }
+    });
+
+    uint64_t nSent = 0;
+    auto tStart = std::chrono::steady_clock::now();
+    auto tEnd = tStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(cfg.dSeconds));
+    while (std::chrono::steady_clock::now() < tEnd) {
+        if (nSent * vClients.size() - nReceived < nWindow * vClients.size()) {
+            server.MessageAllClients(MakeMessage(BenchMsgTypes::Broadcast, nSize, nSent++));
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    res.dElapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - tStart).count();
+    res.nMessages = nReceived;
+
+    bRunning = false;
+    StopDrivers(vClients, vDrivers);
+    for (auto& latency : vLatency) {
+        res.latency.merge(latency);
+    }
+}
+
+void RunScenario(const std::string& sScenario, const config& cfg, size_t nSize, uint16_t nPort) {
+    BenchServer server(nPort, cfg.sDispatch == "direct" ? olc::net::dispatch_mode::direct : olc::net::dispatch_mode::queued);
+    server.SetSocketOptions(ParseProfile(cfg.sProfile));
+    server.Start(cfg.nThreads);
+
+    bool bSlowConsumer = sScenario == "slowconsumer";
+    if (bSlowConsumer) {
+        server.SetSendQueueLimits(olc::net::send_queue_limits::make(ParsePolicy(cfg.sPolicy), 1024, 1024 * 1024));
+    }
+
+    size_t nClients = sScenario == "stream" ? 1 : cfg.nClients;
+    std::vector<std::unique_ptr<BenchClient>> vClients;
+    for (size_t i = 0; i < nClients; i++) {
+        vClients.push_back(std::make_unique<BenchClient>());
+        vClients.back()->SetSocketOptions(ParseProfile(cfg.sProfile));
+        vClients.back()->Connect("127.0.0.1", nPort);
+    }
+
+    // the slow consumer is a plain socket that never reads, with a small receive buffer
+    // so the kernel doesn't hide the problem for long
+    asio::io_context slowContext;
+    asio::ip::tcp::socket slowSocket(slowContext);
+    if (bSlowConsumer) {
+        slowSocket.open(asio::ip::tcp::v4());
+        slowSocket.set_option(asio::socket_base::receive_buffer_size(4096));
+        slowSocket.connect(asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), nPort));
+    }
+
+    // wait for every client to be accepted
+    while (server.ClientCount() < nClients + (bSlowConsumer ? 1 : 0)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    result res;
+    uint64_t nAllocationsStart = nAllocations;
+
+    if (sScenario == "pingpong") {
+        RunEcho(server, vClients, cfg, nSize, 1, res);
+    } else if (sScenario == "echo") {
+        RunEcho(server, vClients, cfg, nSize, cfg.nWindow, res);
+    } else if (sScenario == "stream" || sScenario == "fanin") {
+        RunStream(server, vClients, cfg, nSize, cfg.nWindow, res);
+    } else if (sScenario == "broadcast" || bSlowConsumer) {
+        // the flow control of the broadcast only waits for the clients that read
+        RunBroadcast(server, vClients, cfg, nSize, cfg.nWindow, res);
+    }
+
+    double dAllocsPerMsg = res.nMessages ? double(nAllocations - nAllocationsStart) / res.nMessages : 0.0;
+    double dMsgs = res.dElapsed > 0.0 ? res.nMessages / res.dElapsed : 0.0;
+    double dMBs = dMsgs * (std::max(nSize, sizeof(stamp)) + sizeof(olc::net::message_header<BenchMsgTypes>)) / (1024.0 * 1024.0);
+
+    olc::net::server_stats stats = server.GetStats();
+
+    std::printf("{\"scenario\":\"%s\",\"dispatch\":\"%s\",\"profile\":\"%s\",\"cork\":%s,\"threads\":%zu,\"clients\":%zu,\"size\":%zu,\"window\":%zu,"
+        "\"seconds\":%.3f,\"messages\":%llu,\"msgs_per_s\":%.0f,\"mb_per_s\":%.2f,"
+        "\"p50_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f,"
+        "\"allocs_per_msg\":%.2f,\"server_msgs_per_write\":%.2f,\"server_msgs_per_read\":%.2f,"
+        "\"server_queue_out_high_water\":%llu,\"server_queue_out_bytes_high_water\":%llu,"
+        "\"policy\":\"%s\",\"dropped_oldest\":%llu,\"dropped_newest\":%llu,\"coalesced\":%llu,"
+        "\"high_watermarks\":%llu,\"low_watermarks\":%llu,\"limits_reached\":%llu,\"disconnects\":%llu}\n",
+        sScenario.c_str(), cfg.sDispatch.c_str(), cfg.sProfile.c_str(), cfg.bCork ? "true" : "false", cfg.nThreads, nClients, nSize, sScenario == "pingpong" ? size_t(1) : cfg.nWindow,
+        res.dElapsed, (unsigned long long)res.nMessages, dMsgs, dMBs,
+        res.latency.percentile(0.50), res.latency.percentile(0.99), res.latency.percentile(0.999),
+        dAllocsPerMsg, stats.total.MessagesPerWrite(), stats.total.MessagesPerRead(),
+        (unsigned long long)stats.total.nQueueOutHighWater, (unsigned long long)stats.total.nQueueOutBytesHighWater,
+        bSlowConsumer ? cfg.sPolicy.c_str() : "none", (unsigned long long)stats.total.nDroppedOldest,
+        (unsigned long long)stats.total.nDroppedNewest, (unsigned long long)stats.total.nCoalesced,
+        (unsigned long long)server.nHighWatermarks, (unsigned long long)server.nLowWatermarks,
+        (unsigned long long)server.nLimitsReached, (unsigned long long)server.nDisconnected);
+    std::fflush(stdout);
+
+    vClients.clear();
+    server.Stop();
+}
+
+int main(int argc, char* argv[]) {
+    config cfg;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string sArg = argv[i];
+        std::string sValue = argv[i + 1];
+        if (sArg == "--scenario") {
+            cfg.sScenario = sValue;
+        } else if (sArg == "--threads") {
+            cfg.nThreads = std::stoul(sValue);
+        } else if (sArg == "--clients") {
+            cfg.nClients = std::stoul(sValue);
+        } else if (sArg == "--seconds") {
+            cfg.dSeconds = std::stod(sValue);
+        } else if (sArg == "--window") {
+            cfg.nWindow = std::stoul(sValue);
+        } else if (sArg == "--dispatch") {
+            cfg.sDispatch = sValue;
+        } else if (sArg == "--profile") {
+            cfg.sProfile = sValue;
+        } else if (sArg == "--cork") {
+            cfg.bCork = sValue == "1" || sValue == "true";
+        } else if (sArg == "--policy") {
+            cfg.sPolicy = sValue;
+        } else if (sArg == "--sizes") {
+            cfg.vSizes.clear();
+            size_t nPos = 0;
+            while (nPos < sValue.size()) {
+                size_t nComma = sValue.find(',', nPos);
+                if (nComma == std::string::npos) {
+                    nComma = sValue.size();
+                }
+                cfg.vSizes.push_back(std::stoul(sValue.substr(nPos, nComma - nPos)));
+                nPos = nComma + 1;
+            }
+        } else {
+            std::fprintf(stderr, "Unknown option %s\n", sArg.c_str());
+            return 1;
+        }
+    }
+
+    std::vector<std::string> vScenarios = { "pingpong", "echo", "stream", "fanin", "broadcast", "slowconsumer" };
+    if (cfg.sScenario != "all") {
+        vScenarios = { cfg.sScenario };
+    }
+
+    // every run gets a server of its own, on a port of its own
+    uint16_t nPort = 60100;
+    for (auto& sScenario : vScenarios) {
+        for (size_t nSize : cfg.vSizes) {
+            RunScenario(sScenario, cfg, nSize, nPort++);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,141 @@
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include <ctime>
+#include "../NetCommon/olc_net.hpp"
+
+// Contention benchmark of the queues used for incoming messages
+// P producer threads push items as fast as they can, while a single consumer
+// waits for them and takes them out - the same pattern as the I/O threads and
+// the Update loop of the server
+//
+// The second part measures the cost of dispatching messages on the consumer side
+// (the work of server_interface::Update) at a fixed rate of incoming messages:
+// popping them one by one (empty() + pop_front()) against taking them in batches
+// with drain(). The CPU time of the consumer thread is divided by the number of
+// messages, so time spent asleep waiting for messages is not counted
+//
+// usage: QueueBenchmark [producers] [items per producer] [dispatch rate msgs/s] [dispatch seconds]
+
+// a message sized item, like the owned_message<T> pushed by the connections
+struct item {
+    std::shared_ptr<int> remote;
+    std::vector<uint8_t> body;
+};
+
+template <typename Queue>
+double Run(size_t nProducers, size_t nItems) {
+    Queue queue;
+
+    auto tStart = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> vProducers;
+    for (size_t p = 0; p < nProducers; p++) {
+        vProducers.emplace_back([&]() {
+            for (size_t i = 0; i < nItems; i++) {
+                queue.push_back(item{});
+            }
+        });
+    }
+
+    size_t nTotal = nProducers * nItems;
+    for (size_t nReceived = 0; nReceived < nTotal; ) {
+        queue.wait();
+        while (!queue.empty()) {
+            queue.pop_front();
+            nReceived++;
+        }
+    }
+
+    for (auto& producer : vProducers) {
+        producer.join();
+    }
+
+    double dElapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - tStart).count();
+    return nTotal / dElapsed;
+}
+
+// CPU time used by the calling thread, in seconds
+double ThreadCpuTime() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// nanoseconds of consumer CPU time per message, with the producers pushing nRate messages
+// per second in total (in small bursts, every 100us)
+template <typename Queue>
+double Dispatch(size_t nProducers, double dRate, double dSeconds, bool bBatched) {
+    Queue queue;
+    std::atomic<bool> bRunning = true;
+
+    std::vector<std::thread> vProducers;
+    for (size_t p = 0; p < nProducers; p++) {
+        vProducers.emplace_back([&]() {
+            const auto tTick = std::chrono::microseconds(100);
+            size_t nBurst = std::max<size_t>(1, size_t(dRate / nProducers / 10000));
+            auto tNext = std::chrono::steady_clock::now();
+            while (bRunning) {
+                for (size_t i = 0; i < nBurst; i++) {
+                    queue.push_back(item{});
+                }
+                tNext += tTick;
+                std::this_thread::sleep_until(tNext);
+            }
+            // wake up the consumer one last time
+            queue.push_back(item{});
+        });
+    }
+
+    // the consumer is the "Update" loop
+    std::deque<item> deqBatch;
+    size_t nReceived = 0;
+    double dCpuStart = ThreadCpuTime();
+    auto tEnd = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(dSeconds));
+    while (std::chrono::steady_clock::now() < tEnd) {
+        queue.wait();
+        if (bBatched) {
+            queue.drain(deqBatch);
+            while (!deqBatch.empty()) {
+                deqBatch.pop_front();
+                nReceived++;
+            }
+        } else {
+            while (!queue.empty()) {
+                queue.pop_front();
+                nReceived++;
+            }
+        }
+    }
+    double dCpu = ThreadCpuTime() - dCpuStart;
+
+    bRunning = false;
+    for (auto& producer : vProducers) {
+        producer.join();
+    }
+
+    return nReceived ? dCpu * 1e9 / nReceived : 0.0;
+}
+
+int main(int argc, char* argv[]) {
+    size_t nProducers = argc > 1 ? std::stoul(argv[1]) : 4;
+    size_t nItems     = argc > 2 ? std::stoul(argv[2]) : 1000000;
+    double dRate      = argc > 3 ? std::stod(argv[3]) : 1000000.0;
+    double dSeconds   = argc > 4 ? std::stod(argv[4]) : 3.0;
+
+    double dLocked   = Run<olc::net::tsqueue<item>>(nProducers, nItems);
+    double dLockFree = Run<olc::net::mpscqueue<item>>(nProducers, nItems);
+
+    std::printf("producers=%zu items=%zu tsqueue items/s=%.0f mpscqueue items/s=%.0f speedup=%.2f\n",
+        nProducers, nItems, dLocked, dLockFree, dLockFree / dLocked);
+
+    double dLockedPop    = Dispatch<olc::net::tsqueue<item>>(nProducers, dRate, dSeconds, false);
+    double dLockedDrain  = Dispatch<olc::net::tsqueue<item>>(nProducers, dRate, dSeconds, true);
+    double dLockFreePop   = Dispatch<olc::net::mpscqueue<item>>(nProducers, dRate, dSeconds, false);
+    double dLockFreeDrain = Dispatch<olc::net::mpscqueue<item>>(nProducers, dRate, dSeconds, true);
+
+    std::printf("producers=%zu rate=%.0f tsqueue pop ns/msg=%.1f tsqueue drain ns/msg=%.1f mpscqueue pop ns/msg=%.1f mpscqueue drain ns/msg=%.1f\n",
+        nProducers, dRate, dLockedPop, dLockedDrain, dLockFreePop, dLockFreeDrain);
+
+    return 0;
+}
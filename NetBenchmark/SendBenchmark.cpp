@@ -0,0 +1,123 @@
+#include <iostream>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+// only errors of the framework are logged, so the results (written with printf)
+// are not mixed with connection messages
+#ifndef OLC_NET_LOG_LEVEL
+#define OLC_NET_LOG_LEVEL OLC_NET_LOG_LEVEL_ERROR
+#endif
+#include "../NetCommon/olc_net.hpp"
+
+// Counts the heap allocations needed to send a message, for each way of sending one
+// A client streams messages to a server over loopback, and all the allocations made
+// by the process (client and server) are divided by the number of messages
+//
+//   copy    - Send(const message<T>&)  the message is built once and copied for every send
+//   move    - Send(message<T>&&)       a new message is built and moved for every send
+//   emplace - EmplaceSend(id, args...) the message is built directly in the outgoing queue
+//
+// usage: SendBenchmark [messages]
+
+#include "alloc_counter.hpp"
+
+enum class BenchMsgTypes : uint32_t {
+    Position
+};
+
+struct vec3 {
+    float x, y, z;
+};
+
+class SinkServer : public olc::net::server_interface<BenchMsgTypes> {
+    public:
+        SinkServer(uint16_t nPort) : olc::net::server_interface<BenchMsgTypes>(nPort) {
+
+        }
+
+        virtual ~SinkServer() {
+            Stop();
+        }
+
+        std::atomic<uint64_t> nReceived = 0;
+
+    protected:
+        virtual bool OnClientConnect(std::shared_ptr<olc::net::connection<BenchMsgTypes>> client) {
+            return true;
+        }
+
+        virtual void OnMessage(std::shared_ptr<olc::net::connection<BenchMsgTypes>> client, olc::net::message<BenchMsgTypes>& msg) {
+            nReceived++;
+        }
+};
+
+int main(int argc, char* argv[]) {
+    size_t nMessages = argc > 1 ? std::stoul(argv[1]) : 200000;
+    uint16_t nPort = 60101;
+
+    SinkServer server(nPort);
+    server.Start();
+
+    olc::net::client_interface<BenchMsgTypes> client;
+    client.Connect("127.0.0.1", nPort);
+    while (!client.IsConnected()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    uint32_t nPlayer = 42;
+    vec3 vPosition = { 1.0f, 2.0f, 3.0f };
+
+    olc::net::message<BenchMsgTypes> msgTemplate;
+    msgTemplate.header.id = BenchMsgTypes::Position;
+    msgTemplate << nPlayer << vPosition;
+
+    auto Run = [&](const char* sName, auto fnSend) {
+        // the server is drained on this thread, like a game loop would
+        auto fnPump = [&](uint64_t nTarget) {
+            while (server.nReceived < nTarget) {
+                server.Update(-1, true);
+            }
+        };
+
+        // warm up - fill the pools and the queues first, only the steady state is measured
+        uint64_t nTarget = server.nReceived + nMessages / 10;
+        for (size_t i = 0; i < nMessages / 10; i++) {
+            fnSend();
+        }
+        fnPump(nTarget);
+
+        uint64_t nStart = nAllocations;
+        nTarget = server.nReceived + nMessages;
+        for (size_t i = 0; i < nMessages; i++) {
+            fnSend();
+            // keep the number of messages in flight small and stable
+            if (i % 64 == 63) {
+                fnPump(nTarget - nMessages + i + 1);
+            }
+        }
+        fnPump(nTarget);
+
+        std::printf("%-8s allocs/send=%.2f\n", sName, double(nAllocations - nStart) / nMessages);
+    };
+
+    Run("copy", [&]() {
+        client.Send(msgTemplate);
+    });
+
+    Run("move", [&]() {
+        olc::net::message<BenchMsgTypes> msg;
+        msg.header.id = BenchMsgTypes::Position;
+        msg << nPlayer << vPosition;
+        client.Send(std::move(msg));
+    });
+
+    Run("emplace", [&]() {
+        client.EmplaceSend(BenchMsgTypes::Position, nPlayer, vPosition);
+    });
+
+    client.Disconnect();
+    server.Stop();
+    return 0;
+}
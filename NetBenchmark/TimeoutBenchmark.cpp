@@ -0,0 +1,189 @@
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+// only errors of the framework are logged, so the results (written with printf)
+// are not mixed with connection messages
+#ifndef OLC_NET_LOG_LEVEL
+#define OLC_NET_LOG_LEVEL OLC_NET_LOG_LEVEL_ERROR
+#endif
+#include "../NetCommon/olc_net.hpp"
+
+// Timeouts of the server (SetTimeouts, net_timer.hpp): what they cost, and how fast they
+// find dead clients
+//
+//   arm    - a timer per connection with asio (armed, then re-armed as a read would do it)
+//            against a timer_wheel entry per connection (added, then expired). With the
+//            wheel, a read only stores its time: that is the cost of a "re-arm"
+//   idle   - live clients that say nothing (they answer the heartbeats) and dead ones (sockets
+//            that never read nor write): how long until every dead one is closed, and whether
+//            the live ones are kept
+//   write  - the same, with a write timeout: every client is sent a big message, the live
+//            ones read it, the dead ones don't
+//
+// usage: TimeoutBenchmark [timers] [live clients] [dead clients]
+
+enum class TimeoutMsgTypes : uint32_t {
+    Data
+};
+
+double Seconds(std::chrono::steady_clock::time_point tStart) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - tStart).count();
+}
+
+void RunArm(size_t nTimers) {
+    // asio: a timer per connection
+    {
+        asio::io_context context;
+        std::vector<std::unique_ptr<asio::steady_timer>> vTimers;
+        vTimers.reserve(nTimers);
+        for (size_t i = 0; i < nTimers; i++) {
+            vTimers.push_back(std::make_unique<asio::steady_timer>(context));
+        }
+        auto tStart = std::chrono::steady_clock::now();
+        for (auto& timer : vTimers) {
+            timer->expires_after(std::chrono::seconds(30));
+            timer->async_wait([](std::error_code) {});
+        }
+        double dArm = Seconds(tStart);
+        // a read on every connection moves its timeout
+        tStart = std::chrono::steady_clock::now();
+        for (auto& timer : vTimers) {
+            timer->expires_after(std::chrono::seconds(30));
+            timer->async_wait([](std::error_code) {});
+        }
+        context.poll();
+        double dRearm = Seconds(tStart);
+        std::printf("{\"scenario\":\"arm\",\"timers\":\"asio\",\"count\":%zu,\"arm_ns\":%.1f,\"rearm_ns\":%.1f}\n",
+            nTimers, dArm * 1e9 / nTimers, dRearm * 1e9 / nTimers);
+    }
+
+    // the wheel: an entry per connection, and the time of the last read
+    {
+        olc::net::timer_wheel<uint32_t> wheel(std::chrono::milliseconds(1));
+        auto tDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(50);
+        auto tStart = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < nTimers; i++) {
+            // spread over 1000 ticks
+            wheel.Add(tDeadline + std::chrono::milliseconds(i % 1000), uint32_t(i));
+        }
+        double dArm = Seconds(tStart);
+
+        olc::net::connection_counters counters;
+        tStart = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < nTimers; i++) {
+            counters.TouchRead();
+        }
+        double dRearm = Seconds(tStart);
+
+        std::vector<uint32_t> vExpired;
+        vExpired.reserve(nTimers);
+        tStart = std::chrono::steady_clock::now();
+        wheel.Advance(tDeadline + std::chrono::seconds(2), vExpired);
+        double dExpire = Seconds(tStart);
+        std::printf("{\"scenario\":\"arm\",\"timers\":\"wheel\",\"count\":%zu,\"arm_ns\":%.1f,\"rearm_ns\":%.1f,\"expire_ns\":%.1f,\"expired\":%zu}\n",
+            nTimers, dArm * 1e9 / nTimers, dRearm * 1e9 / nTimers, dExpire * 1e9 / nTimers, vExpired.size());
+    }
+    std::fflush(stdout);
+}
+
+class TimeoutServer : public olc::net::server_interface<TimeoutMsgTypes> {
+    public:
+        TimeoutServer(uint16_t nPort) : olc::net::server_interface<TimeoutMsgTypes>(nPort) {}
+        virtual ~TimeoutServer() { Stop(); }
+
+        std::atomic<uint64_t> nDisconnects = 0;
+
+        size_t ClientCount() {
+            std::scoped_lock lock(muxConnections);
+            return m_connections.size();
+        }
+
+    protected:
+        virtual bool OnClientConnect(std::shared_ptr<olc::net::connection<TimeoutMsgTypes>> client) {
+            return true;
+        }
+
+        virtual void OnClientDisconnect(std::shared_ptr<olc::net::connection<TimeoutMsgTypes>> client) {
+            nDisconnects++;
+        }
+};
+
+// Live clients: an empty script only keeps them open, and their connections answer heartbeats
+class QuietPool : public olc::net::client_pool<TimeoutMsgTypes> {};
+
+void RunDetect(const char* pScenario, const olc::net::timeout_options& options, size_t nLive, size_t nDead, size_t nFlood, uint16_t nPort) {
+    TimeoutServer server(nPort);
+    server.SetTimeouts(options, std::chrono::milliseconds(20));
+    server.Start(1);
+
+    QuietPool pool;
+    pool.Start("127.0.0.1", nPort, nLive, 1);
+
+    // dead clients: connected, and then never a byte either way
+    asio::io_context context;
+    std::vector<asio::ip::tcp::socket> vDead;
+    for (size_t i = 0; i < nDead; i++) {
+        vDead.emplace_back(context);
+        asio::error_code ec;
+        vDead.back().connect(asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), nPort), ec);
+        if (!ec) {
+            // a small receive buffer, so a flood fills it quickly
+            vDead.back().set_option(asio::socket_base::receive_buffer_size(4096), ec);
+        }
+    }
+    for (int i = 0; i < 1000 && server.ClientCount() < nLive + nDead; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+
+    auto tStart = std::chrono::steady_clock::now();
+    if (nFlood > 0) {
+        olc::net::message<TimeoutMsgTypes> msg;
+        msg.header.id = TimeoutMsgTypes::Data;
+        msg.body.resize(nFlood);
+        msg.header.size = uint32_t(msg.size());
+        server.MessageAllClients(std::move(msg));
+    }
+
+    // until every dead client is closed (or 10 s)
+    double dDetect = -1.0;
+    while (Seconds(tStart) < 10.0) {
+        olc::net::server_stats stats = server.GetStats();
+        if (stats.nIdleTimeouts + stats.nWriteTimeouts >= nDead) {
+            dDetect = Seconds(tStart);
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    // and a little more, to see that the live ones stay
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+    olc::net::server_stats stats = server.GetStats();
+    std::printf("{\"scenario\":\"%s\",\"live\":%zu,\"dead\":%zu,\"idle_ms\":%lld,\"write_ms\":%lld,\"heartbeat_ms\":%lld,"
+        "\"detect_ms\":%.0f,\"idle_timeouts\":%llu,\"write_timeouts\":%llu,\"heartbeats\":%llu,\"disconnects\":%llu,\"kept\":%zu}\n",
+        pScenario, nLive, nDead, (long long)options.idle.count(), (long long)options.write.count(), (long long)options.heartbeat.count(),
+        dDetect * 1000.0, (unsigned long long)stats.nIdleTimeouts, (unsigned long long)stats.nWriteTimeouts,
+        (unsigned long long)stats.nHeartbeats, (unsigned long long)server.nDisconnects.load(), stats.nConnections);
+    std::fflush(stdout);
+
+    pool.Stop();
+    vDead.clear();
+    server.Stop();
+}
+
+int main(int argc, char* argv[]) {
+    size_t nTimers = argc > 1 ? std::stoul(argv[1]) : 100000;
+    size_t nLive = argc > 2 ? std::stoul(argv[2]) : 200;
+    size_t nDead = argc > 3 ? std::stoul(argv[3]) : 200;
+
+    RunArm(nTimers);
+    RunDetect("idle", olc::net::timeout_options::make(std::chrono::milliseconds(500), std::chrono::milliseconds(0), std::chrono::milliseconds(150)),
+        nLive, nDead, 0, 63000);
+    // the live clients must read the whole message before the write timeout
+    RunDetect("write", olc::net::timeout_options::make(std::chrono::milliseconds(0), std::chrono::milliseconds(1000)),
+        std::min<size_t>(nLive, 20), std::min<size_t>(nDead, 20), 8 * 1024 * 1024, 63001);
+
+    return 0;
+}
@@ -0,0 +1,183 @@
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+// only errors of the framework are logged, so the results (written with printf)
+// are not mixed with connection messages
+#ifndef OLC_NET_LOG_LEVEL
+#define OLC_NET_LOG_LEVEL OLC_NET_LOG_LEVEL_ERROR
+#endif
+#include "../NetCommon/olc_net.hpp"
+
+// The same-host transports (net_transport.hpp) side by side: loopback TCP, a Unix
+// domain socket and the shared memory rings. A client and a server in this process
+// echo messages, and for each transport and body size it prints:
+//
+//   pingpong - one message in flight: rtt p50/p99 in us and round trips per second
+//   stream   - 64 messages in flight: messages and MB per second (each way)
+//
+// with the system calls the connections made for it (reads + writes; over shared memory,
+// only the times a side had to sleep), and checks every echo has the body it was sent
+//
+// usage: TransportBenchmark [seconds per test] [sizes, comma separated]
+
+enum class TransportMsgTypes : uint32_t {
+    Echo
+};
+
+int64_t Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class EchoServer : public olc::net::server_interface<TransportMsgTypes> {
+    public:
+        EchoServer(const std::string& sEndpoint)
+            : olc::net::server_interface<TransportMsgTypes>(sEndpoint, olc::net::dispatch_mode::direct) {
+
+        }
+
+        virtual ~EchoServer() {
+            Stop();
+        }
+
+    protected:
+        virtual bool OnClientConnect(std::shared_ptr<olc::net::connection<TransportMsgTypes>> client) {
+            return true;
+        }
+
+        virtual void OnMessage(std::shared_ptr<olc::net::connection<TransportMsgTypes>> client, olc::net::message<TransportMsgTypes>& msg) {
+            client->Send(std::move(msg));
+        }
+};
+
+// the body: the time it was sent, then a pattern that depends on its sequence number
+olc::net::message<TransportMsgTypes> MakeMessage(size_t nSize, uint64_t nSequence) {
+    olc::net::message<TransportMsgTypes> msg;
+    msg.header.id = TransportMsgTypes::Echo;
+    msg.body.resize(std::max(nSize, sizeof(int64_t) + sizeof(uint64_t)));
+    int64_t nTime = Now();
+    std::memcpy(msg.body.data(), &nTime, sizeof(nTime));
+    std::memcpy(msg.body.data() + sizeof(nTime), &nSequence, sizeof(nSequence));
+    for (size_t i = sizeof(nTime) + sizeof(nSequence); i < msg.body.size(); i++) {
+        msg.body[i] = uint8_t(nSequence + i);
+    }
+    msg.header.size = uint32_t(msg.size());
+    return msg;
+}
+
+bool CheckMessage(const olc::net::message<TransportMsgTypes>& msg) {
+    uint64_t nSequence;
+    std::memcpy(&nSequence, msg.body.data() + sizeof(int64_t), sizeof(nSequence));
+    for (size_t i = sizeof(int64_t) + sizeof(nSequence); i < msg.body.size(); i++) {
+        if (msg.body[i] != uint8_t(nSequence + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+class EchoClient : public olc::net::client_interface<TransportMsgTypes> {
+    public:
+        EchoClient() : olc::net::client_interface<TransportMsgTypes>(olc::net::dispatch_mode::direct) {}
+        virtual ~EchoClient() { Disconnect(); }
+
+        size_t nSize = 0;
+        std::atomic<uint64_t> nReplies = 0;
+        std::atomic<uint64_t> nBad = 0;
+        std::atomic<bool> bRunning = true;
+        olc::net::latency_histogram latency;
+
+    protected:
+        // every reply sends the next message, so the window stays as it was filled
+        virtual void OnMessage(olc::net::message<TransportMsgTypes>& msg) {
+            int64_t nSent;
+            std::memcpy(&nSent, msg.body.data(), sizeof(nSent));
+            latency.add(uint64_t(Now() - nSent));
+            if (!CheckMessage(msg)) {
+                nBad++;
+            }
+            uint64_t nReply = nReplies.fetch_add(1, std::memory_order_relaxed);
+            if (bRunning.load(std::memory_order_relaxed)) {
+                Send(MakeMessage(nSize, nReply));
+            }
+        }
+};
+
+void Run(const char* pName, const std::string& sEndpoint, const char* pScenario, size_t nWindow, size_t nSize, double dSeconds) {
+    EchoServer server(sEndpoint);
+    server.Start(1);
+
+    EchoClient client;
+    client.nSize = nSize;
+    client.Connect(sEndpoint);
+    for (int i = 0; i < 200 && !client.IsConnected(); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    for (size_t i = 0; i < nWindow; i++) {
+        client.Send(MakeMessage(nSize, i));
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(dSeconds));
+    client.bRunning = false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    olc::net::connection_stats clientStats = client.GetStats();
+    olc::net::server_stats serverStats = server.GetStats();
+    uint64_t nReplies = client.nReplies.load();
+    uint64_t nSyscalls = clientStats.nReads + clientStats.nWrites + serverStats.total.nReads + serverStats.total.nWrites;
+    if (sEndpoint.rfind("shm://", 0) == 0) {
+        // reads and writes of the rings are not system calls, the wake ups are (a doorbell
+        // written and read)
+        nSyscalls = 2 * (clientStats.nRingWakeups + serverStats.total.nRingWakeups);
+    }
+
+    std::printf("{\"transport\":\"%s\",\"scenario\":\"%s\",\"size\":%zu,\"msgs_per_s\":%.0f,\"mb_per_s\":%.1f,"
+        "\"rtt_p50_us\":%.1f,\"rtt_p99_us\":%.1f,\"syscalls_per_msg\":%.3f,\"bad\":%llu}\n",
+        pName, pScenario, nSize, nReplies / dSeconds, nReplies * double(nSize) / dSeconds / 1e6,
+        client.latency.percentile(0.50) / 1000.0, client.latency.percentile(0.99) / 1000.0,
+        nReplies ? double(nSyscalls) / nReplies : 0.0, (unsigned long long)client.nBad.load());
+    std::fflush(stdout);
+
+    client.Disconnect();
+    server.Stop();
+}
+
+int main(int argc, char* argv[]) {
+    double dSeconds = argc > 1 ? std::stod(argv[1]) : 1.0;
+    std::vector<size_t> vSizes = { 16, 1024, 64 * 1024 };
+    if (argc > 2) {
+        vSizes.clear();
+        std::string sSizes = argv[2];
+        for (size_t nStart = 0; nStart < sSizes.size(); ) {
+            size_t nEnd = sSizes.find(',', nStart);
+            vSizes.push_back(std::stoul(sSizes.substr(nStart, nEnd - nStart)));
+            nStart = nEnd == std::string::npos ? sSizes.size() : nEnd + 1;
+        }
+    }
+
+    struct transport_case {
+        const char* pName;
+        std::string sEndpoint;
+    };
+    std::vector<transport_case> vTransports = {
+        { "tcp", "tcp://127.0.0.1:60900" },
+#if OLC_NET_HAS_LOCAL_TRANSPORT
+        { "unix", "unix:///tmp/olc-net-bench.sock" },
+        { "shm", "shm:///tmp/olc-net-bench-shm.sock" },
+#endif
+    };
+
+    for (size_t nSize : vSizes) {
+        for (auto& t : vTransports) {
+            Run(t.pName, t.sEndpoint, "pingpong", 1, nSize, dSeconds);
+        }
+        for (auto& t : vTransports) {
+            Run(t.pName, t.sEndpoint, "stream", 64, nSize, dSeconds);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,148 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+// Counts every heap allocation of the process (server and clients), for the benchmarks
+// that report allocations per message
+//
+// It replaces the global operator new and delete, so it is included by the one source
+// file of a benchmark. Every form of them (array, sized, aligned, nothrow) goes through
+// malloc/aligned_alloc and free, so a block is always freed the way it was allocated.
+// They are never inlined: inlined into a caller, the compiler would see a pointer from
+// operator new given to free and warn about it (-Wmismatched-new-delete)
+
+#if defined(_MSC_VER)
+#define OLC_BENCH_NOINLINE __declspec(noinline)
+#else
+#define OLC_BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+static std::atomic<uint64_t> nAllocations = 0;
+
+namespace alloc_counter {
+
+    inline void* Allocate(std::size_t nSize) noexcept {
+        nAllocations.fetch_add(1, std::memory_order_relaxed);
+        return std::malloc(nSize ? nSize : 1);
+    }
+
+    inline void* AllocateAligned(std::size_t nSize, std::align_val_t alignment) noexcept {
+        nAllocations.fetch_add(1, std::memory_order_relaxed);
+        std::size_t nAlign = std::max(static_cast<std::size_t>(alignment), sizeof(void*));
+        // aligned_alloc wants a size that is a multiple of the alignment
+        std::size_t nRounded = (std::max<std::size_t>(nSize, 1) + nAlign - 1) / nAlign * nAlign;
+#if defined(_MSC_VER)
+        return _aligned_malloc(nRounded, nAlign);
+#else
+        return std::aligned_alloc(nAlign, nRounded);
+#endif
+    }
+
+    inline void Free(void* p) noexcept {
+        std::free(p);
+    }
+
+    inline void FreeAligned(void* p) noexcept {
+#if defined(_MSC_VER)
+        _aligned_free(p);
+#else
+        std::free(p);
+#endif
+    }
+}
+
+OLC_BENCH_NOINLINE void* operator new(std::size_t nSize) {
+    if (void* p = alloc_counter::Allocate(nSize)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+OLC_BENCH_NOINLINE void* operator new[](std::size_t nSize) {
+    if (void* p = alloc_counter::Allocate(nSize)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+OLC_BENCH_NOINLINE void* operator new(std::size_t nSize, const std::nothrow_t&) noexcept {
+    return alloc_counter::Allocate(nSize);
+}
+
+OLC_BENCH_NOINLINE void* operator new[](std::size_t nSize, const std::nothrow_t&) noexcept {
+    return alloc_counter::Allocate(nSize);
+}
+
+OLC_BENCH_NOINLINE void* operator new(std::size_t nSize, std::align_val_t alignment) {
+    if (void* p = alloc_counter::AllocateAligned(nSize, alignment)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+OLC_BENCH_NOINLINE void* operator new[](std::size_t nSize, std::align_val_t alignment) {
+    if (void* p = alloc_counter::AllocateAligned(nSize, alignment)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+OLC_BENCH_NOINLINE void* operator new(std::size_t nSize, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return alloc_counter::AllocateAligned(nSize, alignment);
+}
+
+OLC_BENCH_NOINLINE void* operator new[](std::size_t nSize, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return alloc_counter::AllocateAligned(nSize, alignment);
+}
+
+OLC_BENCH_NOINLINE void operator delete(void* p) noexcept {
+    alloc_counter::Free(p);
+}
+
+OLC_BENCH_NOINLINE void operator delete[](void* p) noexcept {
+    alloc_counter::Free(p);
+}
+
+OLC_BENCH_NOINLINE void operator delete(void* p, std::size_t) noexcept {
+    alloc_counter::Free(p);
+}
+
+OLC_BENCH_NOINLINE void operator delete[](void* p, std::size_t) noexcept {
+    alloc_counter::Free(p);
+}
+
+OLC_BENCH_NOINLINE void operator delete(void* p, const std::nothrow_t&) noexcept {
+    alloc_counter::Free(p);
+}
+
+OLC_BENCH_NOINLINE void operator delete[](void* p, const std::nothrow_t&) noexcept {
+    alloc_counter::Free(p);
+}
+
+OLC_BENCH_NOINLINE void operator delete(void* p, std::align_val_t) noexcept {
+    alloc_counter::FreeAligned(p);
+}
+
+OLC_BENCH_NOINLINE void operator delete[](void* p, std::align_val_t) noexcept {
+    alloc_counter::FreeAligned(p);
+}
+
+OLC_BENCH_NOINLINE void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+    alloc_counter::FreeAligned(p);
+}
+
+OLC_BENCH_NOINLINE void operator delete[](void* p, std::size_t, std::align_val_t) noexcept {
+    alloc_counter::FreeAligned(p);
+}
+
+OLC_BENCH_NOINLINE void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept {
+    alloc_counter::FreeAligned(p);
+}
+
+OLC_BENCH_NOINLINE void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept {
+    alloc_counter::FreeAligned(p);
+}
@@ -0,0 +1,55 @@
+#include "../NetCommon/olc_net.hpp"
+#include <iostream>
+#include <string>
+
+// Load test for SimpleServer: many clients, all pinging the server, from one process
+// usage: LoadClient [connections] [threads] [connections per second] [seconds]
+
+enum class CustomMsgTypes : uint32_t {
+    ServerAccept,
+    ServerDeny,
+    ServerPing,
+    MessageAll,
+    ServerMessage
+};
+
+class PingLoad : public olc::net::client_pool<CustomMsgTypes> {
+
+    protected:
+        // every client pings the server every 100 ms, for as long as the test runs
+        virtual olc::net::load_script<CustomMsgTypes> GetScript(size_t nIndex) {
+            olc::net::message<CustomMsgTypes> msg;
+            msg.header.id = CustomMsgTypes::ServerPing;
+            msg << nIndex;
+
+            olc::net::load_script<CustomMsgTypes> script;
+            script.Send(msg).Expect(CustomMsgTypes::ServerPing).Pause(std::chrono::milliseconds(100));
+            return script;
+        }
+};
+
+int main(int argc, char* argv[]) {
+    size_t nConnections = argc > 1 ? std::stoul(argv[1]) : 1000;
+    size_t nThreads = argc > 2 ? std::stoul(argv[2]) : 2;
+    double dRate = argc > 3 ? std::stod(argv[3]) : 200.0;
+    int nSeconds = argc > 4 ? std::stoi(argv[4]) : 10;
+
+    PingLoad load;
+    if (!load.Start("127.0.0.1", 60000, nConnections, nThreads, dRate)) {
+        return 1;
+    }
+
+    for (int i = 0; i < nSeconds; i++) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        olc::net::client_pool_stats stats = load.GetStats();
+        std::cout << "[" << stats.dElapsed << "s] connected " << stats.nConnected << "/" << stats.nStarted
+            << " (failed " << stats.nFailed << ", lost " << stats.nDisconnected << ")"
+            << " out " << stats.dMessagesOutRate << " msg/s, in " << stats.dMessagesInRate << " msg/s"
+            << ", latency p50 " << stats.dLatencyP50 << " us, p99 " << stats.dLatencyP99
+            << " us, p999 " << stats.dLatencyP999 << " us\n";
+    }
+
+    load.Stop();
+    return 0;
+}
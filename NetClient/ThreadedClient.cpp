@@ -64,6 +64,10 @@ int main()
             if (!c.Incoming().empty())
             {
                 auto msg = c.Incoming().pop_front().msg;
+                // the body is read through a view: a message that is too short (truncated,
+                // or from something else than our server) fails the read instead of reading
+                // past the end of the body
+                olc::net::message_view<CustomMsgTypes> view(msg);
 
                 switch (msg.header.id)
                 {
@@ -77,16 +81,24 @@ int main()
                 {
                     std::chrono::system_clock::time_point timeNow = std::chrono::system_clock::now();
                     std::chrono::system_clock::time_point timeThen;
-                    msg >> timeThen;
-                    std::cout << "Ping: " << std::chrono::duration<double>(timeNow - timeThen).count() << "\n";
+                    if (view >> timeThen)
+                    {
+                        std::cout << "Ping: " << std::chrono::duration<double>(timeNow - timeThen).count() << "\n";
+                    }
+                    else
+                    {
+                        std::cout << "Malformed ping reply\n";
+                    }
                     break;
                 }
 
                 case CustomMsgTypes::ServerMessage:
                 {
                     uint32_t clientID;
-                    msg >> clientID;
-                    std::cout << "Message from: " << clientID << "\n";
+                    if (view >> clientID)
+                    {
+                        std::cout << "Message from: " << clientID << "\n";
+                    }
                     break;
                 }
                 }
@@ -0,0 +1,68 @@
+#pragma once
+#include "net_common.hpp"
+
+namespace olc {
+
+    namespace net {
+
+        // What a connection does with a message that doesn't fit in its outgoing queue
+        enum class backpressure_policy {
+            // no limit at all, the queue grows as long as the remote doesn't read
+            none,
+            // the oldest messages that are not being written yet make room for the new one
+            drop_oldest,
+            // the new message is thrown away
+            drop_newest,
+            // the new message replaces the last queued message with the same id (only the
+            // latest state of something is sent); if there is none, the oldest is dropped
+            coalesce,
+            // the remote is too slow to be kept - the connection is closed
+            disconnect
+        };
+
+        // What OnBackpressure is told about
+        enum class backpressure_event {
+            // the queue went above its high watermark
+            high_watermark,
+            // the queue went back under its low watermark
+            low_watermark,
+            // a message didn't fit and the policy was applied
+            // reported once, until the queue is back under the low watermark
+            limit_reached
+        };
+
+        // Limits of the outgoing queue of a connection (0 means no limit)
+        // Every message in the queue counts, including the ones being written, and a message
+        // counts for its header and body. The limits should leave room for the biggest message.
+        // The control frames of the connection (capabilities, heartbeat replies, datagram
+        // offers) don't count, and are never dropped or coalesced
+        struct send_queue_limits {
+            backpressure_policy policy = backpressure_policy::none;
+
+            // above these the policy is applied
+            size_t nMaxMessages = 0;
+            size_t nMaxBytes = 0;
+
+            // OnBackpressure is told when the queue reaches one of the high watermarks...
+            size_t nHighWaterMessages = 0;
+            size_t nHighWaterBytes = 0;
+            // ...and again when it is back under both low watermarks
+            size_t nLowWaterMessages = 0;
+            size_t nLowWaterBytes = 0;
+
+            // the usual setup: the policy applies at the limits, the high watermark is at
+            // 3/4 of them and the low watermark at 1/4
+            static send_queue_limits make(backpressure_policy policy, size_t nMaxMessages, size_t nMaxBytes) {
+                send_queue_limits limits;
+                limits.policy = policy;
+                limits.nMaxMessages = nMaxMessages;
+                limits.nMaxBytes = nMaxBytes;
+                limits.nHighWaterMessages = nMaxMessages * 3 / 4;
+                limits.nHighWaterBytes = nMaxBytes * 3 / 4;
+                limits.nLowWaterMessages = nMaxMessages / 4;
+                limits.nLowWaterBytes = nMaxBytes / 4;
+                return limits;
+            }
+        };
+    }
+}
@@ -2,19 +2,31 @@
 #include "net_common.hpp"
 #include "net_message.hpp"
 #include "net_tsqueue.hpp"
+#include "net_mpscqueue.hpp"
 #include "net_connection.hpp"
+#include "net_transport.hpp"
+#include "net_datagram.hpp"
+#include "net_uring.hpp"
+#include "net_log.hpp"
 
 namespace olc {
 
     namespace net {
 
-        template <typename T>
+        template <typename T, typename H = fixed_header>
         // Responsible for setting up ASIO and setting up the connection
         // It acts as an access point for your app to talk to the server
+        // H is the header format, it must be the one of the server (see net_header.hpp)
         class client_interface {
         public:
+            // what Send returns - with coroutines, co_await it to wait until the message is
+            // written (see connection::send_awaitable)
+            using send_awaitable = typename connection<T, H>::send_awaitable;
+
             // Constructor and Destructor
-            client_interface() {}
+            // with dispatch_mode::direct the messages from the server are not put in
+            // Incoming(), OnMessage is called for them by the thread of the asio context
+            client_interface(dispatch_mode mode = dispatch_mode::queued) : m_nDispatchMode(mode) {}
 
             virtual ~client_interface() {
                 // If the client is destroyed(shutdown), always try discoinnect from server
@@ -34,11 +46,7 @@ namespace olc {
                     asio::ip::tcp::resolver::results_type endpoints = resolver.resolve(host, std::to_string(port));
 
                     // Create connection
-                    m_connection = std::make_unique<connection<T>>(
-                        connection<T>::owner::client,
-                        m_context,
-                        asio::ip::tcp::socket(m_context),
-                        m_qMessagesIn);
+                    CreateConnection();
 
                     // Tell the connection object to connect to server
                     m_connection->ConnectToServer(endpoints);
@@ -48,14 +56,50 @@ namespace olc {
 
 
                 } catch(std::exception& e) {
-                    std::cerr << " Client Exception: " << e.what() << "\n";
+                    OLC_NET_LOG_ERROR("[CLIENT] Exception: ", e.what());
                     return false;
                 }
 
                 return true;
             }
 
+            // Connect to server with an endpoint, which chooses the transport: tcp://host:port,
+            // or for a server on this host unix:///path/of/socket and shm:///path/of/socket
+            // (see net_transport.hpp) - the server must listen on the same endpoint
+            bool Connect(const std::string& sEndpoint) {
+                endpoint_address address;
+                if (!ParseEndpoint(sEndpoint, address)) {
+                    OLC_NET_LOG_ERROR("[CLIENT] Bad endpoint: ", sEndpoint);
+                    return false;
+                }
+                if (address.scheme == transport::tcp) {
+                    return Connect(address.host, address.port);
+                }
+
+#if OLC_NET_HAS_LOCAL_TRANSPORT
+                try {
+                    CreateConnection();
+                    if (address.scheme == transport::shm) {
+                        m_connection->EnableSharedMemory();
+                    }
+                    m_connection->ConnectToServer(asio::local::stream_protocol::endpoint(address.path));
+
+                    thrContext = std::thread([this]() { m_context.run(); });
+                } catch(std::exception& e) {
+                    OLC_NET_LOG_ERROR("[CLIENT] Exception: ", e.what());
+                    return false;
+                }
+                return true;
+#else
+                OLC_NET_LOG_ERROR("[CLIENT] No Unix domain sockets here: ", sEndpoint);
+                return false;
+#endif
+            }
+
             // Disconnect from server
+            // It can be called more than once. A derived class calls it in its own destructor:
+            // in dispatch_mode::direct the thread of the context may still be in OnMessage
+            // when the base destructor runs, after the members of the derived class are gone
             void Disconnect() {
                 // If conncetion exist, and is connected then...
                 if(IsConnected()) {
@@ -70,9 +114,9 @@ namespace olc {
                     thrContext.join();
                 }
 
-                // Destroy the connection object
-                // releases the unique pointer
-                m_connection.release();
+                // Let go of the connection object - the context is stopped, and the handlers
+                // still in it that hold the connection go with the context
+                m_connection.reset();
             }
 
             // Check if connection is still valid
@@ -84,29 +128,225 @@ namespace olc {
             }
 
             // Send message to server
-            void Send(message<T> const& msg) {
+            // (as a datagram, if its type was given delivery::unreliable)
+            // A datagram, or a message that is not sent as the client is not connected, has
+            // nothing to wait for: co_await on what is returned says false at once
+            send_awaitable Send(message<T> const& msg) {
+                if(IsConnected()) {
+                    if (IsUnreliable(msg.header.id)) {
+                        m_connection->SendUnreliable(msg);
+                    } else {
+                        return m_connection->Send(msg);
+                    }
+                }
+                return send_awaitable{};
+            }
+
+            // Send message to server, moving it instead of copying it
+            send_awaitable Send(message<T>&& msg) {
                 if(IsConnected()) {
-                    m_connection->Send(msg);
+                    if (IsUnreliable(msg.header.id)) {
+                        m_connection->SendUnreliable(std::move(msg));
+                    } else {
+                        return m_connection->Send(std::move(msg));
+                    }
                 }
+                return send_awaitable{};
+            }
+
+            // Send message to server, built in place from the id and the arguments
+            template <typename... Args>
+            send_awaitable EmplaceSend(T id, const Args&... args) {
+                if(IsConnected()) {
+                    return m_connection->EmplaceSend(id, args...);
+                }
+                return send_awaitable{};
+            }
+
+#if OLC_NET_HAS_COROUTINES
+            // The next message from the server, with dispatch_mode::coroutine - std::nullopt
+            // once the connection is closed (see connection::ReadMessage)
+            typename connection<T, H>::read_awaitable ReadMessage() {
+                if (m_connection) {
+                    return m_connection->ReadMessage();
+                }
+                return {};
+            }
+
+            // Starts a task on the strand of the connection - call it after Connect
+            // e.g. a request that waits for its reply, written as a straight line:
+            //
+            //   olc::net::task<> Run() {
+            //       co_await Send(request);
+            //       auto reply = co_await ReadMessage();
+            //       ...
+            //   }
+            void Spawn(task<void> t) {
+                if (m_connection) {
+                    olc::net::Spawn(m_connection->GetStrand(), std::move(t));
+                }
+            }
+#endif
+
+            // Opens a UDP socket for the messages sent with delivery::unreliable - call it
+            // before Connect. The channel is used once the server has offered its own
+            bool EnableDatagrams() {
+                auto pDatagrams = std::make_unique<datagram_socket>(m_context);
+                if (!pDatagrams->Open(0)) {
+                    return false;
+                }
+                pDatagrams->Start([this](const asio::ip::udp::endpoint& remote, const uint8_t* pData, size_t nData) {
+                    if (m_connection) {
+                        m_connection->ReceiveDatagram(remote, pData, nData);
+                    }
+                });
+                m_pDatagrams = std::move(pDatagrams);
+                return true;
+            }
+
+            // The datagram socket, nullptr without EnableDatagrams (e.g. to SetLoss on it)
+            datagram_socket* GetDatagramSocket() {
+                return m_pDatagrams.get();
+            }
+
+            // How the messages of this type are sent (delivery::reliable by default)
+            // call it before Connect
+            void SetDelivery(T id, delivery mode) {
+                auto it = std::find(m_vUnreliableTypes.begin(), m_vUnreliableTypes.end(), id);
+                if (mode == delivery::unreliable && it == m_vUnreliableTypes.end()) {
+                    m_vUnreliableTypes.push_back(id);
+                } else if (mode == delivery::reliable && it != m_vUnreliableTypes.end()) {
+                    m_vUnreliableTypes.erase(it);
+                }
+            }
+
+            bool IsUnreliable(T id) const {
+                return std::find(m_vUnreliableTypes.begin(), m_vUnreliableTypes.end(), id) != m_vUnreliableTypes.end();
+            }
+
+            // Hold the messages sent from now on, until Flush writes them together
+            void Cork() {
+                if (m_connection) {
+                    m_connection->Cork();
+                }
+            }
+
+            void Flush() {
+                if (m_connection) {
+                    m_connection->Flush();
+                }
+            }
+
+            // How the socket is read and written (io_engine::reactor by default, see
+            // net_uring.hpp) - call it before Connect. false if io_uring can't be used here:
+            // the reactor is used then
+            bool SetIoEngine(io_engine engine) {
+                if (engine == io_engine::reactor) {
+                    m_pUring.reset();
+                    return true;
+                }
+                auto pUring = std::make_shared<uring_engine>(m_context);
+                if (!pUring->Open(64, 64)) {
+                    OLC_NET_LOG_WARNING("[CLIENT] No io_uring here, the reactor is used.");
+                    return false;
+                }
+                m_pUring = std::move(pUring);
+                return true;
+            }
+
+            // The io_uring of the connection, nullptr with the reactor
+            uring_engine* GetUringEngine() {
+                return m_pUring.get();
+            }
+
+            // Options of the socket (socket_options::low_latency by default)
+            void SetSocketOptions(const socket_options& options) {
+                m_socketOptions = options;
+                if (m_connection) {
+                    m_connection->SetSocketOptions(options);
+                }
+            }
+
+            // Compress the bodies of at least nThreshold bytes sent to the server, if it can
+            // decompress them (codec_id::none to stop)
+            void SetCompression(codec_id codec = codec_id::lz, size_t nThreshold = 512) {
+                m_nCodec = codec;
+                m_nCompressThreshold = nThreshold;
+                if (m_connection) {
+                    m_connection->SetCompression(codec, nThreshold);
+                }
+            }
+
+            // Snapshot of the counters of the connection to the server
+            connection_stats GetStats() {
+                if (m_connection) {
+                    return m_connection->GetStats();
+                }
+                return {};
             }
 
             // Retrieve queue of messages from server (like a Get)
-            tsqueue<owned_message<T>>& Incoming() {
+            incoming_queue<owned_message<T, H>>& Incoming() {
                 return m_qMessagesIn;
             }
 
+        protected:
+            // Makes the connection, with the settings of the client
+            void CreateConnection() {
+                m_connection = std::make_shared<connection<T, H>>(
+                    connection<T, H>::owner::client,
+                    m_context,
+                    stream_socket(m_context),
+                    m_qMessagesIn);
+
+                m_connection->SetSocketOptions(m_socketOptions);
+                if (m_pDatagrams) {
+                    m_connection->EnableDatagrams(m_pDatagrams.get());
+                }
+                if (m_pUring) {
+                    m_connection->EnableUring(m_pUring);
+                }
+                m_connection->SetCompression(m_nCodec, m_nCompressThreshold);
+                if (m_nDispatchMode == dispatch_mode::direct) {
+                    m_connection->SetMessageHandler([this](owned_message<T, H>& msg) {
+                        OnMessage(msg.msg);
+                    });
+                }
+#if OLC_NET_HAS_COROUTINES
+                if (m_nDispatchMode == dispatch_mode::coroutine) {
+                    m_connection->EnableCoroutines();
+                }
+#endif
+            }
+
+            // Called when a message arrives from the server, in dispatch_mode::direct only
+            virtual void OnMessage(message<T>& msg) {
+
+            }
+
         protected:
             // client interface owns the asio context
             // asio context handles the data trasnfer
             asio::io_context m_context;
             // ...but needs a thread of its own to execute its work commands
             std::thread thrContext;
+            // the io_uring of the connection (io_engine::uring) - shared with it, as a handler
+            // still in the context holds the connection until the context itself is gone
+            std::shared_ptr<uring_engine> m_pUring;
             // The client has a single instance of a "connection" object, which handles data transfer
-            std::unique_ptr<connection<T>> m_connection;
+            // (shared, so that the completions of io_uring can tell when it is gone)
+            std::shared_ptr<connection<T, H>> m_connection;
+            dispatch_mode m_nDispatchMode = dispatch_mode::queued;
+            codec_id m_nCodec = codec_id::none;
+            size_t m_nCompressThreshold = 0;
+            socket_options m_socketOptions;
+            // the UDP socket of the unreliable messages (see EnableDatagrams), and their types
+            std::unique_ptr<datagram_socket> m_pDatagrams;
+            std::vector<T> m_vUnreliableTypes;
 
         private:
             // This is the thread safe queue of incoming messages from server
-            tsqueue<owned_message<T>> m_qMessagesIn;
+            incoming_queue<owned_message<T, H>> m_qMessagesIn;
         };
     }
 }
\ No newline at end of file
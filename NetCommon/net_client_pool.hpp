@@ -0,0 +1,358 @@
+#pragma once
+#include "net_common.hpp"
+#include "net_message.hpp"
+#include "net_mpscqueue.hpp"
+#include "net_connection.hpp"
+#include "net_stats.hpp"
+#include "net_log.hpp"
+
+namespace olc {
+
+    namespace net {
+
+        template <typename T, typename H>
+        class client_pool;
+
+        // What one connection of a client_pool does, step after step
+        // e.g. ping the server 100 times, 10 ms apart:
+        //     load_script<CustomMsgTypes> script;
+        //     script.Send(msgPing).Expect(CustomMsgTypes::ServerPing).Pause(std::chrono::milliseconds(10)).Repeat(100);
+        template <typename T>
+        class load_script {
+        public:
+            // sends a copy of the message
+            load_script& Send(const message<T>& msg) {
+                step s;
+                s.nKind = kind::send;
+                s.msg = msg;
+                m_vSteps.push_back(std::move(s));
+                return *this;
+            }
+
+            // waits for a message with this id - the time since the last Send is its latency
+            // (messages with other ids are ignored)
+            load_script& Expect(T id) {
+                step s;
+                s.nKind = kind::expect;
+                s.msg.header.id = id;
+                m_vSteps.push_back(std::move(s));
+                return *this;
+            }
+
+            // waits for some time
+            load_script& Pause(std::chrono::steady_clock::duration duration) {
+                step s;
+                s.nKind = kind::pause;
+                s.duration = duration;
+                m_vSteps.push_back(std::move(s));
+                return *this;
+            }
+
+            // how many times the whole script runs (0, the default: until the pool stops)
+            load_script& Repeat(size_t nTimes) {
+                m_nRepeat = nTimes;
+                return *this;
+            }
+
+            bool empty() const {
+                return m_vSteps.empty();
+            }
+
+        private:
+            template <typename, typename> friend class client_pool;
+
+            enum class kind {
+                send,
+                expect,
+                pause
+            };
+
+            struct step {
+                kind nKind = kind::send;
+                message<T> msg;
+                std::chrono::steady_clock::duration duration{};
+            };
+
+            std::vector<step> m_vSteps;
+            size_t m_nRepeat = 0;
+        };
+
+        // A load generator: many connections to one server, from a single process
+        // Unlike client_interface, which has a context and a thread for its one connection,
+        // every connection of the pool shares the same asio context, run by a small pool of
+        // threads. The connections are opened at a given rate (the ramp-up), and each of
+        // them runs the script that GetScript gives it. Messages go straight from the
+        // read completion to the script (dispatch_mode::direct), there is no incoming queue
+        //
+        // Derive from it and override GetScript (and OnMessage, if needed), then
+        //     pool.Start("127.0.0.1", 60000, 10000, 4, 500); // 10000 connections, 4 threads, 500 per second
+        //     ... pool.GetStats() ...
+        // H is the header format of the connections, it must be the one of the server
+        template <typename T, typename H = fixed_header>
+        class client_pool {
+        public:
+            client_pool() {}
+
+            virtual ~client_pool() {
+                Stop();
+            }
+
+        public:
+            // Opens nConnections connections to host:port, dConnectRate per second
+            // (0 opens them all at once), on a pool of nThreads threads
+            bool Start(const std::string& host, const uint16_t port, size_t nConnections, size_t nThreads = 1, double dConnectRate = 0.0) {
+                try {
+                    asio::ip::tcp::resolver resolver(m_context);
+                    m_endpoints = resolver.resolve(host, std::to_string(port));
+                } catch (std::exception& e) {
+                    OLC_NET_LOG_ERROR("[POOL] Exception: ", e.what());
+                    return false;
+                }
+
+                m_nConnections = nConnections;
+                m_dConnectRate = dConnectRate;
+                m_tStart = std::chrono::steady_clock::now();
+
+                // the threads keep running the context even when no connection has work
+                m_context.restart();
+                m_workGuard.emplace(asio::make_work_guard(m_context));
+                asio::post(m_context, [this]() { OpenConnections(); });
+
+                nThreads = std::max<size_t>(nThreads, 1);
+                for (size_t i = 0; i < nThreads; i++) {
+                    m_vThreadPool.emplace_back([this]() { m_context.run(); });
+                }
+
+                OLC_NET_LOG_INFO("[POOL] Started ", nConnections, " connection(s) on ", nThreads, " thread(s)");
+                return true;
+            }
+
+            // Options of the sockets of the connections opened from now on
+            // (socket_options::low_latency by default) - call it before Start
+            void SetSocketOptions(const socket_options& options) {
+                std::scoped_lock lock(muxSessions);
+                m_socketOptions = options;
+            }
+
+            // Closes every connection and stops the threads
+            void Stop() {
+                m_workGuard.reset();
+                m_context.stop();
+                for (auto& thread : m_vThreadPool) {
+                    if (thread.joinable()) {
+                        thread.join();
+                    }
+                }
+                m_vThreadPool.clear();
+
+                // nothing runs anymore, the connections can go
+                std::scoped_lock lock(muxSessions);
+                m_vSessions.clear();
+            }
+
+            // Snapshot of the whole pool - can be called from any thread
+            client_pool_stats GetStats() {
+                client_pool_stats stats;
+                {
+                    std::scoped_lock lock(muxSessions);
+                    stats.nStarted = m_vSessions.size();
+                    for (auto& s : m_vSessions) {
+                        connection_stats c = s->conn->GetStats();
+                        stats.total.nBytesIn += c.nBytesIn;
+                        stats.total.nBytesOut += c.nBytesOut;
+                        stats.total.nMessagesIn += c.nMessagesIn;
+                        stats.total.nMessagesOut += c.nMessagesOut;
+                        stats.total.nReads += c.nReads;
+                        stats.total.nWrites += c.nWrites;
+                        stats.total.nReadErrors += c.nReadErrors;
+                        stats.total.nWriteErrors += c.nWriteErrors;
+                        stats.total.nQueueOut += c.nQueueOut;
+                        stats.total.nQueueOutHighWater = std::max(stats.total.nQueueOutHighWater, c.nQueueOutHighWater);
+
+                        if (s->bConnected.load(std::memory_order_relaxed) && c.nReadErrors + c.nWriteErrors > 0) {
+                            stats.nDisconnected++;
+                        }
+                    }
+                }
+
+                stats.nConnected = m_nConnected.load(std::memory_order_relaxed) - stats.nDisconnected;
+                stats.nFailed = m_nFailed.load(std::memory_order_relaxed);
+                stats.nScriptsCompleted = m_nScriptsCompleted.load(std::memory_order_relaxed);
+                stats.nReplies = m_nReplies.load(std::memory_order_relaxed);
+
+                stats.dElapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_tStart).count();
+                if (stats.dElapsed > 0.0) {
+                    stats.dMessagesOutRate = stats.total.nMessagesOut / stats.dElapsed;
+                    stats.dMessagesInRate = stats.total.nMessagesIn / stats.dElapsed;
+                }
+                stats.dLatencyP50 = m_latency.percentile(0.50) / 1000.0;
+                stats.dLatencyP99 = m_latency.percentile(0.99) / 1000.0;
+                stats.dLatencyP999 = m_latency.percentile(0.999) / 1000.0;
+                return stats;
+            }
+
+        protected:
+            // The script of the connection number nIndex (0 to nConnections - 1)
+            // An empty script just keeps the connection open
+            virtual load_script<T> GetScript(size_t nIndex) {
+                return {};
+            }
+
+            // Called for every message received, before the script sees it
+            // It is called by the threads of the pool, for several connections at once
+            virtual void OnMessage(size_t nIndex, message<T>& msg) {
+
+            }
+
+        private:
+            // A connection and where it is in its script
+            // Everything but bConnected is only used from inside the strand of the connection
+            struct session {
+                session(size_t i, std::shared_ptr<connection<T, H>> c, load_script<T>&& s)
+                    : nIndex(i), conn(std::move(c)), script(std::move(s)), timer(conn->GetStrand()) {}
+
+                size_t nIndex;
+                std::shared_ptr<connection<T, H>> conn;
+                load_script<T> script;
+                asio::steady_timer timer;
+
+                size_t nStep = 0;
+                size_t nRound = 0;
+                int64_t nLastSend = 0;
+                std::atomic<bool> bConnected = false;
+            };
+
+            // Opens the connections that are due - called again by the ramp-up timer until all are open
+            void OpenConnections() {
+                size_t nDue = m_nConnections;
+                if (m_dConnectRate > 0.0) {
+                    double dElapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_tStart).count();
+                    nDue = std::min(m_nConnections, size_t(dElapsed * m_dConnectRate) + 1);
+                }
+
+                std::scoped_lock lock(muxSessions);
+                while (m_vSessions.size() < nDue) {
+                    OpenConnection(m_vSessions.size());
+                }
+
+                if (m_vSessions.size() < m_nConnections) {
+                    auto interval = std::chrono::duration<double>(1.0 / m_dConnectRate);
+                    m_rampTimer.expires_after(std::max<std::chrono::steady_clock::duration>(
+                        std::chrono::duration_cast<std::chrono::steady_clock::duration>(interval), std::chrono::milliseconds(1)));
+                    m_rampTimer.async_wait([this](std::error_code ec) {
+                        if (!ec) {
+                            OpenConnections();
+                        }
+                    });
+                }
+            }
+
+            // muxSessions must be locked
+            void OpenConnection(size_t nIndex) {
+                auto conn = std::make_shared<connection<T, H>>(connection<T, H>::owner::client,
+                    m_context, stream_socket(m_context), m_qMessagesIn);
+                session& s = *m_vSessions.emplace_back(std::make_unique<session>(nIndex, conn, GetScript(nIndex)));
+
+                conn->SetSocketOptions(m_socketOptions);
+                conn->SetMessageHandler([this, &s](owned_message<T, H>& msg) {
+                    OnSessionMessage(s, msg.msg);
+                });
+                conn->SetConnectHandler([this, &s](std::error_code ec) {
+                    if (ec) {
+                        m_nFailed.fetch_add(1, std::memory_order_relaxed);
+                        return;
+                    }
+                    s.bConnected.store(true, std::memory_order_relaxed);
+                    m_nConnected.fetch_add(1, std::memory_order_relaxed);
+                    Advance(s);
+                });
+                conn->ConnectToServer(m_endpoints);
+            }
+
+            // Runs the script of a connection until it has to wait - inside its strand
+            void Advance(session& s) {
+                const auto& vSteps = s.script.m_vSteps;
+                while (s.nStep < vSteps.size()) {
+                    const auto& step = vSteps[s.nStep];
+                    switch (step.nKind) {
+                        case load_script<T>::kind::send:
+                            s.nLastSend = connection_counters::Now();
+                            s.conn->Send(step.msg);
+                            s.nStep++;
+                            break;
+
+                        case load_script<T>::kind::expect:
+                            // OnSessionMessage carries on
+                            return;
+
+                        case load_script<T>::kind::pause:
+                            s.timer.expires_after(step.duration);
+                            s.timer.async_wait([this, &s](std::error_code ec) {
+                                if (!ec) {
+                                    s.nStep++;
+                                    Advance(s);
+                                }
+                            });
+                            return;
+                    }
+                }
+
+                if (vSteps.empty()) {
+                    return;
+                }
+
+                // end of the script - the next round starts from the strand again, so
+                // a script that never waits doesn't keep the thread to itself
+                m_nScriptsCompleted.fetch_add(1, std::memory_order_relaxed);
+                s.nRound++;
+                if (s.script.m_nRepeat == 0 || s.nRound < s.script.m_nRepeat) {
+                    s.nStep = 0;
+                    asio::post(s.conn->GetStrand(), [this, &s]() { Advance(s); });
+                }
+            }
+
+            // A message for this connection - inside its strand
+            void OnSessionMessage(session& s, message<T>& msg) {
+                OnMessage(s.nIndex, msg);
+
+                const auto& vSteps = s.script.m_vSteps;
+                if (s.nStep < vSteps.size() && vSteps[s.nStep].nKind == load_script<T>::kind::expect &&
+                    vSteps[s.nStep].msg.header.id == msg.header.id) {
+                    m_latency.add(uint64_t(connection_counters::Now() - s.nLastSend));
+                    m_nReplies.fetch_add(1, std::memory_order_relaxed);
+                    s.nStep++;
+                    Advance(s);
+                }
+            }
+
+        protected:
+            // Declared first, destroyed last: the connections and timers refer to it
+            asio::io_context m_context;
+            std::optional<asio::executor_work_guard<asio::io_context::executor_type>> m_workGuard;
+            std::vector<std::thread> m_vThreadPool;
+
+            // every connection needs one, but with a message handler nothing is put in it
+            incoming_queue<owned_message<T, H>> m_qMessagesIn;
+
+            asio::ip::tcp::resolver::results_type m_endpoints;
+            size_t m_nConnections = 0;
+            double m_dConnectRate = 0.0;
+            // protected by muxSessions
+            socket_options m_socketOptions;
+            asio::steady_timer m_rampTimer{ m_context };
+            std::chrono::steady_clock::time_point m_tStart = std::chrono::steady_clock::now();
+
+            // the connections opened so far (the sessions never move, their connections'
+            // handlers refer to them)
+            std::vector<std::unique_ptr<session>> m_vSessions;
+            std::mutex muxSessions;
+
+            // what every connection adds to
+            std::atomic<size_t> m_nConnected = 0;
+            std::atomic<size_t> m_nFailed = 0;
+            std::atomic<uint64_t> m_nScriptsCompleted = 0;
+            std::atomic<uint64_t> m_nReplies = 0;
+            latency_histogram m_latency;
+        };
+    }
+}
@@ -0,0 +1,236 @@
+#pragma once
+#include "net_common.hpp"
+
+namespace olc {
+
+    namespace net {
+
+        // The ways a body can be compressed
+        // A compressed body starts with the codec that made it and the size of the
+        // original body (uint32_t), the data of the codec follows
+        enum class codec_id : uint8_t {
+            none = 0,
+            lz = 1
+        };
+
+        // LZ77 compressor in the spirit of LZ4: fast, no entropy coding, no dependencies
+        //
+        // The data is a list of sequences: a token byte (number of literals in the high 4 bits,
+        // length of the match - 4 in the low 4 bits), more length bytes when a nibble is 15
+        // (each adds up to 255, a byte under 255 ends it), the literals, and the match as a
+        // 2 byte offset back into the output. The last sequence only has literals
+        //
+        // The decompressor checks every length and offset against the buffers, so data
+        // coming from the network can't make it read or write out of bounds
+        class lz_codec {
+        public:
+            static constexpr size_t nMinMatch = 4;
+            static constexpr size_t nMaxOffset = 65535;
+            // the hash table lives on the stack of the compressing thread (16 KiB)
+            static constexpr size_t nHashBits = 12;
+
+            // the most that compress() can write for n bytes
+            static size_t bound(size_t n) {
+                return n + n / 255 + 16;
+            }
+
+            // dst must have room for bound(n) bytes, returns the number of bytes written
+            static size_t compress(const uint8_t* src, size_t n, uint8_t* dst) {
+                uint32_t vTable[1 << nHashBits] = {};
+                uint8_t* op = dst;
+                size_t ip = 0;
+                size_t nAnchor = 0;
+
+                // the last bytes are always literals, so a match can be checked 4 bytes at a time
+                if (n > 12) {
+                    size_t nMatchLimit = n - 5;
+                    size_t nSearchLimit = n - 12;
+                    while (ip < nSearchLimit) {
+                        uint32_t nSequence = Read32(src + ip);
+                        uint32_t& nSlot = vTable[Hash(nSequence)];
+                        size_t nRef = nSlot;
+                        nSlot = uint32_t(ip);
+
+                        if (nRef >= ip || ip - nRef > nMaxOffset || Read32(src + nRef) != nSequence) {
+                            // skip faster through data that doesn't compress
+                            ip += 1 + ((ip - nAnchor) >> 6);
+                            continue;
+                        }
+
+                        size_t nLength = nMinMatch;
+                        while (ip + nLength < nMatchLimit && src[nRef + nLength] == src[ip + nLength]) {
+                            nLength++;
+                        }
+
+                        op = WriteSequence(op, src + nAnchor, ip - nAnchor, ip - nRef, nLength);
+                        ip += nLength;
+                        nAnchor = ip;
+                    }
+                }
+
+                // the rest goes as literals
+                return size_t(WriteSequence(op, src + nAnchor, n - nAnchor, 0, 0) - dst);
+            }
+
+            // true if src decompresses into exactly nOut bytes
+            static bool decompress(const uint8_t* src, size_t n, uint8_t* dst, size_t nOut) {
+                const uint8_t* ip = src;
+                const uint8_t* iend = src + n;
+                uint8_t* op = dst;
+                uint8_t* oend = dst + nOut;
+
+                while (ip < iend) {
+                    uint8_t nToken = *ip++;
+
+                    size_t nLiterals = nToken >> 4;
+                    if (nLiterals == 15 && !ReadLength(ip, iend, nLiterals)) {
+                        return false;
+                    }
+                    if (size_t(iend - ip) < nLiterals || size_t(oend - op) < nLiterals) {
+                        return false;
+                    }
+                    std::memcpy(op, ip, nLiterals);
+                    ip += nLiterals;
+                    op += nLiterals;
+
+                    // the last sequence has no match
+                    if (ip == iend) {
+                        break;
+                    }
+
+                    if (iend - ip < 2) {
+                        return false;
+                    }
+                    size_t nOffset = size_t(ip[0]) | (size_t(ip[1]) << 8);
+                    ip += 2;
+                    if (nOffset == 0 || nOffset > size_t(op - dst)) {
+                        return false;
+                    }
+
+                    size_t nLength = nToken & 15;
+                    if (nLength == 15 && !ReadLength(ip, iend, nLength)) {
+                        return false;
+                    }
+                    nLength += nMinMatch;
+                    if (size_t(oend - op) < nLength) {
+                        return false;
+                    }
+
+                    // the match may overlap what it is writing (e.g. a run of one byte)
+                    const uint8_t* pMatch = op - nOffset;
+                    if (nOffset >= nLength) {
+                        std::memcpy(op, pMatch, nLength);
+                        op += nLength;
+                    } else {
+                        for (size_t i = 0; i < nLength; i++) {
+                            *op++ = pMatch[i];
+                        }
+                    }
+                }
+
+                return op == oend;
+            }
+
+        private:
+            static uint32_t Read32(const uint8_t* p) {
+                uint32_t n;
+                std::memcpy(&n, p, sizeof(n));
+                return n;
+            }
+
+            static uint32_t Hash(uint32_t nSequence) {
+                return (nSequence * 2654435761u) >> (32 - nHashBits);
+            }
+
+            static uint8_t* WriteLength(uint8_t* op, size_t nLength) {
+                while (nLength >= 255) {
+                    *op++ = 255;
+                    nLength -= 255;
+                }
+                *op++ = uint8_t(nLength);
+                return op;
+            }
+
+            static bool ReadLength(const uint8_t*& ip, const uint8_t* iend, size_t& nLength) {
+                uint8_t nByte;
+                do {
+                    if (ip == iend) {
+                        return false;
+                    }
+                    nByte = *ip++;
+                    nLength += nByte;
+                } while (nByte == 255);
+                return true;
+            }
+
+            // nMatch == 0 writes the last sequence, literals only
+            static uint8_t* WriteSequence(uint8_t* op, const uint8_t* pLiterals, size_t nLiterals, size_t nOffset, size_t nMatch) {
+                size_t nMatchCode = nMatch ? nMatch - nMinMatch : 0;
+                uint8_t* pToken = op++;
+                *pToken = uint8_t((std::min<size_t>(nLiterals, 15) << 4) | std::min<size_t>(nMatchCode, 15));
+
+                if (nLiterals >= 15) {
+                    op = WriteLength(op, nLiterals - 15);
+                }
+                std::memcpy(op, pLiterals, nLiterals);
+                op += nLiterals;
+
+                if (nMatch) {
+                    *op++ = uint8_t(nOffset & 0xFF);
+                    *op++ = uint8_t(nOffset >> 8);
+                    if (nMatchCode >= 15) {
+                        op = WriteLength(op, nMatchCode - 15);
+                    }
+                }
+                return op;
+            }
+        };
+
+        // The codecs this library can decompress, as a bit mask (bit n is codec_id n)
+        // It is what a connection tells the remote side when it starts
+        inline uint32_t SupportedCodecs() {
+            return 1u << uint32_t(codec_id::lz);
+        }
+
+        // Size of what a codec adds in front of the compressed data
+        constexpr size_t nPackedHeaderSize = 1 + sizeof(uint32_t);
+
+        // Compresses a body into out - returns false (and out is not to be used) if the
+        // codec is unknown or the result would not be smaller than the body
+        inline bool PackBody(codec_id codec, const uint8_t* pBody, size_t nBody, std::vector<uint8_t>& out) {
+            if (codec != codec_id::lz || nBody == 0 || nBody > std::numeric_limits<uint32_t>::max()) {
+                return false;
+            }
+
+            out.resize(nPackedHeaderSize + lz_codec::bound(nBody));
+            out[0] = uint8_t(codec);
+            uint32_t nOriginal = uint32_t(nBody);
+            std::memcpy(out.data() + 1, &nOriginal, sizeof(nOriginal));
+
+            size_t nPacked = nPackedHeaderSize + lz_codec::compress(pBody, nBody, out.data() + nPackedHeaderSize);
+            if (nPacked >= nBody) {
+                return false;
+            }
+            out.resize(nPacked);
+            return true;
+        }
+
+        // Decompresses a body made by PackBody into out - false if the data is not valid
+        inline bool UnpackBody(const uint8_t* pPacked, size_t nPacked, std::vector<uint8_t>& out) {
+            if (nPacked < nPackedHeaderSize || codec_id(pPacked[0]) != codec_id::lz) {
+                return false;
+            }
+
+            uint32_t nOriginal;
+            std::memcpy(&nOriginal, pPacked + 1, sizeof(nOriginal));
+            // a byte of compressed data can't stand for more than 255 bytes - don't let
+            // a bad size make us allocate more than that
+            if (nOriginal > (nPacked - nPackedHeaderSize) * 255 + 16) {
+                return false;
+            }
+
+            out.resize(nOriginal);
+            return lz_codec::decompress(pPacked + nPackedHeaderSize, nPacked - nPackedHeaderSize, out.data(), out.size());
+        }
+    }
+}
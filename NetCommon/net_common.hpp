@@ -3,13 +3,23 @@
 #include <memory>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
 #include <deque>
 #include <optional>
+#include <functional>
 #include <vector>
+#include <string>
+#include <string_view>
 #include <iostream>
 #include <algorithm>
+#include <iterator>
+#include <limits>
 #include <chrono>
 #include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <stdexcept>
 
 #define ASIO_STANDALONE
 #include <asio.hpp>
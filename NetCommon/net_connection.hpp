@@ -1,15 +1,75 @@
 #pragma once
 #include "net_common.hpp"
 #include "net_tsqueue.hpp"
+#include "net_mpscqueue.hpp"
 #include "net_message.hpp"
+#include "net_pool.hpp"
+#include "net_stats.hpp"
+#include "net_backpressure.hpp"
+#include "net_socket.hpp"
+#include "net_transport.hpp"
+#include "net_shm.hpp"
+#include "net_datagram.hpp"
+#include "net_uring.hpp"
+#include "net_coro.hpp"
+#include "net_log.hpp"
 
 namespace olc {
 
     namespace net {
 
+        // How the messages received are handed to OnMessage
+        enum class dispatch_mode {
+            // they go through the incoming queue, and OnMessage is called by the thread
+            // that calls Update (or the client's own loop) - OnMessage needs no locking
+            queued,
+            // OnMessage is called as soon as a message is read, by the thread of the asio
+            // context that read it. It is never called twice at the same time for the same
+            // connection, but it is for different connections: it must be thread safe.
+            // The derived server (or client) must call Stop (or Disconnect) in its own
+            // destructor, so OnMessage is not running while the derived object is torn down
+            direct,
+#if OLC_NET_HAS_COROUTINES
+            // they wait in the connection until a coroutine takes them with
+            // co_await ReadMessage() (see net_coro.hpp) - OnMessage is not called
+            coroutine
+#endif
+        };
+
+        // The control messages (header_flags::control) two connections exchange
+        // Their body starts with the type, what follows depends on it. Unknown types are ignored
+        enum class control_type : uint8_t {
+            // uint32_t: the codecs this side can decompress (see SupportedCodecs)
+            capabilities = 1,
+            // from the server: its datagram channel - uint16_t UDP port, uint32_t ID, uint32_t token
+            datagram_offer = 2,
+            // from the server: the hello of the client arrived, datagrams can reach it now
+            datagram_ready = 3,
+            // from the server: it has heard nothing for a while (see timeout_options::heartbeat)
+            // - every connection answers it at once
+            heartbeat = 4,
+            heartbeat_reply = 5
+        };
+
+        // The buffers of a write, seen through two pointers: asio keeps a copy of the
+        // buffer sequence until the write is done, and a copy of the vector that holds
+        // them would be an allocation per write
+        struct buffer_range {
+            using value_type = asio::const_buffer;
+            using const_iterator = const asio::const_buffer*;
+
+            const asio::const_buffer* pBegin = nullptr;
+            const asio::const_buffer* pEnd = nullptr;
+
+            const_iterator begin() const { return pBegin; }
+            const_iterator end() const { return pEnd; }
+        };
+
         // std::enable_shared_from_this enable us to create a shared pointer, internally, from inside the class
-        template <typename T>
-        class connection : public std::enable_shared_from_this<connection<T>> {
+        // H is how the headers are written on the socket (fixed_header or varint_header,
+        // see net_header.hpp) - the remote side must use the same
+        template <typename T, typename H = fixed_header>
+        class connection : public std::enable_shared_from_this<connection<T, H>> {
         public:
 
             enum class owner {
@@ -17,14 +77,19 @@ namespace olc {
                 client
             };
 
-            connection(owner parent, asio::io_context& asioContext, asio::ip::tcp::socket socket, tsqueue<owned_message<T>>& qIn) 
-                : m_asioContext(asioContext), m_socket(std::move(socket)), m_qMessagesIn(qIn) {
+            // the socket can be a TCP socket or a Unix domain socket (see net_transport.hpp)
+            connection(owner parent, asio::io_context& asioContext, stream_socket socket, incoming_queue<owned_message<T, H>>& qIn) 
+                : m_socket(std::move(socket)), m_asioContext(asioContext), m_strand(asio::make_strand(asioContext)), m_qMessagesIn(qIn) {
                 
                 m_nOwnerType = parent;
             }
                 
             virtual ~connection() {
-
+                // the ring may still hold requests for the socket
+                if (m_pUring) {
+                    CloseSocket();
+                    m_pUring->Unregister(m_nUringKey);
+                }
             }
 
             uint32_t GetID() const {
@@ -41,8 +106,17 @@ namespace olc {
                     if (m_socket.is_open()) {
 
                         id = uid;
-                        std::cout << "[SERVER] will try to read a new header!\n";
-                        ReadHeader();                            
+                        OLC_NET_LOG_DEBUG("[", uid, "] will try to read a new header!");
+                        // the caller may be on any thread of the pool, so the first
+                        // read is started from inside the strand of this connection
+                        // (over shared memory, once the client has said where the rings are)
+                        asio::post(m_strand, [this, self = this->shared_from_this()]() {
+                            if (m_bSharedMemory) {
+                                AcceptRings();
+                            } else {
+                                Begin();
+                            }
+                        });
                     }
                 }
             }
@@ -52,23 +126,35 @@ namespace olc {
                 //only clients can connect to server
                 if (m_nOwnerType == owner::client) {
                     // Requests asio attempts to connect to an endpoint
-                    asio::async_connect(m_socket, endpoints,
-                        [this](std::error_code ec, asio::ip::tcp::endpoint endpoint){
-                        if (!ec) {
-                            ReadHeader();
-                        }
-                        else {
-                            std::cout << "[CLIENT] Can not connect to server...\n";
-                        }
-                    });
+                    // (each one given as a generic endpoint, like the socket)
+                    std::vector<stream_endpoint> vEndpoints;
+                    for (const auto& entry : endpoints) {
+                        vEndpoints.emplace_back(entry.endpoint());
+                    }
+                    asio::async_connect(m_socket, vEndpoints, asio::bind_executor(m_strand,
+                        [this, self = this->shared_from_this()](std::error_code ec, const stream_endpoint& endpoint){
+                            OnConnected(ec);
+                        }));
+                }
+            }
+
+#if OLC_NET_HAS_LOCAL_TRANSPORT
+            // only called by clients - to a server on this host, over a Unix domain socket
+            void ConnectToServer(const asio::local::stream_protocol::endpoint& endpoint) {
+                if (m_nOwnerType == owner::client) {
+                    m_socket.async_connect(endpoint, asio::bind_executor(m_strand,
+                        [this, self = this->shared_from_this()](std::error_code ec) {
+                            OnConnected(ec);
+                        }));
                 }
             }
+#endif
 
 
             // can be called by clients and servers
             void Disconnect() {
                 if (IsConnected()) {
-                    asio::post(m_asioContext, [this]() { m_socket.close(); });
+                    asio::post(m_strand, [this, self = this->shared_from_this()]() { CloseSocket(); });
                 }
             }
 
@@ -78,132 +164,1501 @@ namespace olc {
                 return m_socket.is_open();
             }
 
+            // Options of the socket (TCP_NODELAY, buffer sizes...) - set at once if the socket
+            // is connected, or as soon as it is
+            void SetSocketOptions(const socket_options& options) {
+                asio::post(m_strand, [this, self = this->shared_from_this(), options]() {
+                    m_socketOptions = options;
+                    if (m_socket.is_open()) {
+                        ApplySocketOptions(m_socket, m_socketOptions);
+                    }
+                });
+            }
+
+            // Messages go through rings in shared memory rather than through the socket
+            // (transport::shm, see net_shm.hpp) - must be set before the connection starts,
+            // on both sides
+            void EnableSharedMemory() {
+                asio::post(m_strand, [this, self = this->shared_from_this()]() {
+                    m_bSharedMemory = true;
+                });
+            }
+
+            // Gives the connection a datagram channel, for SendUnreliable - must be set before
+            // the connection starts. The server offers the channel to the client over TCP, and
+            // the client says hello from its own socket, so the server knows where to send
+            void EnableDatagrams(datagram_socket* pSocket) {
+                asio::post(m_strand, [this, self = this->shared_from_this(), pSocket]() {
+                    m_pDatagrams = pSocket;
+                });
+            }
+
+            // The socket is read and written through this io_uring rather than by the reactor
+            // of asio (io_engine::uring, see net_uring.hpp) - must be set before the connection
+            // starts. The connection shares the engine, so it is there until the connection is
+            // gone. Over shared memory the rings carry the messages, and it is not used
+            void EnableUring(std::shared_ptr<uring_engine> pUring) {
+                asio::post(m_strand, [this, self = this->shared_from_this(), pUring]() {
+                    m_pUring = pUring;
+                });
+            }
+
+#if OLC_NET_HAS_COROUTINES
+            // The messages received wait in the connection for ReadMessage, instead of going
+            // to the incoming queue (dispatch_mode::coroutine) - must be set before the
+            // connection starts
+            void EnableCoroutines() {
+                asio::post(m_strand, [this, self = this->shared_from_this()]() {
+                    m_bCoroutines = true;
+                });
+            }
+
+            // What ReadMessage returns: co_await it for the next message received, or
+            // std::nullopt once the connection is closed (and every message is read)
+            // The coroutine goes on in the strand of the connection
+            // It holds the connection, so a coroutine never resumes on one that is gone
+            struct read_awaitable {
+                std::shared_ptr<connection> pConnection;
+
+                // a message that is already there is taken without leaving the strand
+                bool await_ready() const {
+                    return !pConnection || (pConnection->m_strand.running_in_this_thread() && pConnection->HasMessageForReader());
+                }
+
+                // from inside the strand there is no message yet (see await_ready), it just waits
+                void await_suspend(std::coroutine_handle<> hReader) {
+                    if (pConnection->m_strand.running_in_this_thread()) {
+                        pConnection->m_hReader = hReader;
+                        return;
+                    }
+                    asio::post(pConnection->m_strand, [p = pConnection, hReader]() {
+                        p->SetReader(hReader);
+                    });
+                }
+
+                std::optional<message<T>> await_resume() {
+                    if (!pConnection) {
+                        return std::nullopt;
+                    }
+                    return pConnection->TakeMessageForReader();
+                }
+            };
+
+            // The next message received - only one coroutine can read at a time
+            // The body comes from the pool of the connection: RecycleBody gives it back
+            // e.g. while (auto msg = co_await client->ReadMessage()) { ... }
+            read_awaitable ReadMessage() {
+                return read_awaitable{ this->shared_from_this() };
+            }
+#endif
+
+            // A datagram for this connection, received by the socket of the owner
+            // can be called from any thread (the bytes are copied) - the caller may let go of
+            // the connection right after, the handler holds it
+            void ReceiveDatagram(const asio::ip::udp::endpoint& remote, const uint8_t* pData, size_t nData) {
+                std::vector<uint8_t> vDatagram = m_bodyPool.acquire();
+                vDatagram.assign(pData, pData + nData);
+                asio::post(m_strand, [this, self = this->shared_from_this(), remote, vDatagram = std::move(vDatagram)]() mutable {
+                    HandleDatagram(remote, vDatagram);
+                    m_bodyPool.release(std::move(vDatagram));
+                });
+            }
+
+            // Holds the messages sent from now on in the outgoing queue, until Flush
+            // A burst of Sends then goes out together, in as few writes as the write
+            // limits allow (one, up to 64 KiB and 32 messages with a body)
+            void Cork() {
+                asio::post(m_strand, [this, self = this->shared_from_this()]() {
+                    m_bCorked = true;
+                });
+            }
+
+            // Writes the messages held since Cork
+            void Flush() {
+                asio::post(m_strand, [this, self = this->shared_from_this()]() {
+                    m_bCorked = false;
+                    if (m_bStarted && m_nMessagesInFlight == 0 && !m_qMessagesOut.empty() && m_socket.is_open()) {
+                        WriteMessages();
+                    }
+                });
+            }
+
+            // Limits of a single gathered write - how many bytes and how many buffers
+            // (each message takes one buffer for its header and one for its body)
+            void SetWriteLimits(size_t nMaxBytes, size_t nMaxBuffers) {
+                asio::post(m_strand, [this, self = this->shared_from_this(), nMaxBytes, nMaxBuffers]() {
+                    m_nMaxWriteBytes = std::max<size_t>(nMaxBytes, 1);
+                    m_nMaxWriteBuffers = std::max<size_t>(nMaxBuffers, 2);
+                });
+            }
+
+            // Limits of the outgoing queue, and what to do with the messages over them
+            void SetSendQueueLimits(const send_queue_limits& limits) {
+                asio::post(m_strand, [this, self = this->shared_from_this(), limits]() {
+                    m_limits = limits;
+                });
+            }
+
+            // Function told about the backpressure of this connection - it is called from
+            // inside the strand (on a thread of the asio context), the server uses it
+            // to call OnBackpressure
+            void SetBackpressureHandler(std::function<void(std::shared_ptr<connection<T, H>>, backpressure_event)> fnHandler) {
+                asio::post(m_strand, [this, self = this->shared_from_this(), fnHandler = std::move(fnHandler)]() mutable {
+                    m_fnBackpressure = std::move(fnHandler);
+                });
+            }
+
+            // Compress the bodies of at least nThreshold bytes with this codec (codec_id::none
+            // to stop) - only once the remote side has said that it can decompress them
+            void SetCompression(codec_id codec, size_t nThreshold) {
+                asio::post(m_strand, [this, self = this->shared_from_this(), codec, nThreshold]() {
+                    m_nCodec = codec;
+                    m_nCompressThreshold = nThreshold;
+                });
+            }
+
+            // Function that takes every message received, instead of the incoming queue
+            // (dispatch_mode::direct) - it is called from inside the strand, and the body
+            // of the message is reused once it returns. Must be set before the connection starts
+            void SetMessageHandler(std::function<void(owned_message<T, H>&)> fnHandler) {
+                asio::post(m_strand, [this, self = this->shared_from_this(), fnHandler = std::move(fnHandler)]() mutable {
+                    m_fnMessageHandler = std::move(fnHandler);
+                });
+            }
+
+            // Function told whether ConnectToServer succeeded, from inside the strand
+            // Must be set before ConnectToServer
+            void SetConnectHandler(std::function<void(std::error_code)> fnHandler) {
+                asio::post(m_strand, [this, self = this->shared_from_this(), fnHandler = std::move(fnHandler)]() mutable {
+                    m_fnConnectHandler = std::move(fnHandler);
+                });
+            }
+
+            // The strand of this connection - an owner can run its own handlers (e.g. timers)
+            // through it, so they never overlap with the handlers of the connection
+            asio::strand<asio::io_context::executor_type>& GetStrand() {
+                return m_strand;
+            }
+
+            // Snapshot of the counters of this connection - can be called from any thread
+            connection_stats GetStats() const {
+                return connection_stats(id, m_counters);
+            }
+
+            // The counters themselves, e.g. to look at the time of the last read without
+            // a whole snapshot - can be called from any thread
+            const connection_counters& GetCounters() const {
+                return m_counters;
+            }
+
+            // Asks the remote side for a sign of life (control_type::heartbeat): its answer
+            // is a read like any other
+            void SendHeartbeat() {
+                asio::post(m_strand, [this, self = this->shared_from_this()]() {
+                    SendControl(control_type::heartbeat);
+                });
+            }
+
+            // Hands the body of a message received from this connection back, once
+            // the consumer is done with it. It will hold the next message received
+            void RecycleBody(std::vector<uint8_t>&& body) {
+                m_bodyPool.release(std::move(body));
+            }
+
         public:
+            // What Send returns - it can be ignored, or with coroutines co_await it to wait
+            // until the message has left the outgoing queue (written to the socket, or
+            // dropped by the send_queue_limits). It says whether the connection is still open
+            // With coroutines it holds the connection, so the coroutine that awaits it never
+            // resumes on one that is gone (without them it is empty)
+            struct send_awaitable {
+#if OLC_NET_HAS_COROUTINES
+                std::shared_ptr<connection> pConnection;
+                bool bOpen = false;
+
+                bool await_ready() const noexcept {
+                    return pConnection == nullptr;
+                }
+
+                // posted after the Send, so its message is queued by the time it runs
+                void await_suspend(std::coroutine_handle<> hWaiter) {
+                    asio::post(pConnection->m_strand, [p = pConnection, hWaiter, pbOpen = &bOpen]() {
+                        p->AddSendWaiter(hWaiter, pbOpen);
+                    });
+                }
+
+                bool await_resume() const noexcept {
+                    return bOpen;
+                }
+#endif
+            };
+
             // send a message
             // post function is used to inject work into a context
-            void Send(const message<T>& msg) {
-                asio::post(m_asioContext,
-                    [this, msg](){
-                        // check if messages are already being written
-                        bool bWritingMessage = !m_qMessagesOut.empty();
-                        //add are message to the queue
-                        m_qMessagesOut.push_back(msg);
+            // the work goes through the strand, so it never runs at the same time as 
+            // a read or write handler of this connection (even if the context has many threads)
+            send_awaitable Send(const message<T>& msg) {
+                // the copy made for the lambda is the one moved into the queue
+                asio::post(m_strand,
+                    [this, self = this->shared_from_this(), msg]() mutable {
+                        QueueMessage(std::move(msg));
+                    });
+                return MakeSendAwaitable();
+            }
+
+            // send a message that the caller doesn't need anymore - it is moved
+            // all the way to the outgoing queue, its body is never copied
+            send_awaitable Send(message<T>&& msg) {
+                asio::post(m_strand,
+                    [this, self = this->shared_from_this(), msg = std::move(msg)]() mutable {
+                        QueueMessage(std::move(msg));
+                    });
+                return MakeSendAwaitable();
+            }
+
+            // send a message whose body is shared with other connections
+            // only the reference to the body is copied, never the body itself
+            // (if the message was packed, and the remote side can decompress it, it is
+            // the compressed body that is shared)
+            send_awaitable Send(const shared_message<T>& msg) {
+                asio::post(m_strand,
+                    [this, self = this->shared_from_this(), msg](){
+                        outgoing_message<T> out(msg);
+                        if (msg.packed && PeerCanDecompress(msg.nCodec)) {
+                            out.shared = msg.packed;
+                            out.msg.header.size = uint32_t(msg.packed->size()) | header_flags::compressed;
+                            connection_counters::Add(m_counters.nCompressed, 1);
+                            connection_counters::Add(m_counters.nBytesSaved, msg.body->size() - msg.packed->size());
+                        }
+                        QueueMessage(std::move(out));
+                    });
+                return MakeSendAwaitable();
+            }
+
+            // send a message as a datagram (delivery::unreliable): it may be lost, and if it
+            // arrives after a newer one it is dropped. It goes over TCP instead while the
+            // datagram channel is not set up, or if it doesn't fit in a datagram
+            void SendUnreliable(const message<T>& msg) {
+                asio::post(m_strand,
+                    [this, self = this->shared_from_this(), msg]() mutable {
+                        if (!SendDatagram(msg.header, msg.body)) {
+                            connection_counters::Add(m_counters.nUnreliableOverTcp, 1);
+                            QueueMessage(std::move(msg));
+                        }
+                    });
+            }
+
+            void SendUnreliable(message<T>&& msg) {
+                asio::post(m_strand,
+                    [this, self = this->shared_from_this(), msg = std::move(msg)]() mutable {
+                        if (!SendDatagram(msg.header, msg.body)) {
+                            connection_counters::Add(m_counters.nUnreliableOverTcp, 1);
+                            QueueMessage(std::move(msg));
+                        }
+                    });
+            }
 
-                        if (!bWritingMessage) {
-                            WriteHeader();
+            void SendUnreliable(const shared_message<T>& msg) {
+                asio::post(m_strand,
+                    [this, self = this->shared_from_this(), msg]() {
+                        if (!SendDatagram(msg.header, *msg.body)) {
+                            connection_counters::Add(m_counters.nUnreliableOverTcp, 1);
+                            QueueMessage(outgoing_message<T>(msg));
                         }
                     });
             }
+
+            // send a message built in place: the message is created directly in the
+            // outgoing queue, with a body taken from the pool, and the arguments are
+            // pushed into it (in order) like with operator <<
+            // e.g. EmplaceSend(CustomMsgTypes::MovePlayer, nPlayerID, vPosition);
+            template <typename... Args>
+            send_awaitable EmplaceSend(T id, const Args&... args) {
+                asio::post(m_strand,
+                    [this, self = this->shared_from_this(), id, args...]() {
+                        QueueMessageWith([&](outgoing_message<T>& out) {
+                            out.msg.header.id = id;
+                            out.msg.body = m_bodyPool.acquire();
+                            (out.msg << ... << args);
+                        });
+                    });
+                return MakeSendAwaitable();
+            }
             
         private: 
-            // ASYNC - Prime context ready to read a message header
-            void ReadHeader() {
-                asio:async_read(m_socket, asio::buffer(&m_msgTemporaryIn.header, sizeof(message_header<T>)),
-                    [this](std::error_code ec, std::size_t length) {
-                        if (!ec){
-                            if (m_msgTemporaryIn.header.size > 0) {
-                                std::cout << "[SERVER] Just read async a Header.\n";
-                                // resize the temporary variable corresponding to the size of the received message
-                                m_msgTemporaryIn.body.resize(m_msgTemporaryIn.header.size);
-                                ReadBody();
-                            } else {
-                                // empty message received
-                                AddToIncomingMessageQueue();
+            // What a Send returns
+            send_awaitable MakeSendAwaitable() {
+#if OLC_NET_HAS_COROUTINES
+                return send_awaitable{ this->shared_from_this() };
+#else
+                return send_awaitable{};
+#endif
+            }
+
+            // The connection is up: tell the remote side what we can do, and start reading
+            // must run inside the strand
+            void Begin() {
+                if (m_pUring) {
+                    if (m_pRings) {
+                        m_pUring = nullptr;
+                    } else {
+                        RegisterUring();
+                    }
+                }
+                // the transport is set: the messages held until now go out with the capabilities
+                m_bStarted = true;
+                SendCapabilities();
+                OfferDatagrams();
+                ReadData();
+            }
+
+            // CLIENT - the connection to the server is done (or failed), from inside the strand
+            void OnConnected(std::error_code ec) {
+                if (!ec) {
+                    ApplySocketOptions(m_socket, m_socketOptions);
+                    if (m_bSharedMemory && !CreateRings()) {
+                        OLC_NET_LOG_WARNING("[CLIENT] Can not set up the shared memory.");
+                        ec = std::make_error_code(std::errc::not_enough_memory);
+                        CloseSocket();
+                    }
+                }
+                if (!ec) {
+                    Begin();
+                }
+                else {
+                    OLC_NET_LOG_WARNING("[CLIENT] Can not connect to server...");
+#if OLC_NET_HAS_COROUTINES
+                    WakeCoroutines();
+#endif
+                }
+                if (m_fnConnectHandler) {
+                    m_fnConnectHandler(ec);
+                }
+            }
+
+            // CLIENT - makes the rings, and tells the server their name before anything else
+            bool CreateRings() {
+                auto pRings = std::make_unique<shm_channel>();
+                if (!pRings->Create()) {
+                    return false;
+                }
+                asio::error_code ec;
+                asio::write(m_socket, asio::buffer(&pRings->GetHello(), sizeof(shm_hello)), ec);
+                if (ec) {
+                    return false;
+                }
+                // from now on only wake ups go through the socket, and they never wait
+                m_socket.non_blocking(true, ec);
+                m_pRings = std::move(pRings);
+                return true;
+            }
+
+            // SERVER - reads the name of the rings the client made, and maps them
+            void AcceptRings() {
+                asio::async_read(m_socket, asio::buffer(&m_ringHello, sizeof(m_ringHello)),
+                    asio::bind_executor(m_strand, [this, self = this->shared_from_this()](std::error_code ec, std::size_t length) {
+                        auto pRings = std::make_unique<shm_channel>();
+                        if (ec || !pRings->Open(m_ringHello)) {
+                            OLC_NET_LOG_WARNING("[", id, "] Can not open the shared memory of the client.");
+                            connection_counters::Add(m_counters.nReadErrors, 1);
+                            CloseSocket();
+                            return;
+                        }
+                        asio::error_code ecBlocking;
+                        m_socket.non_blocking(true, ecBlocking);
+                        m_pRings = std::move(pRings);
+                        Begin();
+                    }));
+            }
+
+            // Adds a message to the outgoing queue - must run inside the strand
+            void QueueMessage(outgoing_message<T>&& out) {
+                QueueMessageWith([&](outgoing_message<T>& entry) { entry = std::move(out); });
+            }
+
+            // Adds a new entry at the back of the outgoing queue, and lets fnBuild fill it in
+            // must run inside the strand
+            template <typename F>
+            void QueueMessageWith(F&& fnBuild) {
+                // nothing will ever be written to a closed socket, don't let it pile up
+                if (!m_socket.is_open()) {
+                    return;
+                }
+
+                // check if messages are already being written
+                bool bWritingMessage = m_nMessagesInFlight > 0;
+                //add are message to the queue
+                fnBuild(m_qMessagesOut.emplace_back());
+                m_nMessagesQueued++;
+                Compress(m_qMessagesOut.back());
+                m_nQueuedBytes += QueuedSize(m_qMessagesOut.back());
+
+                // a control frame is always sent, it doesn't count for the limits
+                if (IsControl(m_qMessagesOut.back())) {
+                    m_nControlQueued++;
+                } else if (OverLimits()) {
+                    ApplyBackpressurePolicy();
+                }
+                m_counters.SetQueueOut(m_qMessagesOut.size(), m_nQueuedBytes);
+                CheckWatermarks();
+
+                if (!bWritingMessage && m_bStarted && !m_bCorked && !m_qMessagesOut.empty() && m_socket.is_open()) {
+                    WriteMessages();
+                }
+            }
+
+            bool PeerCanDecompress(codec_id codec) const {
+                return codec != codec_id::none && (m_nPeerCodecs & (1u << uint32_t(codec))) != 0;
+            }
+
+            // Compresses the body of a new entry of the outgoing queue, if it is worth it
+            // (shared bodies are compressed once for all connections, by shared_message::pack)
+            void Compress(outgoing_message<T>& out) {
+                if (out.shared || out.msg.body.size() < m_nCompressThreshold || !PeerCanDecompress(m_nCodec) ||
+                    (out.msg.header.size & header_flags::control)) {
+                    return;
+                }
+
+                std::vector<uint8_t> vPacked = m_bodyPool.acquire();
+                if (PackBody(m_nCodec, out.msg.body.data(), out.msg.body.size(), vPacked)) {
+                    connection_counters::Add(m_counters.nCompressed, 1);
+                    connection_counters::Add(m_counters.nBytesSaved, out.msg.body.size() - vPacked.size());
+                    std::swap(out.msg.body, vPacked);
+                    out.msg.header.size = uint32_t(out.msg.body.size()) | header_flags::compressed;
+                }
+                m_bodyPool.release(std::move(vPacked));
+            }
+
+            // Tells the remote side which codecs we can decompress - must run inside the strand
+            void SendCapabilities() {
+                QueueMessageWith([](outgoing_message<T>& out) {
+                    uint32_t nCodecs = SupportedCodecs();
+                    out.msg.body.resize(1 + sizeof(nCodecs));
+                    out.msg.body[0] = uint8_t(control_type::capabilities);
+                    std::memcpy(out.msg.body.data() + 1, &nCodecs, sizeof(nCodecs));
+                    out.msg.header.size = uint32_t(out.msg.body.size()) | header_flags::control;
+                });
+            }
+
+            // A control message with nothing but its type - must run inside the strand
+            void SendControl(control_type type) {
+                QueueMessageWith([type](outgoing_message<T>& out) {
+                    out.msg.body.assign(1, uint8_t(type));
+                    out.msg.header.size = uint32_t(out.msg.body.size()) | header_flags::control;
+                });
+            }
+
+            // A control message from the remote side - must run inside the strand
+            void HandleControl(const uint8_t* pBody, size_t nBody) {
+                if (nBody < 1) {
+                    return;
+                }
+                switch (control_type(pBody[0])) {
+                    case control_type::capabilities:
+                        if (nBody >= 1 + sizeof(uint32_t)) {
+                            std::memcpy(&m_nPeerCodecs, pBody + 1, sizeof(uint32_t));
+                        }
+                        break;
+                    case control_type::datagram_offer:
+                        // only a client with a datagram socket takes the offer
+                        if (m_nOwnerType == owner::client && m_pDatagrams && nBody >= 1 + sizeof(uint16_t) + 2 * sizeof(uint32_t)) {
+                            uint16_t nPort;
+                            std::memcpy(&nPort, pBody + 1, sizeof(nPort));
+                            std::memcpy(&m_nDatagramID, pBody + 1 + sizeof(nPort), sizeof(uint32_t));
+                            std::memcpy(&m_nDatagramToken, pBody + 1 + sizeof(nPort) + sizeof(uint32_t), sizeof(uint32_t));
+                            // the datagrams go to the host we are connected to (over TCP - a
+                            // local connection has no address to send them to)
+                            asio::error_code ec;
+                            asio::ip::tcp::endpoint tcpRemote;
+                            if (ToTcpEndpoint(m_socket.remote_endpoint(ec), tcpRemote) && !ec) {
+                                m_udpRemote = asio::ip::udp::endpoint(tcpRemote.address(), nPort);
+                                // the server knows us by the ID and the token, we can send at once
+                                m_bDatagramReady = true;
+                                SendHello();
+                            }
+                        }
+                        break;
+                    case control_type::datagram_ready:
+                        m_bHelloAnswered = true;
+                        m_helloTimer.cancel();
+                        break;
+                    case control_type::heartbeat:
+                        SendControl(control_type::heartbeat_reply);
+                        break;
+                    default:
+                        break;
+                }
+            }
+
+            // Offers the datagram channel to the client - must run inside the strand
+            void OfferDatagrams() {
+                if (m_nOwnerType != owner::server || !m_pDatagrams) {
+                    return;
+                }
+
+                // the token keeps other hosts from sending datagrams in the name of this client
+                static thread_local std::mt19937 rng(std::random_device{}());
+                m_nDatagramID = id;
+                m_nDatagramToken = uint32_t(rng());
+
+                QueueMessageWith([this](outgoing_message<T>& out) {
+                    uint16_t nPort = m_pDatagrams->GetPort();
+                    out.msg.body.resize(1 + sizeof(nPort) + 2 * sizeof(uint32_t));
+                    out.msg.body[0] = uint8_t(control_type::datagram_offer);
+                    std::memcpy(out.msg.body.data() + 1, &nPort, sizeof(nPort));
+                    std::memcpy(out.msg.body.data() + 1 + sizeof(nPort), &m_nDatagramID, sizeof(uint32_t));
+                    std::memcpy(out.msg.body.data() + 1 + sizeof(nPort) + sizeof(uint32_t), &m_nDatagramToken, sizeof(uint32_t));
+                    out.msg.header.size = uint32_t(out.msg.body.size()) | header_flags::control;
+                });
+            }
+
+            // The client says hello over UDP until the server answers over TCP (a hello can be
+            // lost too) - must run inside the strand
+            void SendHello() {
+                if (m_bHelloAnswered || !m_socket.is_open() || m_nHellos >= nMaxHellos) {
+                    return;
+                }
+                m_nHellos++;
+
+                std::vector<uint8_t> vDatagram = m_pDatagrams->Acquire();
+                datagram_header header{ m_nDatagramID, m_nDatagramToken, 0 };
+                vDatagram.resize(sizeof(header));
+                std::memcpy(vDatagram.data(), &header, sizeof(header));
+                m_pDatagrams->Send(m_udpRemote, std::move(vDatagram));
+
+                m_helloTimer.expires_after(std::chrono::milliseconds(100));
+                m_helloTimer.async_wait(asio::bind_executor(m_strand, [this, self = this->shared_from_this()](std::error_code ec) {
+                    if (!ec) {
+                        SendHello();
+                    }
+                }));
+            }
+
+            // Sends a message as a datagram - false if it can't be (no channel yet, or too big)
+            // must run inside the strand
+            bool SendDatagram(const message_header<T>& msgHeader, const std::vector<uint8_t>& body) {
+                if (!m_bDatagramReady || !m_socket.is_open()) {
+                    return false;
+                }
+
+                message_header<T> header = msgHeader;
+                header.size = uint32_t(body.size());
+                size_t nHeader = H::size(header);
+                size_t nDatagram = sizeof(datagram_header) + nHeader + body.size();
+                if (nDatagram > datagram_socket::nDefaultMaxDatagram) {
+                    return false;
+                }
+
+                // 0 is the sequence number of a hello
+                if (++m_nDatagramSequenceOut == 0) {
+                    m_nDatagramSequenceOut = 1;
+                }
+                datagram_header dgHeader{ m_nDatagramID, m_nDatagramToken, m_nDatagramSequenceOut };
+
+                std::vector<uint8_t> vDatagram = m_pDatagrams->Acquire();
+                vDatagram.resize(nDatagram);
+                std::memcpy(vDatagram.data(), &dgHeader, sizeof(dgHeader));
+                H::encode(header, vDatagram.data() + sizeof(dgHeader));
+                if (!body.empty()) {
+                    std::memcpy(vDatagram.data() + sizeof(dgHeader) + nHeader, body.data(), body.size());
+                }
+                m_pDatagrams->Send(m_udpRemote, std::move(vDatagram));
+
+                connection_counters::Add(m_counters.nDatagramsOut, 1);
+                return true;
+            }
+
+            // A datagram from the remote side - must run inside the strand
+            void HandleDatagram(const asio::ip::udp::endpoint& remote, const std::vector<uint8_t>& vDatagram) {
+                datagram_header dgHeader;
+                if (!m_pDatagrams || vDatagram.size() < sizeof(dgHeader) || !m_socket.is_open()) {
+                    return;
+                }
+                std::memcpy(&dgHeader, vDatagram.data(), sizeof(dgHeader));
+                if (dgHeader.nID != m_nDatagramID || dgHeader.nToken != m_nDatagramToken) {
+                    return;
+                }
+
+                if (m_nOwnerType == owner::server) {
+                    // the datagrams of the client come from here - send ours there too
+                    // (it may change, e.g. when a NAT gives the client another port)
+                    m_udpRemote = remote;
+                    if (!m_bDatagramReady) {
+                        m_bDatagramReady = true;
+                        QueueMessageWith([](outgoing_message<T>& out) {
+                            out.msg.body.push_back(uint8_t(control_type::datagram_ready));
+                            out.msg.header.size = uint32_t(out.msg.body.size()) | header_flags::control;
+                        });
+                    }
+                }
+
+                if (dgHeader.nSequence == 0) {
+                    // a hello, nothing else in it
+                    return;
+                }
+
+                // only newer than the newest so far (the difference is signed, so that the
+                // sequence numbers can wrap around)
+                if (int32_t(dgHeader.nSequence - m_nDatagramSequenceIn) <= 0) {
+                    connection_counters::Add(m_counters.nDatagramsStale, 1);
+                    return;
+                }
+
+                // one whole message, with no flags (datagrams are not compressed)
+                const uint8_t* pMessage = vDatagram.data() + sizeof(dgHeader);
+                size_t nMessage = vDatagram.size() - sizeof(dgHeader);
+                size_t nHeader = H::decode(pMessage, nMessage, m_msgTemporaryIn.header);
+                if (nHeader == 0 || nHeader == header_invalid ||
+                    m_msgTemporaryIn.header.size != nMessage - nHeader) {
+                    OLC_NET_LOG_DEBUG("[", id, "] Bad datagram.");
+                    return;
+                }
+                m_nDatagramSequenceIn = dgHeader.nSequence;
+
+                m_msgTemporaryIn.body = m_bodyPool.acquire();
+                m_msgTemporaryIn.body.assign(pMessage + nHeader, pMessage + nMessage);
+                connection_counters::Add(m_counters.nDatagramsIn, 1);
+                connection_counters::Add(m_counters.nMessagesIn, 1);
+                AddToIncomingMessageQueue();
+            }
+
+            static bool IsControl(const outgoing_message<T>& out) {
+                return (out.msg.header.size & header_flags::control) != 0;
+            }
+
+            // what a queued message counts for in the byte limits (control frames don't)
+            static size_t QueuedSize(const outgoing_message<T>& out) {
+                return IsControl(out) ? 0 : H::size(out.msg.header) + out.body().size();
+            }
+
+            bool OverLimits() const {
+                if (m_limits.policy == backpressure_policy::none) {
+                    return false;
+                }
+                return (m_limits.nMaxMessages > 0 && m_qMessagesOut.size() - m_nControlQueued > m_limits.nMaxMessages)
+                    || (m_limits.nMaxBytes > 0 && m_nQueuedBytes > m_limits.nMaxBytes);
+            }
+
+            // Removes the queued message at position i - never one that is being written
+            void DropQueued(size_t i) {
+                if (IsControl(m_qMessagesOut[i])) {
+                    m_nControlQueued--;
+                }
+                m_nQueuedBytes -= QueuedSize(m_qMessagesOut[i]);
+                m_bodyPool.release(std::move(m_qMessagesOut[i].msg.body));
+                m_qMessagesOut.erase(m_qMessagesOut.begin() + i);
+            }
+
+            // The message just added at the back of the queue doesn't fit
+            // (it is never a control frame, and no control frame is dropped or replaced:
+            // the capabilities, heartbeat replies and datagram offers must reach the peer)
+            void ApplyBackpressurePolicy() {
+                if (!m_bLimitReported) {
+                    m_bLimitReported = true;
+                    ReportBackpressure(backpressure_event::limit_reached);
+                }
+
+                switch (m_limits.policy) {
+                    case backpressure_policy::drop_newest:
+                        DropQueued(m_qMessagesOut.size() - 1);
+                        connection_counters::Add(m_counters.nDroppedNewest, 1);
+                        return;
+
+                    case backpressure_policy::coalesce:
+                    {
+                        // the latest queued message with the same id takes the new content,
+                        // it keeps its place in the queue
+                        size_t nNewest = m_qMessagesOut.size() - 1;
+                        for (size_t i = nNewest; i-- > m_nMessagesInFlight; ) {
+                            if (!IsControl(m_qMessagesOut[i]) &&
+                                m_qMessagesOut[i].msg.header.id == m_qMessagesOut[nNewest].msg.header.id) {
+                                m_nQueuedBytes -= QueuedSize(m_qMessagesOut[i]);
+                                m_bodyPool.release(std::move(m_qMessagesOut[i].msg.body));
+                                m_qMessagesOut[i] = std::move(m_qMessagesOut[nNewest]);
+                                m_qMessagesOut.pop_back();
+                                connection_counters::Add(m_counters.nCoalesced, 1);
+                                break;
+                            }
+                        }
+                        if (!OverLimits()) {
+                            return;
+                        }
+                    }
+                    // nothing to replace, or the new content is bigger - make room
+                    [[fallthrough]];
+
+                    case backpressure_policy::drop_oldest:
+                        // the messages being written can't be touched, control frames are kept,
+                        // and the new one goes last
+                        for (size_t i = m_nMessagesInFlight; OverLimits() && i < m_qMessagesOut.size() - 1; ) {
+                            if (IsControl(m_qMessagesOut[i])) {
+                                i++;
+                                continue;
                             }
+                            DropQueued(i);
+                            connection_counters::Add(m_counters.nDroppedOldest, 1);
+                        }
+                        if (OverLimits()) {
+                            DropQueued(m_qMessagesOut.size() - 1);
+                            connection_counters::Add(m_counters.nDroppedNewest, 1);
+                        }
+                        return;
+
+                    case backpressure_policy::disconnect:
+                        // the messages being written are left to the write in progress, which will fail
+                        while (m_qMessagesOut.size() > m_nMessagesInFlight) {
+                            DropQueued(m_qMessagesOut.size() - 1);
+                        }
+                        connection_counters::Add(m_counters.nOverflowDisconnects, 1);
+                        OLC_NET_LOG_WARNING("[", id, "] Outgoing queue full, disconnecting.");
+                        CloseSocket();
+                        return;
+
+                    default:
+                        return;
+                }
+            }
+
+            // Tells the owner when the queue crosses its watermarks
+            void CheckWatermarks() {
+                size_t nMessages = m_qMessagesOut.size();
+                bool bUnderLow = nMessages <= m_limits.nLowWaterMessages && m_nQueuedBytes <= m_limits.nLowWaterBytes;
+
+                if (!m_bAboveHighWater) {
+                    if ((m_limits.nHighWaterMessages > 0 && nMessages >= m_limits.nHighWaterMessages) ||
+                        (m_limits.nHighWaterBytes > 0 && m_nQueuedBytes >= m_limits.nHighWaterBytes)) {
+                        m_bAboveHighWater = true;
+                        connection_counters::Add(m_counters.nHighWatermarks, 1);
+                        ReportBackpressure(backpressure_event::high_watermark);
+                    }
+                } else if (bUnderLow) {
+                    m_bAboveHighWater = false;
+                    ReportBackpressure(backpressure_event::low_watermark);
+                }
+
+                if (bUnderLow) {
+                    m_bLimitReported = false;
+                }
+            }
+
+            void ReportBackpressure(backpressure_event event) {
+                if (m_fnBackpressure) {
+                    m_fnBackpressure(this->shared_from_this(), event);
+                }
+            }
+
+            // ASYNC - Prime context ready to read whatever the socket has for us
+            // Rather than reading each header and each body with an async_read of its own,
+            // the socket fills a receive buffer with as many bytes as it has ready, and
+            // ParseMessages cuts as many complete messages out of it as it can
+            void ReadData() {
+                // a partial message left from the previous read is moved to the front of the buffer
+                size_t nPending = m_nReadEnd - m_nReadStart;
+                if (m_nReadStart > 0) {
+                    if (nPending > 0) {
+                        std::memmove(m_vReadBuffer.data(), m_vReadBuffer.data() + m_nReadStart, nPending);
+                    }
+                    m_nReadStart = 0;
+                    m_nReadEnd = nPending;
+                }
+
+                // if we already know the size of the partial message, make sure it fits
+                size_t nNeeded = m_nReadEnd + 1;
+                message_header<T> header;
+                size_t nHeader = H::decode(m_vReadBuffer.data(), nPending, header);
+                if (nHeader != 0 && nHeader != header_invalid) {
+                    nNeeded = std::max(nNeeded, nHeader + (header.size & header_flags::size_mask));
+                }
+                if (m_vReadBuffer.size() < nNeeded) {
+                    m_vReadBuffer.resize(std::max(nNeeded, m_vReadBuffer.size() * 2));
+                }
+
+                if (m_pRings) {
+                    ReadRing();
+                    return;
+                }
+
+                // with io_uring, the receive in the ring stays there (a multishot receive) or
+                // is put back after each chunk
+                if (m_pUring) {
+                    if (!m_bUringReceiving) {
+                        m_bUringReceiving = m_pUring->Receive(m_nUringKey, int(m_socket.native_handle()));
+                        if (!m_bUringReceiving) {
+                            OLC_NET_LOG_WARNING("[", id, "] Read Fail.");
+                            connection_counters::Add(m_counters.nReadErrors, 1);
+                            CloseSocket();
+                        }
+                    }
+                    return;
+                }
+
+                // like the write, the operation of the read is made in memory of the connection
+                m_socket.async_read_some(asio::buffer(m_vReadBuffer.data() + m_nReadEnd, m_vReadBuffer.size() - m_nReadEnd),
+                    asio::bind_executor(m_strand, WithMemory(m_readMemory, [this, self = this->shared_from_this()](std::error_code ec, std::size_t length) {
+                        if (!ec) {
+                            m_nReadEnd += length;
+                            connection_counters::Add(m_counters.nReads, 1);
+                            connection_counters::Add(m_counters.nBytesIn, length);
+                            m_counters.TouchRead();
 
+                            ParseMessages();
+                            // go back to the socket for more
+                            ReadData();
                         } else {
-                            std::cout << "[" << id << "] Read Header Fail.\n";
-                            m_socket.close();
+                            OLC_NET_LOG_WARNING("[", id, "] Read Fail.");
+                            connection_counters::Add(m_counters.nReadErrors, 1);
+                            CloseSocket();
                         }
-                    });
+                    })));
             }
 
-            // ASYNC - prime context ready to read a message body
-            void ReadBody() {
-                asio::async_read(m_socket, asio::buffer(m_msgTemporaryIn.body.data(), m_msgTemporaryIn.header.size),
-                    [this](std::error_code ec, std::size_t length) {
+            // Over shared memory, the receive buffer is filled from the ring of the remote side
+            // While bytes keep coming, the ring is looked at again and again (through the strand,
+            // so the sends of this connection still get their turn). Once it has been empty for
+            // a while, the connection sleeps on the socket until the remote side wakes it up
+            void ReadRing() {
+                if (!m_socket.is_open()) {
+                    return;
+                }
+
+                size_t nRead = m_pRings->Read(m_vReadBuffer.data() + m_nReadEnd, m_vReadBuffer.size() - m_nReadEnd);
+                auto tNow = std::chrono::steady_clock::now();
+                if (nRead > 0) {
+                    m_tRingActive = tNow;
+                    // the remote side may be waiting for this room
+                    if (m_pRings->WakeWriter()) {
+                        RingDoorbell();
+                    }
+
+                    m_nReadEnd += nRead;
+                    connection_counters::Add(m_counters.nReads, 1);
+                    connection_counters::Add(m_counters.nBytesIn, nRead);
+                    m_counters.TouchRead();
+                    ParseMessages();
+                }
+
+                // a write that waited for room in our ring may go on
+                ContinueRingWrite();
+
+                if (!m_socket.is_open()) {
+                    return;
+                }
+                if (nRead > 0 || tNow - m_tRingActive < m_tRingSpin || !m_pRings->SleepRead()) {
+                    asio::post(m_strand, [this, self = this->shared_from_this()]() { ReadData(); });
+                    return;
+                }
+
+                // the ring is empty: sleep until the remote side writes (or makes room for a
+                // write of ours), or closes the socket
+                m_socket.async_read_some(asio::buffer(m_vDoorbell),
+                    asio::bind_executor(m_strand, [this, self = this->shared_from_this()](std::error_code ec, std::size_t length) {
                         if (!ec) {
-                            AddToIncomingMessageQueue();
+                            connection_counters::Add(m_counters.nRingWakeups, 1);
+                            ReadData();
                         } else {
-                            std::cout << "[" << id << "] Read Body Fail.\n";
-                            m_socket.close();
+                            OLC_NET_LOG_WARNING("[", id, "] Read Fail.");
+                            connection_counters::Add(m_counters.nReadErrors, 1);
+                            CloseSocket();
                         }
+                    }));
+            }
+
+            // Wakes up the remote side, sleeping on the socket - it never blocks: if the socket
+            // is full, there are wake ups in it already
+            void RingDoorbell() {
+                uint8_t nByte = 0;
+                asio::error_code ec;
+                m_socket.send(asio::buffer(&nByte, 1), 0, ec);
+            }
+
+            // Cut every complete message (header and body) out of the receive buffer
+            // A message that is not complete yet stays in the buffer for the next read
+            // (with a header of variable size, even its header may not be complete)
+            void ParseMessages() {
+                while (m_nReadEnd > m_nReadStart) {
+                    const uint8_t* pData = m_vReadBuffer.data() + m_nReadStart;
+
+                    size_t nHeader = H::decode(pData, m_nReadEnd - m_nReadStart, m_msgTemporaryIn.header);
+                    if (nHeader == 0) {
+                        // only part of the header has arrived
+                        break;
+                    }
+                    if (nHeader == header_invalid) {
+                        OLC_NET_LOG_WARNING("[", id, "] Bad header.");
+                        connection_counters::Add(m_counters.nReadErrors, 1);
+                        CloseSocket();
+                        return;
+                    }
+
+                    uint32_t nFlags = m_msgTemporaryIn.header.size & ~header_flags::size_mask;
+                    size_t nBody = m_msgTemporaryIn.header.size & header_flags::size_mask;
+                    size_t nMessage = nHeader + nBody;
+                    if (m_nReadEnd - m_nReadStart < nMessage) {
+                        // only part of the body has arrived
+                        break;
                     }
-                );
+
+                    OLC_NET_LOG_TRACE("[", id, "] Just read async a Header.");
+                    const uint8_t* pBody = pData + nHeader;
+                    m_nReadStart += nMessage;
+
+                    // messages for the connection itself are not passed on
+                    if (nFlags & header_flags::control) {
+                        HandleControl(pBody, nBody);
+                        continue;
+                    }
+
+                    // the body comes from the pool - when message sizes are stable it
+                    // already has the capacity needed, and assign doesn't allocate
+                    m_msgTemporaryIn.body = m_bodyPool.acquire();
+                    if (nFlags & header_flags::compressed) {
+                        if (!UnpackBody(pBody, nBody, m_msgTemporaryIn.body)) {
+                            OLC_NET_LOG_WARNING("[", id, "] Bad compressed message.");
+                            connection_counters::Add(m_counters.nReadErrors, 1);
+                            CloseSocket();
+                            return;
+                        }
+                        m_msgTemporaryIn.header.size = uint32_t(m_msgTemporaryIn.body.size());
+                    } else {
+                        m_msgTemporaryIn.body.assign(pBody, pBody + nBody);
+                    }
+
+                    connection_counters::Add(m_counters.nMessagesIn, 1);
+                    AddToIncomingMessageQueue();
+                }
             }
 
-            // ASYNC - prime context ready to write a message header
-            void WriteHeader() {
-                asio::async_write(m_socket, asio::buffer(&m_qMessagesOut.front().header, sizeof(message_header<T>)),
-                    [this](std::error_code ec, std::size_t length){
+            // ASYNC - prime context ready to write the messages waiting in the queue
+            // Instead of writing the header and then the body of one message at a time,
+            // the header and body of every queued message (up to the limits) are gathered
+            // into a list of buffers, and the whole list goes out with a single async_write
+            void WriteMessages() {
+                // the headers are encoded into m_vWriteHeaders, and the bodies are written
+                // from their own storage (which doesn't move when a queue entry does), so the
+                // backpressure policy can remove queued messages while these ones are being written
+                // Every message takes at least one buffer: the headers of this write fit in the
+                // space made here, which doesn't move while the buffers point to it
+                size_t nMaxMessages = std::min(m_qMessagesOut.size(), m_nMaxWriteBuffers);
+                m_vWriteHeaders.resize(nMaxMessages * H::template max_size<T>());
+                m_vWriteBuffers.clear();
+                m_nMessagesInFlight = 0;
+                size_t nHeaderBytes = 0;
+                size_t nBytes = 0;
+
+                for (auto& out : m_qMessagesOut) {
+                    if (m_nMessagesInFlight == nMaxMessages) {
+                        break;
+                    }
+
+                    const std::vector<uint8_t>& body = out.body();
+                    uint8_t* pHeader = m_vWriteHeaders.data() + nHeaderBytes;
+                    size_t nHeader = H::encode(out.msg.header, pHeader);
+                    size_t nMsgBuffers = body.empty() ? 1 : 2;
+                    size_t nMsgBytes = nHeader + body.size();
+
+                    // the first message is always written, even if it is over the limits on its own
+                    if (m_nMessagesInFlight > 0 &&
+                        (m_vWriteBuffers.size() + nMsgBuffers > m_nMaxWriteBuffers || nBytes + nMsgBytes > m_nMaxWriteBytes)) {
+                        break;
+                    }
+
+                    m_vWriteBuffers.push_back(asio::buffer(pHeader, nHeader));
+                    // a message does not need to have a body
+                    if (!body.empty()) {
+                        m_vWriteBuffers.push_back(asio::buffer(body.data(), body.size()));
+                    }
+                    nHeaderBytes += nHeader;
+                    nBytes += nMsgBytes;
+                    m_nMessagesInFlight++;
+                }
+                // for the write timeout of the server
+                m_counters.nWriteStarted.store(connection_counters::Now(), std::memory_order_relaxed);
+
+                if (m_pRings) {
+                    m_nRingBuffer = 0;
+                    m_nRingOffset = 0;
+                    m_nRingWritten = 0;
+                    WriteRing();
+                    return;
+                }
+
+                if (m_pUring) {
+                    m_nUringWritten = 0;
+                    m_nUringToWrite = nBytes;
+                    WriteUring();
+                    return;
+                }
+
+                // the messages stay in the queue until they are written (and m_vWriteBuffers
+                // doesn't change, so the write can point into it)
+                // The operation of the write is made in m_writeMemory - asio frees it before
+                // the handler runs, so the next write can take it again
+                buffer_range buffers{ m_vWriteBuffers.data(), m_vWriteBuffers.data() + m_vWriteBuffers.size() };
+                asio::async_write(m_socket, buffers,
+                    asio::bind_executor(m_strand, WithMemory(m_writeMemory, [this, self = this->shared_from_this()](std::error_code ec, std::size_t length){
                         if (!ec) {
-                            if (m_qMessagesOut.front().body.size() > 0) {
-                                WriteBody();
-                            } else {
-                                // if the message does not have a body we have to remove it
-                                m_qMessagesOut.pop_front();
+                            OnMessagesWritten(length);
 
-                                // we can also check if there are other messages to be sent
-                                if (!m_qMessagesOut.empty()) {
-                                    WriteHeader();
-                                }
+                            // messages sent while we were writing are gathered in the next write
+                            // (or wait for Flush, if the connection has been corked since)
+                            if (!m_qMessagesOut.empty() && !m_bCorked) {
+                                WriteMessages();
                             }
-
                         } else {
-                            std::cout << "[" << id << "} Write Header Fail.\n";
-                            m_socket.close();
+                            OLC_NET_LOG_WARNING("[", id, "] Write Fail.");
+                            connection_counters::Add(m_counters.nWriteErrors, 1);
+                            CloseSocket();
+                        }
+                    })));
+            }
+
+            // The messages in flight are written
+            void OnMessagesWritten(size_t nLength) {
+                // remove the messages that were written, their bodies can be reused
+                // by the messages we receive (a shared body is just released, it is
+                // freed with the last reference)
+                for (size_t i = 0; i < m_nMessagesInFlight; i++) {
+                    if (IsControl(m_qMessagesOut[i])) {
+                        m_nControlQueued--;
+                    }
+                    m_nQueuedBytes -= QueuedSize(m_qMessagesOut[i]);
+                    m_bodyPool.release(std::move(m_qMessagesOut[i].msg.body));
+                }
+                m_qMessagesOut.erase(m_qMessagesOut.begin(), m_qMessagesOut.begin() + m_nMessagesInFlight);
+
+                connection_counters::Add(m_counters.nWrites, 1);
+                connection_counters::Add(m_counters.nMessagesOut, m_nMessagesInFlight);
+                connection_counters::Add(m_counters.nBytesOut, nLength);
+                m_counters.SetQueueOut(m_qMessagesOut.size(), m_nQueuedBytes);
+                m_counters.Touch();
+                m_counters.nWriteStarted.store(0, std::memory_order_relaxed);
+                m_nMessagesInFlight = 0;
+                CheckWatermarks();
+#if OLC_NET_HAS_COROUTINES
+                ResumeSendWaiters();
+#endif
+            }
+
+            // Over shared memory, the gathered buffers are copied into our ring - as much as
+            // fits. If it is full, the rest waits until the remote side has read some of it
+            void WriteRing() {
+                while (m_nRingBuffer < m_vWriteBuffers.size()) {
+                    const asio::const_buffer& buffer = m_vWriteBuffers[m_nRingBuffer];
+                    size_t nWritten = m_pRings->Write(static_cast<const uint8_t*>(buffer.data()) + m_nRingOffset, buffer.size() - m_nRingOffset);
+                    m_nRingOffset += nWritten;
+                    m_nRingWritten += nWritten;
+                    if (m_nRingOffset == buffer.size()) {
+                        m_nRingBuffer++;
+                        m_nRingOffset = 0;
+                    } else if (m_pRings->SleepWrite()) {
+                        // the ring is full, and the remote side will say when it has made room
+                        if (m_pRings->WakeReader()) {
+                            RingDoorbell();
+                        }
+                        m_bRingWriteWaiting = true;
+                        return;
+                    }
+                }
+
+                if (m_pRings->WakeReader()) {
+                    RingDoorbell();
+                }
+                OnMessagesWritten(m_nRingWritten);
+
+                // the next write is posted rather than started from here, so a long queue
+                // doesn't go down the stack
+                if (!m_qMessagesOut.empty() && !m_bCorked) {
+                    asio::post(m_strand, [this, self = this->shared_from_this()]() {
+                        if (m_nMessagesInFlight == 0 && !m_qMessagesOut.empty() && !m_bCorked && m_socket.is_open()) {
+                            WriteMessages();
                         }
                     });
+                }
+            }
+
+            // The remote side may have made room for a write that was waiting
+            void ContinueRingWrite() {
+                if (m_bRingWriteWaiting && m_socket.is_open()) {
+                    m_bRingWriteWaiting = false;
+                    WriteRing();
+                }
             }
-                
-            // ASYNC - prime context ready to write a message body
-            void WriteBody() {
-                asio::async_write(m_socket, asio::buffer(m_qMessagesOut.front().body.data(), m_qMessagesOut.front().body.size()),
-                    [this](std::error_code ec, std::size_t length){
-                        if (!ec) {
-                            m_qMessagesOut.pop_front();
 
-                            if (!m_qMessagesOut.empty()) {
-                                WriteHeader();
+            // Closes the socket - with io_uring, the requests in the ring that are not sent to the
+            // kernel yet go first (so none of them finds another socket that gets this descriptor)
+            // and the socket is shut down: the ring holds it too, and a close alone would leave
+            // its receive waiting
+            void CloseSocket() {
+                if (m_pUring && m_socket.is_open()) {
+                    m_pUring->Flush();
+                    asio::error_code ec;
+                    m_socket.shutdown(asio::socket_base::shutdown_both, ec);
+                }
+                m_socket.close();
+#if OLC_NET_HAS_COROUTINES
+                WakeCoroutines();
+#endif
+            }
+
+#if OLC_NET_HAS_COROUTINES
+            // COROUTINES - inside the strand: the reader is kept until a message arrives
+            bool HasMessageForReader() const {
+                return !m_qCoroIn.empty() || m_bCoroClosed;
+            }
+
+            void SetReader(std::coroutine_handle<> hReader) {
+                if (HasMessageForReader()) {
+                    hReader.resume();
+                } else {
+                    m_hReader = hReader;
+                }
+            }
+
+            std::optional<message<T>> TakeMessageForReader() {
+                if (m_qCoroIn.empty()) {
+                    return std::nullopt;
+                }
+                std::optional<message<T>> msg(std::move(m_qCoroIn.front()));
+                m_qCoroIn.pop_front();
+                return msg;
+            }
+
+            // The waiter of a send goes on once every message queued so far has left the queue
+            void AddSendWaiter(std::coroutine_handle<> hWaiter, bool* pbOpen) {
+                if (m_bCoroClosed) {
+                    *pbOpen = false;
+                    hWaiter.resume();
+                } else if (m_qMessagesOut.empty()) {
+                    *pbOpen = true;
+                    hWaiter.resume();
+                } else {
+                    m_qSendWaiters.push_back({ m_nMessagesQueued, hWaiter, pbOpen });
+                }
+            }
+
+            // They are resumed by handlers of their own, this one may be in the middle of a write
+            void ResumeSendWaiters() {
+                uint64_t nDone = m_nMessagesQueued - m_qMessagesOut.size();
+                while (!m_qSendWaiters.empty() && (m_bCoroClosed || m_qSendWaiters.front().nTarget <= nDone)) {
+                    send_waiter waiter = m_qSendWaiters.front();
+                    m_qSendWaiters.pop_front();
+                    *waiter.pbOpen = !m_bCoroClosed;
+                    asio::post(m_strand, [hWaiter = waiter.hWaiter]() { hWaiter.resume(); });
+                }
+            }
+
+            // The connection is closed: the reader gets what is left and then std::nullopt
+            void WakeCoroutines() {
+                m_bCoroClosed = true;
+                if (m_hReader) {
+                    asio::post(m_strand, [hReader = std::exchange(m_hReader, nullptr)]() { hReader.resume(); });
+                }
+                ResumeSendWaiters();
+            }
+#endif
+
+            // With io_uring: the completions of this connection come through its strand
+            // They hold no reference to the connection - one that is gone by then is skipped,
+            // and the buffer of a receive goes back to the kernel
+            void RegisterUring() {
+                std::weak_ptr<connection<T, H>> wpSelf = this->weak_from_this();
+                // the engine keeps this function: it must not hold the engine either
+                std::weak_ptr<uring_engine> wpUring = m_pUring;
+                m_nUringKey = m_pUring->Register([strand = m_strand, wpSelf, wpUring](uring_op op, int32_t nResult, uint32_t nFlags) {
+                    asio::post(strand, [wpSelf, wpUring, op, nResult, nFlags]() {
+                        if (auto self = wpSelf.lock()) {
+                            if (op == uring_op::receive) {
+                                self->OnUringReceive(nResult, nFlags);
+                            } else {
+                                self->OnUringSend(nResult);
                             }
-                        } else {
-                            std::cout << "[" << id << "] Write Body Fail.\n";
-                            m_socket.close();
+                        } else if (auto pUring = wpUring.lock()) {
+                            pUring->ReleaseBuffer(nFlags);
+                        }
+                    });
+                });
+            }
+
+            // A receive of the ring completed: the chunk is copied out of the buffer of the
+            // kernel (which goes back at once) and parsed like a read of the socket
+            void OnUringReceive(int32_t nResult, uint32_t nFlags) {
+                if (!uring_engine::MoreToCome(nFlags)) {
+                    m_bUringReceiving = false;
+                }
+
+                const uint8_t* pData = m_pUring->GetBuffer(nFlags);
+                if (nResult > 0 && pData && m_socket.is_open()) {
+                    size_t nRead = size_t(nResult);
+                    if (m_vReadBuffer.size() < m_nReadEnd + nRead) {
+                        m_vReadBuffer.resize(std::max(m_nReadEnd + nRead, m_vReadBuffer.size() * 2));
+                    }
+                    std::memcpy(m_vReadBuffer.data() + m_nReadEnd, pData, nRead);
+                    m_pUring->ReleaseBuffer(nFlags);
+
+                    m_nReadEnd += nRead;
+                    connection_counters::Add(m_counters.nReads, 1);
+                    connection_counters::Add(m_counters.nBytesIn, nRead);
+                    m_counters.TouchRead();
+
+                    ParseMessages();
+                    if (m_socket.is_open()) {
+                        ReadData();
+                    }
+                    return;
+                }
+                m_pUring->ReleaseBuffer(nFlags);
+
+                if (!m_socket.is_open()) {
+                    return;
+                }
+                if (nResult == -ENOBUFS) {
+                    // every buffer of the kernel is waiting to be copied out by a connection:
+                    // try again once the others have had their turn
+                    asio::post(m_strand, [this, self = this->shared_from_this()]() {
+                        if (m_socket.is_open()) {
+                            ReadData();
                         }
                     });
+                    return;
+                }
+                if (nResult == -EINVAL && m_pUring->DisableMultishot()) {
+                    ReadData();
+                    return;
+                }
+
+                OLC_NET_LOG_WARNING("[", id, "] Read Fail.");
+                connection_counters::Add(m_counters.nReadErrors, 1);
+                CloseSocket();
             }
 
+            // ASYNC - the gathered buffers go in the ring as one send (the part of them not
+            // written yet, if a send was cut short)
+            void WriteUring() {
+                if (!m_pUring->Send(m_nUringKey, int(m_socket.native_handle()), m_vWriteBuffers, m_nUringWritten)) {
+                    OLC_NET_LOG_WARNING("[", id, "] Write Fail.");
+                    connection_counters::Add(m_counters.nWriteErrors, 1);
+                    CloseSocket();
+                }
+            }
+
+            // A send of the ring completed
+            void OnUringSend(int32_t nResult) {
+                if (!m_socket.is_open()) {
+                    return;
+                }
+                if (nResult <= 0 && nResult != -EINTR && nResult != -EAGAIN) {
+                    OLC_NET_LOG_WARNING("[", id, "] Write Fail.");
+                    connection_counters::Add(m_counters.nWriteErrors, 1);
+                    CloseSocket();
+                    return;
+                }
+
+                // the socket is full: sending again at once would just fail again (and again),
+                // so the send waits until the socket can take more
+                if (nResult == -EAGAIN) {
+                    connection_counters::Add(m_counters.nWriteStalls, 1);
+                    m_socket.async_wait(asio::socket_base::wait_write,
+                        asio::bind_executor(m_strand, [this, self = this->shared_from_this()](std::error_code ec) {
+                            if (!m_socket.is_open()) {
+                                return;
+                            }
+                            if (ec) {
+                                OLC_NET_LOG_WARNING("[", id, "] Write Fail.");
+                                connection_counters::Add(m_counters.nWriteErrors, 1);
+                                CloseSocket();
+                                return;
+                            }
+                            WriteUring();
+                        }));
+                    return;
+                }
+
+                // an interrupted send is simply sent again
+                m_nUringWritten += size_t(std::max(nResult, 0));
+                if (m_nUringWritten < m_nUringToWrite) {
+                    WriteUring();
+                    return;
+                }
+
+                OnMessagesWritten(m_nUringWritten);
+                if (!m_qMessagesOut.empty() && !m_bCorked) {
+                    WriteMessages();
+                }
+            }
+
+            // the message is moved into the queue - its body is not copied
+            // or straight to the message handler, if there is one
             void AddToIncomingMessageQueue() {
+#if OLC_NET_HAS_COROUTINES
+                if (m_bCoroutines) {
+                    m_qCoroIn.push_back(std::move(m_msgTemporaryIn));
+                    if (m_hReader) {
+                        asio::post(m_strand, [hReader = std::exchange(m_hReader, nullptr)]() { hReader.resume(); });
+                    }
+                    return;
+                }
+#endif
+                if (m_fnMessageHandler) {
+                    owned_message<T, H> msg{ m_nOwnerType == owner::server ? this->shared_from_this() : nullptr, std::move(m_msgTemporaryIn) };
+                    m_fnMessageHandler(msg);
+                    // the handler is done with the message, the body holds the next one
+                    m_bodyPool.release(std::move(msg.msg.body));
+                    return;
+                }
+
                 if (m_nOwnerType == owner::server) {
-                    m_qMessagesIn.push_back({ this->shared_from_this(), m_msgTemporaryIn });
+                    m_qMessagesIn.push_back({ this->shared_from_this(), std::move(m_msgTemporaryIn) });
                 } else {
                     // if the message comes from a client
                     // clients have only one connection so it is not relevant 
-                    m_qMessagesIn.push_back({ nullptr, m_msgTemporaryIn });
+                    m_qMessagesIn.push_back({ nullptr, std::move(m_msgTemporaryIn) });
                 }
-                // because we completely read a message (header and body at this point)
-                // we can read another message (starting with the header)
-                ReadHeader();
             }
 
         protected:
-            // Each connection has an unique socket to a remote
-            asio::ip::tcp::socket m_socket;
+            // Each connection has an unique socket to a remote (TCP, or a Unix domain socket)
+            stream_socket m_socket;
 
             // This context is shared with the whole asio instance
             asio::io_context& m_asioContext;
 
+            // The context can be run by a pool of threads. Every handler of this
+            // connection is dispatched through its strand, so they never overlap
+            // and the connection state below needs no extra locking
+            // Every handler holds the connection (self = shared_from_this), so it lives until
+            // the last of them has run, even once its owner has let it go
+            asio::strand<asio::io_context::executor_type> m_strand;
+
             // This queue holds all messages to be sent to the remote side
             // of this connection
-            tsqueue<message<T>> m_qMessagesOut;
+            // It is only used from inside the strand, so it doesn't need to be thread safe
+            std::deque<outgoing_message<T>> m_qMessagesOut;
+
+            // Codec of the bodies we send, from which size, and the codecs the remote side
+            // can decompress (a bit per codec_id, 0 until it tells us)
+            codec_id m_nCodec = codec_id::none;
+            size_t m_nCompressThreshold = 0;
+            uint32_t m_nPeerCodecs = 0;
+
+            // Bytes (headers and bodies) of the messages in m_qMessagesOut, and how many control
+            // frames are in it - the limits leave the control frames out
+            size_t m_nQueuedBytes = 0;
+            size_t m_nControlQueued = 0;
+
+            // How big m_qMessagesOut may grow, and who is told when it gets full
+            send_queue_limits m_limits;
+            std::function<void(std::shared_ptr<connection<T, H>>, backpressure_event)> m_fnBackpressure;
+            bool m_bAboveHighWater = false;
+            bool m_bLimitReported = false;
+
+            // The buffers of the write in progress, the encoded headers they point to, and how
+            // many messages from the front of m_qMessagesOut they belong to
+            std::vector<asio::const_buffer> m_vWriteBuffers;
+            std::vector<uint8_t> m_vWriteHeaders;
+            // where asio makes the operations of the write and the read in progress
+            handler_memory m_writeMemory;
+            handler_memory m_readMemory;
+            size_t m_nMessagesInFlight = 0;
+
+            // Limits of a single write - 64 buffers is also what asio passes to one writev call
+            size_t m_nMaxWriteBytes = 64 * 1024;
+            size_t m_nMaxWriteBuffers = 64;
+            // Between Cork and Flush, the queued messages are not written
+            bool m_bCorked = false;
+            // Nor before Begin: a server's OnClientConnect can Send before the connection
+            // knows its transport (shared memory rings, io_uring)
+            bool m_bStarted = false;
+
+            // Set on the socket when it is connected
+            socket_options m_socketOptions;
+
+            // The datagram channel of the unreliable messages (nullptr if there is none):
+            // the socket of the owner, where to send, and whether the remote side can be reached
+            // (the server waits for the hello of the client, the client for the offer)
+            datagram_socket* m_pDatagrams = nullptr;
+            asio::ip::udp::endpoint m_udpRemote;
+            bool m_bDatagramReady = false;
+            // what the server gave the client, in front of every datagram of both sides
+            uint32_t m_nDatagramID = 0;
+            uint32_t m_nDatagramToken = 0;
+            // the last sequence number sent, and the newest received
+            uint32_t m_nDatagramSequenceOut = 0;
+            uint32_t m_nDatagramSequenceIn = 0;
+            // the hellos of the client, 100 ms apart, until the server answers
+            static constexpr int nMaxHellos = 50;
+            int m_nHellos = 0;
+            bool m_bHelloAnswered = false;
+            asio::steady_timer m_helloTimer{ m_asioContext };
 
             // This queue holds all messages that have been recieved from
             // the remote side of this connection. 
             // It is a reference as the "owner" of this connection is expected to 
             // provide a queue
-            tsqueue<owned_message<T>>& m_qMessagesIn;
+            incoming_queue<owned_message<T, H>>& m_qMessagesIn;
             message<T> m_msgTemporaryIn;
+            // In dispatch_mode::direct, the messages are given to this function instead
+            std::function<void(owned_message<T, H>&)> m_fnMessageHandler;
+            // Told when ConnectToServer is done
+            std::function<void(std::error_code)> m_fnConnectHandler;
+
+            // Over shared memory (transport::shm): the rings, and the name of them the client
+            // sent. The socket only carries wake ups then, read into m_vDoorbell
+            bool m_bSharedMemory = false;
+            std::unique_ptr<shm_channel> m_pRings;
+            shm_hello m_ringHello;
+            std::vector<uint8_t> m_vDoorbell = std::vector<uint8_t>(64);
+            // how long the ring is looked at once empty, before the connection goes to sleep
+            // (a reply that comes within it doesn't cost a system call on either side)
+            // On a single core it would only keep the other side from running, so it is 0 there
+            std::chrono::steady_clock::duration m_tRingSpin = std::thread::hardware_concurrency() > 1 ?
+                std::chrono::steady_clock::duration(std::chrono::microseconds(50)) : std::chrono::steady_clock::duration::zero();
+            std::chrono::steady_clock::time_point m_tRingActive;
+            // where the write in progress is in m_vWriteBuffers, and whether it waits for room
+            size_t m_nRingBuffer = 0;
+            size_t m_nRingOffset = 0;
+            size_t m_nRingWritten = 0;
+            bool m_bRingWriteWaiting = false;
+
+            // With io_uring (see net_uring.hpp): the engine, the key of this connection in it,
+            // whether a receive is in the ring, and how much of the write in progress is written
+            std::shared_ptr<uring_engine> m_pUring;
+            uint64_t m_nUringKey = 0;
+            bool m_bUringReceiving = false;
+            size_t m_nUringWritten = 0;
+            size_t m_nUringToWrite = 0;
+
+            // Messages ever added to m_qMessagesOut - minus the ones still in it, it is how
+            // many have left it (what a send_awaitable waits for)
+            uint64_t m_nMessagesQueued = 0;
+
+#if OLC_NET_HAS_COROUTINES
+            // With dispatch_mode::coroutine: the messages received that ReadMessage has not
+            // taken yet, the coroutine waiting in ReadMessage, and the ones waiting for a Send
+            struct send_waiter {
+                uint64_t nTarget;
+                std::coroutine_handle<> hWaiter;
+                bool* pbOpen;
+            };
+            bool m_bCoroutines = false;
+            bool m_bCoroClosed = false;
+            std::deque<message<T>> m_qCoroIn;
+            std::coroutine_handle<> m_hReader;
+            std::deque<send_waiter> m_qSendWaiters;
+#endif
+
+            // Storage for the bodies of received messages
+            body_pool m_bodyPool;
+
+            // Receive buffer - bytes between m_nReadStart and m_nReadEnd have been
+            // received but not parsed yet (the start of a message that is not complete)
+            // It grows when a message doesn't fit in it
+            std::vector<uint8_t> m_vReadBuffer = std::vector<uint8_t>(8 * 1024);
+            size_t m_nReadStart = 0;
+            size_t m_nReadEnd = 0;
+
 
+            // What went in and out of this connection
+            connection_counters m_counters;
 
             // The owner decides how some of the connection behaves
             owner m_nOwnerType = owner::server;
@@ -0,0 +1,280 @@
+#pragma once
+#include "net_common.hpp"
+#include "net_log.hpp"
+
+// The awaitable API (ReadMessage, Send, Accept, task) needs C++20 coroutines - with an
+// older standard the framework is the same, without it
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define OLC_NET_HAS_COROUTINES 1
+#endif
+#endif
+#ifndef OLC_NET_HAS_COROUTINES
+#define OLC_NET_HAS_COROUTINES 0
+#endif
+
+#if OLC_NET_HAS_COROUTINES
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+namespace olc {
+
+    namespace net {
+
+        // Recycles the frames of coroutines (task)
+        // A frame is a heap allocation, made every time a coroutine is called. The frames that
+        // are freed are kept, on a list per thread and per size (in steps of 64 bytes), and the
+        // next coroutine of that size takes one back: a helper coroutine called for every
+        // message (e.g. a request that waits for its reply) doesn't allocate once it has run
+        // A frame freed by another thread than the one that made it just joins the list of
+        // that thread. Frames over 4 KiB are not kept
+        class frame_pool {
+        public:
+            static void* Allocate(size_t nSize) {
+                size_t nClass = SizeClass(nSize);
+                if (nClass < nClasses) {
+                    auto& vFree = Lists().vFree[nClass];
+                    if (!vFree.empty()) {
+                        void* p = vFree.back();
+                        vFree.pop_back();
+                        return p;
+                    }
+                    return ::operator new((nClass + 1) * nStep);
+                }
+                return ::operator new(nSize);
+            }
+
+            static void Release(void* p, size_t nSize) {
+                size_t nClass = SizeClass(nSize);
+                if (nClass < nClasses) {
+                    auto& vFree = Lists().vFree[nClass];
+                    if (vFree.size() < nMaxPerClass) {
+                        vFree.push_back(p);
+                        return;
+                    }
+                }
+                ::operator delete(p);
+            }
+
+        private:
+            static constexpr size_t nStep = 64;
+            static constexpr size_t nClasses = 64;
+            static constexpr size_t nMaxPerClass = 256;
+
+            static size_t SizeClass(size_t nSize) {
+                return (nSize + nStep - 1) / nStep - 1;
+            }
+
+            struct lists {
+                std::vector<void*> vFree[nClasses];
+
+                ~lists() {
+                    for (auto& vList : vFree) {
+                        for (void* p : vList) {
+                            ::operator delete(p);
+                        }
+                    }
+                }
+            };
+
+            static lists& Lists() {
+                static thread_local lists l;
+                return l;
+            }
+        };
+
+        template <typename R>
+        class task;
+
+        namespace detail {
+
+            // What every task has: who to resume when it is done, and what it threw
+            struct task_promise_base {
+                std::coroutine_handle<> continuation;
+                std::exception_ptr exception;
+                // started by Spawn: nobody waits for it, it frees itself when done
+                bool bDetached = false;
+
+                // a task starts when it is awaited (or spawned), not when it is called
+                std::suspend_always initial_suspend() noexcept {
+                    return {};
+                }
+
+                struct final_awaiter {
+                    bool await_ready() noexcept {
+                        return false;
+                    }
+
+                    // the coroutine that awaited the task goes on right away, on this thread
+                    template <typename P>
+                    std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+                        task_promise_base& promise = h.promise();
+                        if (promise.continuation) {
+                            return promise.continuation;
+                        }
+                        if (promise.bDetached) {
+                            if (promise.exception) {
+                                LogException(promise.exception);
+                            }
+                            h.destroy();
+                        }
+                        return std::noop_coroutine();
+                    }
+
+                    void await_resume() noexcept {}
+                };
+
+                final_awaiter final_suspend() noexcept {
+                    return {};
+                }
+
+                void unhandled_exception() {
+                    exception = std::current_exception();
+                }
+
+                static void* operator new(size_t nSize) {
+                    return frame_pool::Allocate(nSize);
+                }
+
+                static void operator delete(void* p, size_t nSize) {
+                    frame_pool::Release(p, nSize);
+                }
+
+                // an exception nobody waited for
+                static void LogException(std::exception_ptr exception) {
+                    try {
+                        std::rethrow_exception(exception);
+                    } catch (std::exception& e) {
+                        OLC_NET_LOG_ERROR("[TASK] Exception: ", e.what());
+                    } catch (...) {
+                        OLC_NET_LOG_ERROR("[TASK] Unknown exception.");
+                    }
+                }
+            };
+
+            template <typename R>
+            struct task_promise : task_promise_base {
+                std::optional<R> value;
+
+                task<R> get_return_object();
+
+                template <typename V>
+                void return_value(V&& v) {
+                    value.emplace(std::forward<V>(v));
+                }
+
+                R result() {
+                    if (exception) {
+                        std::rethrow_exception(exception);
+                    }
+                    return std::move(*value);
+                }
+            };
+
+            template <>
+            struct task_promise<void> : task_promise_base {
+                task<void> get_return_object();
+
+                void return_void() {}
+
+                void result() {
+                    if (exception) {
+                        std::rethrow_exception(exception);
+                    }
+                }
+            };
+        }
+
+        // A coroutine that can be awaited, and returns an R
+        // It starts when it is awaited, and the coroutine that awaits it goes on as soon as it
+        // returns, on the same thread - no post and no allocation in between (its frame comes
+        // from the frame_pool). What it throws is thrown again by the co_await
+        //
+        // e.g. a request that waits for its reply, written as a straight line:
+        //
+        //   olc::net::task<std::optional<message<T>>> Request(connection<T>& conn, message<T> msg) {
+        //       co_await conn.Send(std::move(msg));
+        //       co_return co_await conn.ReadMessage();
+        //   }
+        //
+        // A task that nobody awaits (a session, an accept loop) is started with Spawn
+        template <typename R = void>
+        class [[nodiscard]] task {
+        public:
+            using promise_type = detail::task_promise<R>;
+            using handle_type = std::coroutine_handle<promise_type>;
+
+            explicit task(handle_type h) : m_handle(h) {}
+
+            task(task&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+
+            task& operator=(task&& other) noexcept {
+                if (this != &other) {
+                    if (m_handle) {
+                        m_handle.destroy();
+                    }
+                    m_handle = std::exchange(other.m_handle, nullptr);
+                }
+                return *this;
+            }
+
+            task(const task&) = delete;
+
+            ~task() {
+                if (m_handle) {
+                    m_handle.destroy();
+                }
+            }
+
+            bool await_ready() const noexcept {
+                return !m_handle;
+            }
+
+            // the task runs now, and resumes the caller when it is done
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> hCaller) noexcept {
+                m_handle.promise().continuation = hCaller;
+                return m_handle;
+            }
+
+            R await_resume() {
+                return m_handle.promise().result();
+            }
+
+            // gives up the coroutine (for Spawn)
+            handle_type Release() {
+                return std::exchange(m_handle, nullptr);
+            }
+
+        private:
+            handle_type m_handle;
+        };
+
+        namespace detail {
+            template <typename R>
+            task<R> task_promise<R>::get_return_object() {
+                return task<R>(std::coroutine_handle<task_promise<R>>::from_promise(*this));
+            }
+
+            inline task<void> task_promise<void>::get_return_object() {
+                return task<void>(std::coroutine_handle<task_promise<void>>::from_promise(*this));
+            }
+        }
+
+        // Starts a task that nobody waits for, on an executor (the strand of a connection, an
+        // io_context...) - it frees itself when it is done, and what it throws is logged
+        // It runs through the executor until it first waits: a session of a connection
+        // spawned on the strand of that connection never runs at the same time as the
+        // connection's own handlers
+        template <typename Executor>
+        void Spawn(const Executor& executor, task<void> t) {
+            auto h = t.Release();
+            if (!h) {
+                return;
+            }
+            h.promise().bDetached = true;
+            asio::post(executor, [h]() { h.resume(); });
+        }
+    }
+}
+#endif
@@ -0,0 +1,159 @@
+#pragma once
+#include "net_common.hpp"
+#include "net_pool.hpp"
+#include "net_log.hpp"
+#include <random>
+
+namespace olc {
+
+    namespace net {
+
+        // How the messages of a type travel (see SetDelivery on the server and the client)
+        enum class delivery {
+            // over the TCP connection: in order, never lost (the default)
+            reliable,
+            // in a datagram of their own: a lost or late one is gone, but it never holds up
+            // the messages behind it, as a lost TCP segment does (e.g. position updates, where
+            // only the latest one matters). They still go over TCP until the datagram channel
+            // of the connection is set up, and when they don't fit in a datagram
+            unreliable
+        };
+
+        // What is in front of every datagram: the connection it belongs to (its ID on the
+        // server, and the token the server gave it over TCP, so another host can't send in
+        // its name) and a sequence number, which only goes up
+        // The message follows, with the same framing as on TCP (header, then body)
+        // A datagram with sequence number 0 has no message: it is a hello, that tells the
+        // server where the datagrams of that client come from
+        struct datagram_header {
+            uint32_t nID = 0;
+            uint32_t nToken = 0;
+            uint32_t nSequence = 0;
+        };
+
+        // A UDP socket - the server has one for all of its clients, a client one for itself
+        //
+        // A socket can't be used by two threads at once, so everything it does goes through
+        // a strand of its own. A send is never waited for: the socket doesn't block, and a
+        // datagram that can't be sent at once is dropped (it is unreliable anyway)
+        class datagram_socket {
+        public:
+            using endpoint = asio::ip::udp::endpoint;
+
+            // the biggest datagram sent - the largest UDP payload that fits a typical 1500 byte
+            // path without IP fragmentation, with room to spare for tunnels
+            static constexpr size_t nDefaultMaxDatagram = 1200;
+
+            datagram_socket(asio::io_context& asioContext)
+                : m_socket(asioContext), m_strand(asio::make_strand(asioContext)), m_rng(std::random_device{}()) {
+
+            }
+
+            // Opens the socket on a local port (0 lets the system choose one)
+            bool Open(uint16_t nPort) {
+                asio::error_code ec;
+                m_socket.open(asio::ip::udp::v4(), ec);
+                if (!ec) {
+                    m_socket.bind(endpoint(asio::ip::udp::v4(), nPort), ec);
+                }
+                if (!ec) {
+                    m_socket.non_blocking(true, ec);
+                }
+                if (!ec) {
+                    m_nPort = m_socket.local_endpoint(ec).port();
+                }
+                if (ec) {
+                    OLC_NET_LOG_ERROR("[UDP] Can not open a socket on port ", nPort, ": ", ec.message());
+                    return false;
+                }
+                return true;
+            }
+
+            // Starts receiving - fnHandler is called with every datagram, from inside the strand
+            // (the bytes are only valid during the call)
+            void Start(std::function<void(const endpoint&, const uint8_t*, size_t)> fnHandler) {
+                asio::post(m_strand, [this, fnHandler = std::move(fnHandler)]() mutable {
+                    m_fnReceive = std::move(fnHandler);
+                    Receive();
+                });
+            }
+
+            uint16_t GetPort() const {
+                return m_nPort;
+            }
+
+            // A buffer to build a datagram in - can be called from any thread
+            std::vector<uint8_t> Acquire() {
+                return m_bufferPool.acquire();
+            }
+
+            // Sends a datagram built in a buffer from Acquire - can be called from any thread
+            void Send(const endpoint& remote, std::vector<uint8_t>&& vDatagram) {
+                asio::post(m_strand, [this, remote, vDatagram = std::move(vDatagram)]() mutable {
+                    if (m_dLoss > 0.0 && std::uniform_real_distribution<double>(0.0, 1.0)(m_rng) < m_dLoss) {
+                        m_nLost.fetch_add(1, std::memory_order_relaxed);
+                    } else {
+                        asio::error_code ec;
+                        m_socket.send_to(asio::buffer(vDatagram), remote, 0, ec);
+                        if (ec) {
+                            m_nSendErrors.fetch_add(1, std::memory_order_relaxed);
+                        }
+                    }
+                    m_bufferPool.release(std::move(vDatagram));
+                });
+            }
+
+            // Drops this fraction (0 to 1) of the datagrams sent, at random - to see how an
+            // application copes with a lossy network, over loopback
+            void SetLoss(double dLoss) {
+                asio::post(m_strand, [this, dLoss]() {
+                    m_dLoss = dLoss;
+                });
+            }
+
+            // datagrams dropped by SetLoss, and the ones the system refused to send
+            uint64_t GetLost() const {
+                return m_nLost.load(std::memory_order_relaxed);
+            }
+
+            uint64_t GetSendErrors() const {
+                return m_nSendErrors.load(std::memory_order_relaxed);
+            }
+
+        private:
+            // ASYNC - waits for the next datagram
+            void Receive() {
+                m_socket.async_receive_from(asio::buffer(m_vReceiveBuffer), m_remote,
+                    asio::bind_executor(m_strand, [this](std::error_code ec, std::size_t length) {
+                        if (!m_socket.is_open()) {
+                            return;
+                        }
+                        // an error on a UDP socket (e.g. an ICMP port unreachable from a
+                        // client that went away) doesn't stop it from receiving the others
+                        if (!ec && m_fnReceive) {
+                            m_fnReceive(m_remote, m_vReceiveBuffer.data(), length);
+                        }
+                        Receive();
+                    }));
+            }
+
+        private:
+            asio::ip::udp::socket m_socket;
+            asio::strand<asio::io_context::executor_type> m_strand;
+            uint16_t m_nPort = 0;
+
+            std::function<void(const endpoint&, const uint8_t*, size_t)> m_fnReceive;
+            std::vector<uint8_t> m_vReceiveBuffer = std::vector<uint8_t>(64 * 1024);
+            endpoint m_remote;
+
+            // the buffers of the datagrams, reused once they are sent
+            body_pool m_bufferPool;
+
+            // induced loss (only used inside the strand)
+            double m_dLoss = 0.0;
+            std::mt19937 m_rng;
+            std::atomic<uint64_t> m_nLost = 0;
+            std::atomic<uint64_t> m_nSendErrors = 0;
+        };
+    }
+}
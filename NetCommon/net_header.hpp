@@ -0,0 +1,185 @@
+#pragma once
+#include "net_common.hpp"
+
+namespace olc {
+    namespace net {
+        // Message header is sent at start of all messages. The template allows us
+        // to use "enum class" to ensure that messages are valid at compile time
+
+        template <typename T>
+        struct message_header {
+            T id{};
+            uint32_t size = 0;
+
+        };
+
+        // The two highest bits of message_header::size belong to the connection, the rest is
+        // the size of the body (so a body can't be bigger than 1 GiB). OnMessage never sees them
+        namespace header_flags {
+            // the body is compressed (see net_codec.hpp)
+            inline constexpr uint32_t compressed = 0x80000000u;
+            // a message between the two connections themselves, e.g. to tell the other
+            // side which codecs they can decompress
+            inline constexpr uint32_t control = 0x40000000u;
+            inline constexpr uint32_t size_mask = 0x3FFFFFFFu;
+        }
+
+        // How a message_header is written on the socket is a policy of the connection
+        // (connection<T, H>, server_interface<T, H>, client_interface<T, H>) - both sides
+        // must use the same one. A header format is a class with these static functions:
+        //
+        //   max_size<T>()          the most bytes a header can take
+        //   size(header)           the bytes this header takes
+        //   encode(header, p)      writes the header at p, returns the bytes written
+        //   decode(p, n, header)   reads a header from the n bytes at p, returns the bytes read,
+        //                          0 if more bytes are needed, or header_invalid if they can't
+        //                          be a header (the connection is closed then)
+        //
+        // The flags of message_header::size must go through encode/decode unchanged
+        inline constexpr size_t header_invalid = ~size_t(0);
+
+        // The header as it is in memory: the id as a T and the size as a uint32_t
+        // (8 bytes for an enum of uint32_t) - it is the default format
+        struct fixed_header {
+            template <typename T>
+            static constexpr size_t max_size() {
+                return sizeof(message_header<T>);
+            }
+
+            template <typename T>
+            static size_t size(const message_header<T>&) {
+                return sizeof(message_header<T>);
+            }
+
+            template <typename T>
+            static size_t encode(const message_header<T>& header, uint8_t* p) {
+                std::memcpy(p, &header, sizeof(message_header<T>));
+                return sizeof(message_header<T>);
+            }
+
+            template <typename T>
+            static size_t decode(const uint8_t* p, size_t n, message_header<T>& header) {
+                if (n < sizeof(message_header<T>)) {
+                    return 0;
+                }
+                std::memcpy(&header, p, sizeof(message_header<T>));
+                return sizeof(message_header<T>);
+            }
+        };
+
+        // The id and the size as varints (7 bits per byte, the high bit says that another
+        // byte follows), with the two flags of the size in its lowest bits
+        // A message with an id under 128 and a body under 32 bytes has a 2 byte header,
+        // 3 bytes up to 8 KiB - instead of the 8 bytes of fixed_header
+        struct varint_header {
+            // the id as an unsigned integer of the same size (T can be an enum or an integer)
+            template <typename T, bool = std::is_enum<T>::value>
+            struct id_value {
+                using type = std::make_unsigned_t<std::underlying_type_t<T>>;
+            };
+
+            template <typename T>
+            struct id_value<T, false> {
+                using type = std::make_unsigned_t<T>;
+            };
+
+            template <typename T>
+            using id_type = typename id_value<T>::type;
+
+            template <typename T>
+            static constexpr size_t max_size() {
+                return MaxVarintSize(sizeof(id_type<T>) * 8) + MaxVarintSize(32);
+            }
+
+            template <typename T>
+            static size_t size(const message_header<T>& header) {
+                return VarintSize(static_cast<id_type<T>>(header.id)) + VarintSize(PackSize(header.size));
+            }
+
+            template <typename T>
+            static size_t encode(const message_header<T>& header, uint8_t* p) {
+                uint8_t* op = WriteVarint(p, static_cast<id_type<T>>(header.id));
+                op = WriteVarint(op, PackSize(header.size));
+                return size_t(op - p);
+            }
+
+            template <typename T>
+            static size_t decode(const uint8_t* p, size_t n, message_header<T>& header) {
+                uint64_t nId = 0;
+                size_t nIdBytes = ReadVarint(p, n, MaxVarintSize(sizeof(id_type<T>) * 8), nId);
+                if (nIdBytes == 0 || nIdBytes == header_invalid) {
+                    return nIdBytes;
+                }
+
+                uint64_t nSize = 0;
+                size_t nSizeBytes = ReadVarint(p + nIdBytes, n - nIdBytes, MaxVarintSize(32), nSize);
+                if (nSizeBytes == 0 || nSizeBytes == header_invalid) {
+                    return nSizeBytes;
+                }
+
+                if (nId > std::numeric_limits<id_type<T>>::max() || nSize > std::numeric_limits<uint32_t>::max()) {
+                    return header_invalid;
+                }
+                header.id = static_cast<T>(static_cast<id_type<T>>(nId));
+                header.size = UnpackSize(uint32_t(nSize));
+                return nIdBytes + nSizeBytes;
+            }
+
+        private:
+            static constexpr size_t MaxVarintSize(size_t nBits) {
+                return (nBits + 6) / 7;
+            }
+
+            static size_t VarintSize(uint64_t nValue) {
+                size_t n = 1;
+                while (nValue >= 0x80) {
+                    nValue >>= 7;
+                    n++;
+                }
+                return n;
+            }
+
+            // the size goes up by 2 bits, the flags take the bits at the bottom
+            static uint32_t PackSize(uint32_t nSize) {
+                return ((nSize & header_flags::size_mask) << 2)
+                    | ((nSize & header_flags::compressed) ? 1u : 0u)
+                    | ((nSize & header_flags::control) ? 2u : 0u);
+            }
+
+            static uint32_t UnpackSize(uint32_t nPacked) {
+                return (nPacked >> 2)
+                    | ((nPacked & 1u) ? header_flags::compressed : 0u)
+                    | ((nPacked & 2u) ? header_flags::control : 0u);
+            }
+
+            static uint8_t* WriteVarint(uint8_t* op, uint64_t nValue) {
+                while (nValue >= 0x80) {
+                    *op++ = uint8_t(nValue) | 0x80;
+                    nValue >>= 7;
+                }
+                *op++ = uint8_t(nValue);
+                return op;
+            }
+
+            // returns the bytes read, 0 if the varint is not complete yet, or header_invalid
+            // if it is longer than nMaxBytes (or has bits that don't fit in 64)
+            static size_t ReadVarint(const uint8_t* p, size_t n, size_t nMaxBytes, uint64_t& nValue) {
+                nValue = 0;
+                for (size_t i = 0; i < nMaxBytes; i++) {
+                    if (i == n) {
+                        return 0;
+                    }
+                    uint64_t nBits = p[i] & 0x7F;
+                    if (i * 7 + 7 > 64 && (nBits >> (64 - i * 7)) != 0) {
+                        return header_invalid;
+                    }
+                    nValue |= nBits << (i * 7);
+                    if (!(p[i] & 0x80)) {
+                        return i + 1;
+                    }
+                }
+                return header_invalid;
+            }
+        };
+    }
+}
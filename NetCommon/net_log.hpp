@@ -0,0 +1,262 @@
+#pragma once
+#include "net_common.hpp"
+#include <charconv>
+#include <sstream>
+#include <type_traits>
+
+// Levels of the log messages of the library
+// Define OLC_NET_LOG_LEVEL before including olc_net.hpp to choose which ones are kept,
+// e.g. #define OLC_NET_LOG_LEVEL OLC_NET_LOG_LEVEL_TRACE to see every message read.
+// The messages below that level are removed by the preprocessor - their arguments
+// are not even evaluated
+#define OLC_NET_LOG_LEVEL_TRACE   0
+#define OLC_NET_LOG_LEVEL_DEBUG   1
+#define OLC_NET_LOG_LEVEL_INFO    2
+#define OLC_NET_LOG_LEVEL_WARNING 3
+#define OLC_NET_LOG_LEVEL_ERROR   4
+#define OLC_NET_LOG_LEVEL_NONE    5
+
+#ifndef OLC_NET_LOG_LEVEL
+#define OLC_NET_LOG_LEVEL OLC_NET_LOG_LEVEL_INFO
+#endif
+
+namespace olc {
+
+    namespace net {
+
+        enum class log_level : uint8_t {
+            trace,
+            debug,
+            info,
+            warning,
+            error
+        };
+
+        // A log message, already turned into text by the thread that logged it
+        // Fixed size, so putting it in the ring never allocates; longer messages are cut
+        struct log_record {
+            static constexpr size_t nMaxText = 240;
+
+            log_level level = log_level::info;
+            uint16_t nLength = 0;
+            char text[nMaxText];
+
+            void append(std::string_view s) {
+                size_t n = std::min(s.size(), nMaxText - nLength);
+                std::memcpy(text + nLength, s.data(), n);
+                nLength += uint16_t(n);
+            }
+
+            template <typename A>
+            void append_value(const A& value) {
+                if constexpr (std::is_same_v<A, bool>) {
+                    append(value ? "true" : "false");
+                } else if constexpr (std::is_same_v<A, char>) {
+                    append(std::string_view(&value, 1));
+                } else if constexpr (std::is_enum_v<A>) {
+                    // enums (like the message ids) are written as their number
+                    append_value(static_cast<std::underlying_type_t<A>>(value));
+                } else if constexpr (std::is_integral_v<A>) {
+                    char buf[24];
+                    auto res = std::to_chars(buf, buf + sizeof(buf), value);
+                    append(std::string_view(buf, size_t(res.ptr - buf)));
+                } else if constexpr (std::is_floating_point_v<A>) {
+                    char buf[32];
+                    int n = std::snprintf(buf, sizeof(buf), "%g", double(value));
+                    append(std::string_view(buf, size_t(std::max(n, 0))));
+                } else if constexpr (std::is_convertible_v<const A&, std::string_view>) {
+                    append(std::string_view(value));
+                } else {
+                    // anything else that can be streamed (endpoints, addresses...)
+                    // this one allocates, but it is only used by the rare messages
+                    std::ostringstream os;
+                    os << value;
+                    append(os.str());
+                }
+            }
+        };
+
+        // The log of the library
+        // Logging a message only formats it into a log_record and puts it into a ring;
+        // a background thread takes the records out and writes them to std::cout
+        // (std::cerr for errors). The threads running asio never wait for the console
+        //
+        // The ring is a bounded lock free queue for many producers and one consumer:
+        // each cell has a sequence number that tells whether it is free to be written
+        // or ready to be read. When the ring is full the message is dropped (and counted),
+        // a slow console must never block the network
+        class logger {
+        public:
+            static constexpr size_t nRingSize = 1024; // must be a power of 2
+
+            static logger& Get() {
+                static logger instance;
+                return instance;
+            }
+
+            logger(const logger&) = delete;
+
+            ~logger() {
+                // the writer empties the ring before it leaves
+                {
+                    std::scoped_lock lock(muxBlocking);
+                    bStop = true;
+                }
+                cvBlocking.notify_one();
+                if (m_thrWriter.joinable()) {
+                    m_thrWriter.join();
+                }
+            }
+
+            template <typename... Args>
+            void Write(log_level level, const Args&... args) {
+                log_record record;
+                record.level = level;
+                (record.append_value(args), ...);
+                Push(record);
+            }
+
+            // number of messages lost because the ring was full
+            uint64_t Dropped() const {
+                return m_nDropped.load(std::memory_order_relaxed);
+            }
+
+        private:
+            logger() {
+                for (size_t i = 0; i < nRingSize; i++) {
+                    m_cells[i].nSequence.store(i, std::memory_order_relaxed);
+                }
+                m_thrWriter = std::thread([this]() { Run(); });
+            }
+
+            void Push(const log_record& record) {
+                size_t nPos = m_nEnqueuePos.load(std::memory_order_relaxed);
+                cell* c;
+                for (;;) {
+                    c = &m_cells[nPos & (nRingSize - 1)];
+                    size_t nSeq = c->nSequence.load(std::memory_order_acquire);
+                    intptr_t nDiff = intptr_t(nSeq) - intptr_t(nPos);
+                    if (nDiff == 0) {
+                        // the cell is free - try to claim it
+                        if (m_nEnqueuePos.compare_exchange_weak(nPos, nPos + 1, std::memory_order_relaxed)) {
+                            break;
+                        }
+                    } else if (nDiff < 0) {
+                        // the writer has not read this cell yet, the ring is full
+                        m_nDropped.fetch_add(1, std::memory_order_relaxed);
+                        return;
+                    } else {
+                        // another producer took it
+                        nPos = m_nEnqueuePos.load(std::memory_order_relaxed);
+                    }
+                }
+
+                std::memcpy(&c->record, &record, offsetof(log_record, text) + record.nLength);
+                // sequentially consistent, like the load of bParked below (see mpscqueue::link)
+                c->nSequence.store(nPos + 1);
+
+                if (bParked.load()) {
+                    std::scoped_lock lock(muxBlocking);
+                    cvBlocking.notify_one();
+                }
+            }
+
+            // only called by the writer thread
+            bool Ready() {
+                return m_cells[m_nDequeuePos & (nRingSize - 1)].nSequence.load() == m_nDequeuePos + 1;
+            }
+
+            void Run() {
+                uint64_t nReportedDrops = 0;
+                for (;;) {
+                    bool bWritten = false;
+                    while (Ready()) {
+                        cell& c = m_cells[m_nDequeuePos & (nRingSize - 1)];
+                        std::ostream& os = c.record.level == log_level::error ? std::cerr : std::cout;
+                        os.write(c.record.text, c.record.nLength);
+                        os.put('\n');
+
+                        // give the cell back to the producers, one lap later
+                        c.nSequence.store(m_nDequeuePos + nRingSize, std::memory_order_release);
+                        m_nDequeuePos++;
+                        bWritten = true;
+                    }
+
+                    uint64_t nDropped = Dropped();
+                    if (nDropped != nReportedDrops) {
+                        std::cout << "[LOG] " << (nDropped - nReportedDrops) << " message(s) dropped\n";
+                        nReportedDrops = nDropped;
+                        bWritten = true;
+                    }
+
+                    if (bWritten) {
+                        std::cout.flush();
+                        continue;
+                    }
+
+                    // nothing to write - sleep until a producer wakes us up
+                    std::unique_lock<std::mutex> ul(muxBlocking);
+                    bParked.store(true);
+                    while (!Ready() && !bStop) {
+                        cvBlocking.wait(ul);
+                    }
+                    bParked.store(false);
+                    if (bStop && !Ready()) {
+                        return;
+                    }
+                }
+            }
+
+        private:
+            struct cell {
+                std::atomic<size_t> nSequence;
+                log_record record;
+            };
+
+            // producers share the enqueue position, the writer owns the dequeue one
+            alignas(64) std::atomic<size_t> m_nEnqueuePos = 0;
+            alignas(64) size_t m_nDequeuePos = 0;
+            std::atomic<uint64_t> m_nDropped = 0;
+            cell m_cells[nRingSize];
+
+            std::thread m_thrWriter;
+
+            // only used when the writer has nothing to do
+            std::atomic<bool> bParked = false;
+            bool bStop = false;
+            std::condition_variable cvBlocking;
+            std::mutex muxBlocking;
+        };
+    }
+}
+
+// Log a message made of all the arguments, e.g. OLC_NET_LOG_INFO("[", nID, "] Connection Approved!")
+#if OLC_NET_LOG_LEVEL <= OLC_NET_LOG_LEVEL_TRACE
+#define OLC_NET_LOG_TRACE(...) ::olc::net::logger::Get().Write(::olc::net::log_level::trace, __VA_ARGS__)
+#else
+#define OLC_NET_LOG_TRACE(...) ((void)0)
+#endif
+
+#if OLC_NET_LOG_LEVEL <= OLC_NET_LOG_LEVEL_DEBUG
+#define OLC_NET_LOG_DEBUG(...) ::olc::net::logger::Get().Write(::olc::net::log_level::debug, __VA_ARGS__)
+#else
+#define OLC_NET_LOG_DEBUG(...) ((void)0)
+#endif
+
+#if OLC_NET_LOG_LEVEL <= OLC_NET_LOG_LEVEL_INFO
+#define OLC_NET_LOG_INFO(...) ::olc::net::logger::Get().Write(::olc::net::log_level::info, __VA_ARGS__)
+#else
+#define OLC_NET_LOG_INFO(...) ((void)0)
+#endif
+
+#if OLC_NET_LOG_LEVEL <= OLC_NET_LOG_LEVEL_WARNING
+#define OLC_NET_LOG_WARNING(...) ::olc::net::logger::Get().Write(::olc::net::log_level::warning, __VA_ARGS__)
+#else
+#define OLC_NET_LOG_WARNING(...) ((void)0)
+#endif
+
+#if OLC_NET_LOG_LEVEL <= OLC_NET_LOG_LEVEL_ERROR
+#define OLC_NET_LOG_ERROR(...) ::olc::net::logger::Get().Write(::olc::net::log_level::error, __VA_ARGS__)
+#else
+#define OLC_NET_LOG_ERROR(...) ((void)0)
+#endif
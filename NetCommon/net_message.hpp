@@ -1,18 +1,10 @@
 #pragma once
 #include "net_common.hpp"
+#include "net_codec.hpp"
+#include "net_header.hpp"
 
 namespace olc {
     namespace net {
-        // Message header is sent at start of all messages. The template allows us 
-        // to use "enum class" to ensure that messages are valid at compile time
-
-        template <typename T>
-        struct message_header {
-            T id{};
-            uint32_t size = 0;
-            
-        };
-
         template <typename T>
         struct message {
             message_header<T> header{};
@@ -57,6 +49,35 @@ namespace olc {
                 return msg;
             }
 
+            // Pushes a string into the message buffer: its length (uint32_t) followed by its characters
+            // it has to be read back with a message_view (front to back)
+            friend message<T>& operator << (message<T>& msg, const std::string& data) {
+                msg << uint32_t(data.size());
+
+                size_t i = msg.body.size();
+                msg.body.resize(msg.body.size() + data.size());
+                std::memcpy(msg.body.data() + i, data.data(), data.size());
+
+                msg.header.size = msg.size();
+                return msg;
+            }
+
+            // Pushes an array of POD-like data into the message buffer: the number of elements (uint32_t)
+            // followed by the elements - it has to be read back with a message_view (front to back)
+            template<typename DataType>
+            friend message<T>& operator << (message<T>& msg, const std::vector<DataType>& data) {
+                static_assert(std::is_standard_layout<DataType>::value, "Data is to complex to be pushed into vector!\n");
+
+                msg << uint32_t(data.size());
+
+                size_t i = msg.body.size();
+                msg.body.resize(msg.body.size() + data.size() * sizeof(DataType));
+                std::memcpy(msg.body.data() + i, data.data(), data.size() * sizeof(DataType));
+
+                msg.header.size = msg.size();
+                return msg;
+            }
+
             template<typename DataType> 
             friend message<T>& operator >> (message<T>& msg, DataType& data) {
 
@@ -81,22 +102,191 @@ namespace olc {
             }
         };
 
-        // need to declare connection class here -> so it can be used by owned_message
+        // Reads the body of a message from front to back, in the order the data was pushed
+        // Unlike operator >> on the message itself, nothing is removed from the body: the view
+        // just moves a cursor forward, so the message can be inspected without destroying it,
+        // and the view can also be put directly on top of a buffer the message was received in
+        //
+        // Every read checks that the body is long enough. If it isn't (a truncated or malformed
+        // message), nothing is read, the view is marked as failed and every later read fails too
+        // - check it like a stream: if (view >> a >> b) { ... }
         template <typename T>
-        class connection;
+        class message_view {
+        public:
+            message_view(const message<T>& msg)
+                : header(msg.header), m_pData(msg.body.data()), m_nSize(msg.body.size()) {
+
+            }
+
+            // the view points into the body, so it can't be put on a temporary message
+            message_view(const message<T>&&) = delete;
+
+            message_view(const message_header<T>& h, const uint8_t* pData, size_t nSize)
+                : header(h), m_pData(pData), m_nSize(nSize) {
+
+            }
 
+            // the header of the message being read
+            message_header<T> header{};
+
+        public:
+            // true while every read so far was successful
+            bool good() const {
+                return !m_bFail;
+            }
+
+            explicit operator bool() const {
+                return good();
+            }
+
+            // number of bytes not read yet
+            size_t remaining() const {
+                return m_nSize - m_nPos;
+            }
+
+            // Returns a pointer to the next nBytes bytes of the body and moves past them
+            // (nullptr if there aren't that many) - the bytes are not copied
+            const uint8_t* read_bytes(size_t nBytes) {
+                if (m_bFail || nBytes > remaining()) {
+                    m_bFail = true;
+                    return nullptr;
+                }
+                const uint8_t* p = m_pData + m_nPos;
+                m_nPos += nBytes;
+                return p;
+            }
+
+            // Reads any POD-like data
+            template<typename DataType>
+            friend message_view<T>& operator >> (message_view<T>& view, DataType& data) {
+                static_assert(std::is_standard_layout<DataType>::value, "Data is to complex to be read from the message!\n");
+
+                if (const uint8_t* p = view.read_bytes(sizeof(DataType))) {
+                    std::memcpy(&data, p, sizeof(DataType));
+                }
+                return view;
+            }
+
+            // Reads a string pushed with operator << - the characters are copied into 'data'
+            friend message_view<T>& operator >> (message_view<T>& view, std::string& data) {
+                std::string_view sv;
+                if (view >> sv) {
+                    data.assign(sv.data(), sv.size());
+                }
+                return view;
+            }
+
+            // Reads a string pushed with operator << without copying it - 'data' points into the body,
+            // so it is only valid as long as the body is
+            friend message_view<T>& operator >> (message_view<T>& view, std::string_view& data) {
+                uint32_t nLength = 0;
+                if (view >> nLength) {
+                    if (const uint8_t* p = view.read_bytes(nLength)) {
+                        data = std::string_view(reinterpret_cast<const char*>(p), nLength);
+                    }
+                }
+                return view;
+            }
+
+            // Reads an array pushed with operator <<
+            template<typename DataType>
+            friend message_view<T>& operator >> (message_view<T>& view, std::vector<DataType>& data) {
+                static_assert(std::is_standard_layout<DataType>::value, "Data is to complex to be read from the message!\n");
+
+                uint32_t nCount = 0;
+                if (view >> nCount) {
+                    // the count is checked against what is left before anything is allocated
+                    if (const uint8_t* p = view.read_bytes(size_t(nCount) * sizeof(DataType))) {
+                        data.resize(nCount);
+                        std::memcpy(data.data(), p, size_t(nCount) * sizeof(DataType));
+                    }
+                }
+                return view;
+            }
+
+        private:
+            const uint8_t* m_pData = nullptr;
+            size_t m_nSize = 0;
+            size_t m_nPos = 0;
+            bool m_bFail = false;
+        };
+
+        // A message whose body is serialised once and then shared, read only, by
+        // every connection it is sent to (e.g. a broadcast to all clients)
+        // The connections only hold a reference to the body, which is freed when
+        // the last of them has written it
+        template <typename T>
+        struct shared_message {
+            message_header<T> header{};
+            std::shared_ptr<const std::vector<uint8_t>> body;
+
+            shared_message() = default;
+
+            // takes the body of the message (copy it, or move it in to avoid the copy)
+            explicit shared_message(message<T> msg)
+                : header(msg.header), body(std::make_shared<const std::vector<uint8_t>>(std::move(msg.body))) {
+
+            }
+
+            // The body compressed with a codec, if it is at least nThreshold bytes and it gets
+            // smaller - it is done once, and used for every connection whose remote side
+            // can decompress it
+            void pack(codec_id codec, size_t nThreshold) {
+                if (packed || !body || body->size() < nThreshold) {
+                    return;
+                }
+                std::vector<uint8_t> vPacked;
+                if (PackBody(codec, body->data(), body->size(), vPacked)) {
+                    packed = std::make_shared<const std::vector<uint8_t>>(std::move(vPacked));
+                    nCodec = codec;
+                }
+            }
+
+            // returns size of the body in bytes
+            size_t size() const {
+                return body ? body->size() : 0;
+            }
+
+            // the compressed body, if pack() made one
+            std::shared_ptr<const std::vector<uint8_t>> packed;
+            codec_id nCodec = codec_id::none;
+        };
+
+        // An entry of the outgoing queue of a connection - a message with a body
+        // of its own, or a message with a shared body
         template <typename T>
+        struct outgoing_message {
+            message<T> msg;
+            std::shared_ptr<const std::vector<uint8_t>> shared;
+
+            outgoing_message() = default;
+            outgoing_message(const message<T>& m) : msg(m) {}
+            outgoing_message(message<T>&& m) : msg(std::move(m)) {}
+            outgoing_message(const shared_message<T>& m) : shared(m.body) { msg.header = m.header; }
+
+            // the body that has to be written
+            const std::vector<uint8_t>& body() const {
+                return shared ? *shared : msg.body;
+            }
+        };
+
+        // need to declare connection class here -> so it can be used by owned_message
+        template <typename T, typename H>
+        class connection;
+
+        // H is the header format of the connection (see net_header.hpp)
+        template <typename T, typename H = fixed_header>
         struct owned_message {
             
             // tagged to a connection object via a shared pointer
-            std::shared_ptr<connection<T>> remote = nullptr;
+            std::shared_ptr<connection<T, H>> remote = nullptr;
             // incapsulates a regular message
             message<T> msg;
 
             // Override for std::cout compatibility
             // produces friendly description of messages
             // 'friend' as it should be available from every possible location
-            friend std::ostream& operator << (std::ostream& os, const owned_message<T>& msg) {
+            friend std::ostream& operator << (std::ostream& os, const owned_message<T, H>& msg) {
                 os << msg.msg;
                 return os;
             }
@@ -0,0 +1,221 @@
+#pragma once
+#include "net_common.hpp"
+#include "net_tsqueue.hpp"
+
+namespace olc {
+
+    namespace net {
+
+        // Lock free queue for many producers and a single consumer (MPSC)
+        // The incoming messages are pushed by the threads that run the asio context,
+        // and only one thread takes them out (Update on the server, the user's loop on the client)
+        // so the mutex of tsqueue is not needed - producers only swap a pointer
+        //
+        // It is a linked list of nodes: producers exchange the head and link the previous
+        // head to the new node, the consumer follows the links from the tail. The tail
+        // is always a "stub" node whose item was already taken (or never existed)
+        //
+        // The consumer doesn't delete the nodes it is done with, it puts them on a free list
+        // the producers take them from - once the queue has been as long as it gets, a push
+        // costs no allocation. Only one producer at a time takes a node from the list (a
+        // flag, never waited for: a producer that finds it taken allocates a node instead),
+        // so the list can't be changed under it by another one
+        //
+        // front(), pop_front(), empty(), clear(), drain(), wait() and wait_for() must only be called by the consumer
+        // push_back() and count() can be called from any thread
+        template<typename T>
+        class mpscqueue {
+        public:
+            mpscqueue() {
+                node* stub = new node();
+                m_pHead.store(stub, std::memory_order_relaxed);
+                m_pTail = stub;
+            }
+            // not allow the queue to be copied
+            mpscqueue(const mpscqueue<T>&) = delete;
+
+            virtual ~mpscqueue() {
+                clear();
+                delete m_pTail;
+                node* n = m_pFree.load();
+                while (n) {
+                    node* next = n->next.load(std::memory_order_relaxed);
+                    delete n;
+                    n = next;
+                }
+            }
+
+        public:
+            // Returns and maintains item at front of Queue
+            const T& front() {
+                return m_pTail->next.load(std::memory_order_acquire)->item;
+            }
+
+            // Removes and returns item from front of queue
+            T pop_front() {
+                node* tail = m_pTail;
+                node* next = tail->next.load(std::memory_order_acquire);
+
+                // the next node becomes the new stub once its item is taken
+                T item = std::move(next->item);
+                m_pTail = next;
+                release_node(tail);
+
+                m_nCount.fetch_sub(1, std::memory_order_relaxed);
+                return item;
+            }
+
+            // Adds an item to back of the Queue
+            void push_back(const T& item) {
+                node* n = acquire_node();
+                n->item = item;
+                link(n);
+            }
+
+            void push_back(T&& item) {
+                node* n = acquire_node();
+                n->item = std::move(item);
+                link(n);
+            }
+
+            // Returns true if the Queue is empty
+            bool empty() {
+                return m_pTail->next.load() == nullptr;
+            }
+
+            // Return number of items in Queue
+            size_t count() {
+                return m_nCount.load(std::memory_order_relaxed);
+            }
+
+            // Clears Queue
+            void clear() {
+                while (!empty()) {
+                    pop_front();
+                }
+            }
+
+            // Moves every item of the Queue to the back of 'out'
+            // Same interface as tsqueue::drain, so the server can take a whole batch
+            // of messages whichever queue it uses
+            size_t drain(std::deque<T>& out) {
+                size_t nCount = 0;
+                while (!empty()) {
+                    out.push_back(pop_front());
+                    nCount++;
+                }
+                return nCount;
+            }
+
+            // Blocks the consumer until there is something in the queue
+            void wait() {
+                if (!empty()) {
+                    return;
+                }
+
+                // tell the producers that we are going to sleep, only then do they
+                // have to pay for the mutex and the condition variable
+                std::unique_lock<std::mutex> ul(muxBlocking);
+                bParked.store(true);
+                while (empty()) {
+                    cvBlocking.wait(ul);
+                }
+                bParked.store(false);
+            }
+
+            // Same, for at most tTimeout - returns false if the queue is still empty
+            template <typename Rep, typename Period>
+            bool wait_for(const std::chrono::duration<Rep, Period>& tTimeout) {
+                if (!empty()) {
+                    return true;
+                }
+
+                std::unique_lock<std::mutex> ul(muxBlocking);
+                bParked.store(true);
+                bool bItems = cvBlocking.wait_for(ul, tTimeout, [this]() { return !empty(); });
+                bParked.store(false);
+                return bItems;
+            }
+
+        private:
+            struct node {
+                std::atomic<node*> next = nullptr;
+                T item{};
+            };
+
+            // A node from the free list (its item was moved out by the consumer), or a new one
+            node* acquire_node() {
+                if (!m_bFreeBusy.exchange(true, std::memory_order_acquire)) {
+                    // the consumer may push nodes meanwhile, but nobody else takes them -
+                    // the next of the node on top stays what we read
+                    node* n = m_pFree.load(std::memory_order_acquire);
+                    while (n && !m_pFree.compare_exchange_weak(n, n->next.load(std::memory_order_relaxed), std::memory_order_acquire)) {}
+                    m_bFreeBusy.store(false, std::memory_order_release);
+                    if (n) {
+                        m_nFree.fetch_sub(1, std::memory_order_relaxed);
+                        n->next.store(nullptr, std::memory_order_relaxed);
+                        return n;
+                    }
+                }
+                return new node();
+            }
+
+            // Consumer only: keeps a node it is done with (up to m_nMaxFree of them)
+            void release_node(node* n) {
+                if (m_nFree.load(std::memory_order_relaxed) >= m_nMaxFree) {
+                    delete n;
+                    return;
+                }
+                m_nFree.fetch_add(1, std::memory_order_relaxed);
+                node* top = m_pFree.load(std::memory_order_relaxed);
+                do {
+                    n->next.store(top, std::memory_order_relaxed);
+                } while (!m_pFree.compare_exchange_weak(top, n, std::memory_order_release, std::memory_order_relaxed));
+            }
+
+            void link(node* n) {
+                m_nCount.fetch_add(1, std::memory_order_relaxed);
+
+                // claim the head, then make the old head point at us
+                // until the second step the consumer simply sees one item less
+                node* prev = m_pHead.exchange(n, std::memory_order_acq_rel);
+                prev->next.store(n);
+
+                // the store above and the load below are sequentially consistent, like
+                // the ones in wait(): either the consumer sees the new item, or we see it parked
+                if (bParked.load()) {
+                    std::scoped_lock lock(muxBlocking);
+                    cvBlocking.notify_one();
+                }
+            }
+
+        protected:
+            // producers work on the head, the consumer on the tail - keep them
+            // on different cache lines so they don't slow each other down
+            alignas(64) std::atomic<node*> m_pHead;
+            alignas(64) node* m_pTail;
+            std::atomic<size_t> m_nCount = 0;
+
+            // nodes the consumer is done with, for the producers to reuse
+            alignas(64) std::atomic<node*> m_pFree = nullptr;
+            std::atomic<bool> m_bFreeBusy = false;
+            std::atomic<size_t> m_nFree = 0;
+            size_t m_nMaxFree = 4096;
+
+            // only used when the consumer has nothing to do
+            std::atomic<bool> bParked = false;
+            std::condition_variable cvBlocking;
+            std::mutex muxBlocking;
+        };
+
+        // The queue of incoming messages (many I/O threads write, one thread reads)
+        // Define OLC_NET_TSQUEUE_INCOMING to go back to the mutex based tsqueue
+#ifdef OLC_NET_TSQUEUE_INCOMING
+        template<typename T>
+        using incoming_queue = tsqueue<T>;
+#else
+        template<typename T>
+        using incoming_queue = mpscqueue<T>;
+#endif
+    }
+}
@@ -0,0 +1,147 @@
+#pragma once
+#include "net_common.hpp"
+
+namespace olc {
+
+    namespace net {
+
+        // Recycles the storage of message bodies
+        // Every received message needs a body, and without a pool each of them costs
+        // a heap allocation. The pool keeps the vectors that are no longer needed
+        // (with their capacity), so when message sizes are stable a new body is just
+        // an old one handed out again
+        //
+        // It is used from the I/O thread (acquire) and from the thread that consumes
+        // the messages (release), so a small mutex protects it - it is never waited
+        // for: if the other thread holds it, acquire returns an empty body and release
+        // lets the body go, which is what the pool does when it is empty or full anyway
+        class body_pool {
+        public:
+            body_pool() = default;
+            // not allow the pool to be copied
+            body_pool(const body_pool&) = delete;
+
+        public:
+            // Returns an empty vector - with some capacity, if one was pooled
+            std::vector<uint8_t> acquire() {
+                std::unique_lock<std::mutex> lock(muxPool, std::try_to_lock);
+                if (!lock || m_vFree.empty()) {
+                    return {};
+                }
+                auto body = std::move(m_vFree.back());
+                m_vFree.pop_back();
+                return body;
+            }
+
+            // Gives a body back to the pool
+            void release(std::vector<uint8_t>&& body) {
+                // nothing worth keeping, or too large to be kept around
+                if (body.capacity() == 0 || body.capacity() > m_nMaxBodyCapacity) {
+                    return;
+                }
+
+                body.clear();
+                std::unique_lock<std::mutex> lock(muxPool, std::try_to_lock);
+                if (lock && m_vFree.size() < m_nMaxPooled) {
+                    m_vFree.push_back(std::move(body));
+                }
+            }
+
+        protected:
+            std::mutex muxPool;
+            std::vector<std::vector<uint8_t>> m_vFree;
+
+            // the pool never holds more than this many bodies, or bodies larger than this
+            size_t m_nMaxPooled = 64;
+            size_t m_nMaxBodyCapacity = 1024 * 1024;
+        };
+
+        // Room for the asio operation of a handler, so it is not allocated every time
+        // A connection has at most one read and one write in progress, and the operation
+        // asio makes for each (the handler, the buffers and its state) lives in a memory of
+        // its own. The memory is only used from the strand of the connection, so a flag
+        // tells if it is taken - if it is, or the operation doesn't fit, it comes from the
+        // heap as usual
+        class handler_memory {
+        public:
+            handler_memory() = default;
+            // not allow the memory to be copied
+            handler_memory(const handler_memory&) = delete;
+
+        public:
+            void* allocate(size_t nSize) {
+                if (!m_bInUse && nSize <= sizeof(m_storage)) {
+                    m_bInUse = true;
+                    return &m_storage;
+                }
+                return ::operator new(nSize);
+            }
+
+            void deallocate(void* p) {
+                if (p == &m_storage) {
+                    m_bInUse = false;
+                } else {
+                    ::operator delete(p);
+                }
+            }
+
+        protected:
+            alignas(std::max_align_t) unsigned char m_storage[2048];
+            bool m_bInUse = false;
+        };
+
+        // The allocator asio finds on a handler_with_memory (its associated allocator)
+        template <typename U>
+        class handler_allocator {
+        public:
+            using value_type = U;
+
+            explicit handler_allocator(handler_memory& memory) : m_pMemory(&memory) {}
+
+            template <typename V>
+            handler_allocator(const handler_allocator<V>& other) noexcept : m_pMemory(other.m_pMemory) {}
+
+            U* allocate(size_t n) const {
+                return static_cast<U*>(m_pMemory->allocate(sizeof(U) * n));
+            }
+
+            void deallocate(U* p, size_t) const {
+                m_pMemory->deallocate(p);
+            }
+
+            bool operator==(const handler_allocator& other) const noexcept { return m_pMemory == other.m_pMemory; }
+            bool operator!=(const handler_allocator& other) const noexcept { return m_pMemory != other.m_pMemory; }
+
+        private:
+            template <typename> friend class handler_allocator;
+            handler_memory* m_pMemory;
+        };
+
+        // A completion handler whose operation is made in a handler_memory
+        template <typename Handler>
+        class handler_with_memory {
+        public:
+            using allocator_type = handler_allocator<Handler>;
+
+            handler_with_memory(handler_memory& memory, Handler handler) : m_pMemory(&memory), m_handler(std::move(handler)) {}
+
+            allocator_type get_allocator() const noexcept {
+                return allocator_type(*m_pMemory);
+            }
+
+            template <typename... Args>
+            void operator()(Args&&... args) {
+                m_handler(std::forward<Args>(args)...);
+            }
+
+        private:
+            handler_memory* m_pMemory;
+            Handler m_handler;
+        };
+
+        template <typename Handler>
+        handler_with_memory<Handler> WithMemory(handler_memory& memory, Handler handler) {
+            return handler_with_memory<Handler>(memory, std::move(handler));
+        }
+    }
+}
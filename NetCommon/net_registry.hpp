@@ -0,0 +1,182 @@
+#pragma once
+#include "net_common.hpp"
+#include "net_header.hpp"
+
+namespace olc {
+
+    namespace net {
+
+        template <typename T, typename H>
+        class connection;
+
+        // Container of the connections of a server, indexed by their ID
+        // It is a "slot map": the ID of a connection is made of the index of a slot
+        // and the generation of that slot. The slot tells where the connection is,
+        // so insert, lookup and removal are O(1), and the generation changes every
+        // time the slot is reused, so the ID of a client that has gone away doesn't
+        // find the client that took its place - until the generation wraps: an ID has
+        // room for 4095 of them, so after that many reuses of a slot an old ID is back.
+        // Whatever keeps IDs for long (the timeouts of the server) keeps the Key of the
+        // client instead, which has the whole 32 bit count of reuses
+        //
+        // The connections themselves are kept packed together in a vector, so
+        // walking through all of them (e.g. for a broadcast) is cache friendly.
+        // Removing one moves the last connection into its place, so the order of
+        // the connections is not preserved
+        //
+        // The registry of a shard (see sharded_server) only uses the slots whose upper bits
+        // are the number of the shard, so the IDs of the clients are unique across the
+        // shards, and tell which shard a client is on (ShardOf)
+        //
+        // The registry is not thread safe - the server protects it with a mutex
+        template <typename T, typename H = fixed_header>
+        class connection_registry {
+        public:
+            // lower bits of an ID are the slot, upper bits the generation
+            static constexpr uint32_t nSlotBits = 20;
+            static constexpr uint32_t nSlotMask = (1u << nSlotBits) - 1;
+            static constexpr uint32_t nMaxSlots = 1u << nSlotBits;
+            // generations an ID can tell apart (0 is never one, so no ID is ever 0)
+            static constexpr uint32_t nIDGenerations = 0xFFFFFFFFu >> nSlotBits;
+
+        public:
+            // Makes this the registry of shard nShard, out of the 2^nShardBits of a server
+            // call it before the first insert - a shard has 2^(20 - nShardBits) slots
+            void SetShard(uint32_t nShard, uint32_t nShardBits) {
+                m_nSlotLimit = nMaxSlots >> nShardBits;
+                m_nSlotBase = nShard * m_nSlotLimit;
+            }
+
+            // The shard of the client with this ID, for a server of 2^nShardBits shards
+            static uint32_t ShardOf(uint32_t nID, uint32_t nShardBits) {
+                return nShardBits == 0 ? 0 : (nID & nSlotMask) >> (nSlotBits - nShardBits);
+            }
+
+            // Adds a connection and returns its ID (0 if the registry is full)
+            uint32_t insert(std::shared_ptr<connection<T, H>> conn) {
+                uint32_t nSlot;
+                if (!m_vFreeSlots.empty()) {
+                    nSlot = m_vFreeSlots.back();
+                    m_vFreeSlots.pop_back();
+                } else {
+                    if (m_vSlots.size() >= m_nSlotLimit) {
+                        return 0;
+                    }
+                    nSlot = uint32_t(m_vSlots.size());
+                    m_vSlots.push_back({});
+                }
+
+                m_vSlots[nSlot].nDense = uint32_t(m_vConnections.size());
+                m_vConnections.push_back(std::move(conn));
+                m_vDenseToSlot.push_back(nSlot);
+
+                return MakeID(nSlot, m_vSlots[nSlot].nGeneration);
+            }
+
+            // Returns the connection with this ID, or nullptr if there is none
+            std::shared_ptr<connection<T, H>> find(uint32_t nID) const {
+                const slot* s = Lookup(nID);
+                return s ? m_vConnections[s->nDense] : nullptr;
+            }
+
+            // The key of the connection with this ID (0 if there is none): the ID, and the
+            // generation of its slot in full - it only comes back after 2^32 reuses of the slot
+            uint64_t KeyOf(uint32_t nID) const {
+                const slot* s = Lookup(nID);
+                return s ? (uint64_t(s->nGeneration) << 32) | nID : 0;
+            }
+
+            // Returns the connection with this key, or nullptr if it has gone (even if
+            // another one has the same ID now)
+            std::shared_ptr<connection<T, H>> find_key(uint64_t nKey) const {
+                const slot* s = Lookup(uint32_t(nKey));
+                return s && s->nGeneration == uint32_t(nKey >> 32) ? m_vConnections[s->nDense] : nullptr;
+            }
+
+            // Removes the connection with this ID, returns false if there is none
+            bool erase(uint32_t nID) {
+                const slot* s = Lookup(nID);
+                if (!s) {
+                    return false;
+                }
+                erase_at(s->nDense);
+                return true;
+            }
+
+            // Removes the connection at position i of the packed vector
+            // the last connection is moved to position i
+            void erase_at(size_t i) {
+                uint32_t nSlot = m_vDenseToSlot[i];
+
+                // move the last connection into the hole
+                size_t nLast = m_vConnections.size() - 1;
+                if (i != nLast) {
+                    m_vConnections[i] = std::move(m_vConnections[nLast]);
+                    m_vDenseToSlot[i] = m_vDenseToSlot[nLast];
+                    m_vSlots[m_vDenseToSlot[i]].nDense = uint32_t(i);
+                }
+                m_vConnections.pop_back();
+                m_vDenseToSlot.pop_back();
+
+                // a new generation for the next user of this slot
+                m_vSlots[nSlot].nGeneration++;
+                m_vFreeSlots.push_back(nSlot);
+            }
+
+            size_t size() const {
+                return m_vConnections.size();
+            }
+
+            bool empty() const {
+                return m_vConnections.empty();
+            }
+
+            // access to the packed connections, for iteration
+            std::shared_ptr<connection<T, H>>& operator[](size_t i) {
+                return m_vConnections[i];
+            }
+
+            auto begin() { return m_vConnections.begin(); }
+            auto end() { return m_vConnections.end(); }
+
+        private:
+            struct slot {
+                // how many times the slot has been used, the ID only has room for part of it
+                uint32_t nGeneration = 1;
+                // position of the connection in m_vConnections
+                uint32_t nDense = 0;
+            };
+
+            uint32_t MakeID(uint32_t nSlot, uint32_t nGeneration) const {
+                // 1 to nIDGenerations, whatever the full generation is
+                uint32_t nIDGeneration = (nGeneration - 1) % nIDGenerations + 1;
+                return (nIDGeneration << nSlotBits) | (m_nSlotBase + nSlot);
+            }
+
+            // the slot of a live connection with this ID, or nullptr
+            const slot* Lookup(uint32_t nID) const {
+                // the ID of another shard wraps around to a slot far too big
+                uint32_t nSlot = (nID & nSlotMask) - m_nSlotBase;
+                if (nSlot >= m_vSlots.size()) {
+                    return nullptr;
+                }
+                const slot& s = m_vSlots[nSlot];
+                if (MakeID(nSlot, s.nGeneration) != nID || s.nDense >= m_vDenseToSlot.size() || m_vDenseToSlot[s.nDense] != nSlot) {
+                    return nullptr;
+                }
+                return &s;
+            }
+
+        private:
+            std::vector<slot> m_vSlots;
+            std::vector<uint32_t> m_vFreeSlots;
+            // the slots of this shard: m_nSlotBase is added to a slot to make its ID
+            uint32_t m_nSlotBase = 0;
+            uint32_t m_nSlotLimit = nMaxSlots;
+
+            // the connections, packed, and the slot each of them belongs to
+            std::vector<std::shared_ptr<connection<T, H>>> m_vConnections;
+            std::vector<uint32_t> m_vDenseToSlot;
+        };
+    }
+}
@@ -2,58 +2,139 @@
 
 #include "net_common.hpp"
 #include "net_tsqueue.hpp"
+#include "net_mpscqueue.hpp"
 #include "net_message.hpp"
 #include "net_connection.hpp"
+#include "net_registry.hpp"
+#include "net_stats.hpp"
+#include "net_backpressure.hpp"
+#include "net_socket.hpp"
+#include "net_transport.hpp"
+#include "net_datagram.hpp"
+#include "net_uring.hpp"
+#include "net_timer.hpp"
+#include "net_log.hpp"
 
 namespace olc {
 
     namespace net {
         
-        template <typename T>
+        // H is how the message headers are written on the socket: fixed_header (the default)
+        // or varint_header, which is smaller for small messages (see net_header.hpp)
+        // The clients must use the same
+        template <typename T, typename H = fixed_header>
         class server_interface {
             
         public:
             // port number where the server will listen to
-            server_interface(uint16_t port)
-                : m_asioAcceptor(m_asioContext, asio::ip::tcp::endpoint(asio::ip::tcp::v4() , port)) {
+            // and how OnMessage is called (dispatch_mode::direct calls it from the threads
+            // of the pool, as soon as a message is read - Update is not needed then)
+            server_interface(uint16_t port, dispatch_mode mode = dispatch_mode::queued)
+                : m_asioAcceptor(m_asioContext), m_nDispatchMode(mode) {
 
+                m_address.port = port;
+                Listen(asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port));
+            }
+
+            // endpoint where the server will listen to, which also chooses the transport of
+            // its connections: tcp://0.0.0.0:60000, unix:///tmp/server.sock or shm:///tmp/server.sock
+            // (see net_transport.hpp) - the clients connect to the same endpoint
+            // A file left at the path of the socket (e.g. by a server that crashed) is removed
+            server_interface(const std::string& sEndpoint, dispatch_mode mode = dispatch_mode::queued)
+                : m_asioAcceptor(m_asioContext), m_nDispatchMode(mode) {
+
+                if (!ParseEndpoint(sEndpoint, m_address)) {
+                    throw std::invalid_argument("bad endpoint: " + sEndpoint);
+                }
+
+                if (m_address.scheme == transport::tcp) {
+                    Listen(asio::ip::tcp::endpoint(asio::ip::make_address(m_address.host), m_address.port));
+                } else {
+#if OLC_NET_HAS_LOCAL_TRANSPORT
+                    std::remove(m_address.path.c_str());
+                    Listen(asio::local::stream_protocol::endpoint(m_address.path));
+#else
+                    throw std::invalid_argument("no Unix domain sockets here: " + sEndpoint);
+#endif
+                }
             }
 
             virtual ~server_interface() {
                 Stop();
+                // the socket of a local server is a file - it goes with the server
+                if (m_address.scheme != transport::tcp && m_asioAcceptor.is_open()) {
+                    m_asioAcceptor.close();
+                    std::remove(m_address.path.c_str());
+                }
             }
 
-            bool Start() {
+            // nThreads is the size of the pool of threads that run the asio context
+            // all of them share the accept, read and write work of every client
+            bool Start(size_t nThreads = 1) {
                 try {
                     // need to issue some work before the start of the context
 					// prevent it from exiting immediately. Since this is a server, we 
 					// want it primed ready to handle clients trying to
 					// connect.
                     WaitForClientConnection();
-                    // start context in a thread of its own
-                    m_threadContext = std::thread([this]() { m_asioContext.run(); });
+
+                    // a pool of at least one thread is needed to run the context
+                    nThreads = std::max<size_t>(nThreads, 1);
+
+                    // start the context in every thread of the pool
+                    for (size_t i = 0; i < nThreads; i++) {
+                        m_vThreadPool.emplace_back([this]() { m_asioContext.run(); });
+                    }
                 }
                 catch (std::exception& e) {
 
                     // Something prohibeted the server from listening
-                    std::cerr << "[SERVER] Exception: " << e.what() << "\n";
+                    OLC_NET_LOG_ERROR("[SERVER] Exception: ", e.what());
                     return false;
                 }
 
-                std::cout << "[SERVER] Started!\n";
+                OLC_NET_LOG_INFO("[SERVER] Started with ", nThreads, " thread(s)!");
                 return true;
             }
 
+            // Stops the pool - once, later calls return at once
+            // A class derived from the server calls it in its own destructor: the base
+            // destructor comes too late, as the pool may still be calling the derived class
+            // (OnMessage in dispatch_mode::direct, OnClientDisconnect for timeouts) while
+            // its members are being destroyed
             void Stop() {
+                std::scoped_lock lockStop(muxStop);
+                if (m_bStopped) {
+                    return;
+                }
+                m_bStopped = true;
+
                 // Request the context to close
                 m_asioContext.stop();
 
-                // Tidy up the context thread
-                if(m_threadContext.joinable()) {
-                    m_threadContext.join();
+                // Tidy up the context threads
+                for (auto& thread : m_vThreadPool) {
+                    if(thread.joinable()) {
+                        thread.join();
+                    }
+                }
+                m_vThreadPool.clear();
+
+#if OLC_NET_HAS_COROUTINES
+                // a coroutine waiting in Accept gets nullptr, on this thread - the pool is gone
+                std::coroutine_handle<> hAcceptor;
+                {
+                    std::scoped_lock lock(muxAccept);
+                    m_bAcceptStopped = true;
+                    hAcceptor = std::exchange(m_hAcceptor, nullptr);
                 }
+                if (hAcceptor) {
+                    hAcceptor.resume();
+                }
+#endif
+
                 // Inform that server stopped
-                std::cout << "Server Stopped\n!";
+                OLC_NET_LOG_INFO("[SERVER] Stopped!");
             }
 
             // ASYNC - Instruct asio to wait for connection
@@ -62,36 +143,77 @@ namespace olc {
 				// is the purpose of an "acceptor" object. It will provide a unique socket
 				// for each incoming connection attempt
                 m_asioAcceptor.async_accept(
-                    [this](std::error_code ec, asio::ip::tcp::socket socket)
+                    [this](std::error_code ec, stream_socket socket)
                     {
                         // Triggered by incoming connection requests
                         if(!ec) {
 
                             // NO ERRORS - CONNECTION NOT ACCEPTED BY SERVER YET
-                            std::cout << "[Server] New connection: " << socket.remote_endpoint() << "\n";
+                            [[maybe_unused]] asio::error_code ecRemote;
+                            OLC_NET_LOG_INFO("[SERVER] New connection: ", DescribeEndpoint(socket.remote_endpoint(ecRemote)));
 
                             // Create a new connection to handle this client
-                            std::shared_ptr<connection<T>> newconn = 
-                                std::make_shared<connection<T>>(connection<T>::owner::server, 
+                            std::shared_ptr<connection<T, H>> newconn = 
+                                std::make_shared<connection<T, H>>(connection<T, H>::owner::server, 
                                     m_asioContext, std::move(socket), m_qMessagesIn);
 
                             // Give the server a change to deny connection
                             if(OnClientConnect(newconn)) {
                                 // Conncetion accepted by the server
-                                // add the current connection in the server's list of conn
-                                m_deqConnections.push_back(std::move(newconn));
-                                // provide an id to the conn
-                                m_deqConnections.back()->ConnectToClient(nIDCounter++);
-
-                                std::cout << "[" << m_deqConnections.back()->GetID() << "] Connection Approved!\n";
+                                // add the current connection in the server's list of conn, 
+                                // which also provides its id
+                                // this handler runs on a pool thread, while the list is also
+                                // used by the thread that calls MessageClient/MessageAllClients
+                                std::scoped_lock lock(muxConnections);
+                                uint32_t nID = m_connections.insert(newconn);
+                                if (nID != 0) {
+                                    newconn->SetSocketOptions(m_socketOptions);
+                                    if (m_address.scheme == transport::shm) {
+                                        newconn->EnableSharedMemory();
+                                    }
+                                    if (m_pDatagrams) {
+                                        newconn->EnableDatagrams(m_pDatagrams.get());
+                                    }
+                                    if (m_pUring) {
+                                        newconn->EnableUring(m_pUring);
+                                    }
+                                    newconn->SetSendQueueLimits(m_sendQueueLimits);
+                                    newconn->SetCompression(m_nCodec.load(std::memory_order_relaxed), m_nCompressThreshold.load(std::memory_order_relaxed));
+                                    newconn->SetBackpressureHandler([this](std::shared_ptr<connection<T, H>> client, backpressure_event event) {
+                                        OnBackpressure(client, event);
+                                    });
+                                    if (m_nDispatchMode == dispatch_mode::direct) {
+                                        newconn->SetMessageHandler([this](owned_message<T, H>& msg) {
+                                            OnMessage(msg.remote, msg.msg);
+                                        });
+                                    }
+#if OLC_NET_HAS_COROUTINES
+                                    if (m_nDispatchMode == dispatch_mode::coroutine) {
+                                        newconn->EnableCoroutines();
+                                    }
+#endif
+                                    newconn->ConnectToClient(nID);
+                                    ScheduleTimeouts(nID);
+#if OLC_NET_HAS_COROUTINES
+                                    if (m_nDispatchMode == dispatch_mode::coroutine) {
+                                        HandOver(newconn);
+                                    }
+#endif
+                                    m_nAccepted.fetch_add(1, std::memory_order_relaxed);
+                                    OLC_NET_LOG_INFO("[", nID, "] Connection Approved!");
+                                } else {
+                                    m_nDenied.fetch_add(1, std::memory_order_relaxed);
+                                    OLC_NET_LOG_WARNING("[-----] Connection Denied (server is full)");
+                                }
 
                             } else {
-                                std::cout << "[-----] Connection Denied\n";
+                                m_nDenied.fetch_add(1, std::memory_order_relaxed);
+                                OLC_NET_LOG_INFO("[-----] Connection Denied");
                             }
 
                         } else {
                             // Error has occured durring acceptance
-                            std::cout << "[SERVER New Connection Error: " << ec.message() << "\n";
+                            OLC_NET_LOG_ERROR("[SERVER] New Connection Error: ", ec.message());
                         } 
 
                         // Prime the asio context with more work - simply wait
@@ -101,116 +223,717 @@ namespace olc {
                 );
             }
 
+#if OLC_NET_HAS_COROUTINES
+            // What Accept returns: co_await it for the next client connected (and approved
+            // by OnClientConnect), or nullptr once the server is stopped
+            struct accept_awaitable {
+                server_interface* pServer = nullptr;
+
+                bool await_ready() const noexcept {
+                    return false;
+                }
+
+                // it only waits if there is no client yet
+                bool await_suspend(std::coroutine_handle<> hAcceptor) {
+                    std::scoped_lock lock(pServer->muxAccept);
+                    if (!pServer->m_qAccepted.empty() || pServer->m_bAcceptStopped) {
+                        return false;
+                    }
+                    pServer->m_hAcceptor = hAcceptor;
+                    return true;
+                }
+
+                std::shared_ptr<connection<T, H>> await_resume() {
+                    std::scoped_lock lock(pServer->muxAccept);
+                    if (pServer->m_qAccepted.empty()) {
+                        return nullptr;
+                    }
+                    std::shared_ptr<connection<T, H>> client = std::move(pServer->m_qAccepted.front());
+                    pServer->m_qAccepted.pop_front();
+                    return client;
+                }
+            };
+
+            // The next client, with dispatch_mode::coroutine - one coroutine accepts, and
+            // usually spawns a session for each client on its strand:
+            //
+            //   olc::net::task<> AcceptLoop() {
+            //       while (auto client = co_await Accept()) {
+            //           olc::net::Spawn(client->GetStrand(), Session(client));
+            //       }
+            //   }
+            //
+            // The coroutine goes on on a thread of the pool. When the server stops, the loop is
+            // resumed by Stop (the sessions that still wait for a message are not)
+            accept_awaitable Accept() {
+                return accept_awaitable{ this };
+            }
+
+            // Starts a task (e.g. the accept loop) on the threads of the pool
+            void Spawn(task<void> t) {
+                olc::net::Spawn(m_asioContext.get_executor(), std::move(t));
+            }
+#endif
+
             // Send a message to a specific client
-            void MessageClient(std::shared_ptr<connection<T>> client, const message<T>& msg) {
-                if(client && client->IsConnected()) {
-                    client->Send(msg);
-                } else {
-                    // if the client is not connceted anymore - we can call the function that takes care of a disconnected client
-                    OnClientDisconnect(client);
-                    // client is not longer valid => delete client
-                    client.reset();
-                    m_deqConnections.erase(
-                        std::remove(begin(m_deqConnections), end(m_deqConnections), client), end(m_deqConnections)
-                    );
-                }  
+            // (as a datagram, if its type was given delivery::unreliable)
+            void MessageClient(std::shared_ptr<connection<T, H>> client, const message<T>& msg) {
+                if (ValidateClient(client)) {
+                    if (IsUnreliable(msg.header.id)) {
+                        client->SendUnreliable(msg);
+                    } else {
+                        client->Send(msg);
+                    }
+                }
+            }
+
+            // Send a message to a specific client, moving it instead of copying it
+            void MessageClient(std::shared_ptr<connection<T, H>> client, message<T>&& msg) {
+                if (ValidateClient(client)) {
+                    if (IsUnreliable(msg.header.id)) {
+                        client->SendUnreliable(std::move(msg));
+                    } else {
+                        client->Send(std::move(msg));
+                    }
+                }
+            }
+
+            // Send a message to the client with this ID
+            void MessageClient(uint32_t nClientID, const message<T>& msg) {
+                MessageClient(GetClient(nClientID), msg);
+            }
+
+            void MessageClient(uint32_t nClientID, message<T>&& msg) {
+                MessageClient(GetClient(nClientID), std::move(msg));
+            }
+
+            // Limits of the outgoing queue of every client, and what happens to the messages
+            // over them (see send_queue_limits) - applies to the clients already connected too
+            // e.g. SetSendQueueLimits(send_queue_limits::make(backpressure_policy::drop_oldest, 1024, 4 * 1024 * 1024));
+            void SetSendQueueLimits(const send_queue_limits& limits) {
+                std::scoped_lock lock(muxConnections);
+                m_sendQueueLimits = limits;
+                for (auto& client : m_connections) {
+                    client->SetSendQueueLimits(limits);
+                }
+            }
+
+            // Opens a UDP socket on the port of the server, for the messages sent with
+            // delivery::unreliable - call it before Start. Every client that enables
+            // datagrams too gets a channel, the others get these messages over TCP
+            // (a server on a Unix domain socket has no port for them: they go over the socket)
+            bool EnableDatagrams() {
+                asio::error_code ec;
+                asio::ip::tcp::endpoint tcpEndpoint;
+                if (!ToTcpEndpoint(m_asioAcceptor.local_endpoint(ec), tcpEndpoint) || ec) {
+                    return false;
+                }
+                auto pDatagrams = std::make_unique<datagram_socket>(m_asioContext);
+                if (!pDatagrams->Open(tcpEndpoint.port())) {
+                    return false;
+                }
+
+                // the first bytes of a datagram say which client it belongs to, the
+                // connection checks the rest
+                pDatagrams->Start([this](const asio::ip::udp::endpoint& remote, const uint8_t* pData, size_t nData) {
+                    datagram_header header;
+                    if (nData < sizeof(header)) {
+                        return;
+                    }
+                    std::memcpy(&header, pData, sizeof(header));
+                    if (auto client = GetClient(header.nID)) {
+                        client->ReceiveDatagram(remote, pData, nData);
+                    }
+                });
+                m_pDatagrams = std::move(pDatagrams);
+                return true;
+            }
+
+            // The datagram socket, nullptr without EnableDatagrams (e.g. to SetLoss on it)
+            datagram_socket* GetDatagramSocket() {
+                return m_pDatagrams.get();
+            }
+
+            // How the messages of this type are sent (delivery::reliable by default) - call it
+            // before Start, the list is read without a lock
+            void SetDelivery(T id, delivery mode) {
+                auto it = std::find(m_vUnreliableTypes.begin(), m_vUnreliableTypes.end(), id);
+                if (mode == delivery::unreliable && it == m_vUnreliableTypes.end()) {
+                    m_vUnreliableTypes.push_back(id);
+                } else if (mode == delivery::reliable && it != m_vUnreliableTypes.end()) {
+                    m_vUnreliableTypes.erase(it);
+                }
+            }
+
+            bool IsUnreliable(T id) const {
+                return std::find(m_vUnreliableTypes.begin(), m_vUnreliableTypes.end(), id) != m_vUnreliableTypes.end();
+            }
+
+            // How the sockets of the clients are read and written (io_engine::reactor by default,
+            // see net_uring.hpp) - call it before Start. false if io_uring can't be used here
+            // (not Linux, an older kernel, or forbidden in a container): the reactor is used then
+            // The acceptor and the datagrams stay with the reactor either way
+            bool SetIoEngine(io_engine engine) {
+                if (engine == io_engine::reactor) {
+                    m_pUring.reset();
+                    return true;
+                }
+                auto pUring = std::make_shared<uring_engine>(m_asioContext);
+                if (!pUring->Open()) {
+                    OLC_NET_LOG_WARNING("[SERVER] No io_uring here, the reactor is used.");
+                    return false;
+                }
+                m_pUring = std::move(pUring);
+                return true;
+            }
+
+            io_engine GetIoEngine() const {
+                return m_pUring ? io_engine::uring : io_engine::reactor;
+            }
+
+            // The io_uring of the clients, nullptr with the reactor (e.g. for its GetStats)
+            uring_engine* GetUringEngine() {
+                return m_pUring.get();
+            }
+
+            // When to give up on a client (see timeout_options) - applies to the clients already
+            // connected too. A client that times out is closed, and OnClientDisconnect is called
+            // for it from a thread of the pool - not from Update, which may be waiting for a
+            // message, so at the same time as OnMessage in dispatch_mode::queued too
+            // Every client is looked at by a single timer_wheel, so a server with 100k clients
+            // doesn't keep 100k asio timers: the wheel moves every tTick, and a client is only
+            // looked at when one of its timeouts could be due (a timeout fires up to a tick late)
+            // e.g. SetTimeouts(timeout_options::make(30s, 10s, 10s));
+            void SetTimeouts(const timeout_options& options, std::chrono::milliseconds tTick = std::chrono::milliseconds(100)) {
+                std::scoped_lock lock(muxConnections, muxTimeouts);
+                m_timeoutOptions = options;
+                m_timeoutWheel = timer_wheel<timeout_entry>(tTick);
+                if (!options.Enabled()) {
+                    return;
+                }
+                for (auto& client : m_connections) {
+                    m_timeoutWheel.Add(FirstTimeoutCheck(), { m_connections.KeyOf(client->GetID()), 0 });
+                }
+                if (!m_bTimeoutTimerArmed) {
+                    m_bTimeoutTimerArmed = true;
+                    asio::post(m_asioContext, [this]() { ArmTimeoutTimer(); });
+                }
+            }
+
+            // Options of the sockets of the clients (socket_options::low_latency by default)
+            // applies to the clients already connected too
+            void SetSocketOptions(const socket_options& options) {
+                std::scoped_lock lock(muxConnections);
+                m_socketOptions = options;
+                for (auto& client : m_connections) {
+                    client->SetSocketOptions(options);
+                }
+            }
+
+            // Compress the bodies of at least nThreshold bytes sent to the clients that can
+            // decompress them (codec_id::none to stop) - applies to the clients already connected too
+            // A broadcast is compressed once, by the thread that calls MessageAllClients
+            void SetCompression(codec_id codec = codec_id::lz, size_t nThreshold = 512) {
+                std::scoped_lock lock(muxConnections);
+                m_nCodec.store(codec, std::memory_order_relaxed);
+                m_nCompressThreshold.store(nThreshold, std::memory_order_relaxed);
+                for (auto& client : m_connections) {
+                    client->SetCompression(codec, nThreshold);
+                }
+            }
+
+            // Returns the client with this ID, nullptr if it is not connected (anymore)
+            std::shared_ptr<connection<T, H>> GetClient(uint32_t nClientID) {
+                std::scoped_lock lock(muxConnections);
+                return m_connections.find(nClientID);
             }
 
             // Send message to all clients - with option to ignore a client
-            void MessageAllClients(const message<T>& msg, std::shared_ptr<connection<T>> pIgnoreClient = nullptr) {
+            // The body is copied only once, into a shared body that every client refers to
+            void MessageAllClients(const message<T>& msg, std::shared_ptr<connection<T, H>> pIgnoreClient = nullptr) {
+                MessageAllClients(shared_message<T>(msg), pIgnoreClient);
+            }
+
+            // ...and without even that copy, if the message is not needed anymore
+            void MessageAllClients(message<T>&& msg, std::shared_ptr<connection<T, H>> pIgnoreClient = nullptr) {
+                MessageAllClients(shared_message<T>(std::move(msg)), pIgnoreClient);
+            }
+
+            // Send a message with an already shared body to all clients
+            void MessageAllClients(const shared_message<T>& msg, std::shared_ptr<connection<T, H>> pIgnoreClient = nullptr) {
 
-                bool bInvalidClientsExists = false;
+                bool bUnreliable = IsUnreliable(msg.header.id);
 
-                for(auto& client : m_deqConnections) {
-                    // Check client is connected...
-                    if (client && client->IsConnected()) {
-                        // ...it is!
-                        if(client != pIgnoreClient) {
-                            client->Send(msg);
+                // with compression on, the body is compressed once here (before the list
+                // is locked), rather than by every connection (datagrams are not compressed)
+                codec_id codec = m_nCodec.load(std::memory_order_relaxed);
+                if (codec != codec_id::none && !bUnreliable && !msg.packed && msg.size() >= m_nCompressThreshold.load(std::memory_order_relaxed)) {
+                    shared_message<T> packedMsg = msg;
+                    packedMsg.pack(codec, 0);
+                    if (packedMsg.packed) {
+                        MessageAllClients(packedMsg, pIgnoreClient);
+                        return;
+                    }
+                }
+
+                // clients that couldn't be contacted - they are reported once the
+                // list is unlocked, so OnClientDisconnect is free to message other clients
+                std::vector<std::shared_ptr<connection<T, H>>> vInvalidClients;
+
+                {
+                    std::scoped_lock lock(muxConnections);
+
+                    for(size_t i = 0; i < m_connections.size(); ) {
+                        auto& client = m_connections[i];
+                        // Check client is connected...
+                        if (client && client->IsConnected()) {
+                            // ...it is!
+                            if(client != pIgnoreClient) {
+                                if (bUnreliable) {
+                                    client->SendUnreliable(msg);
+                                } else {
+                                    client->Send(msg);
+                                }
+                            }
+                            i++;
+                        } else {
+                            // The client couldn't be contacted, so asssume it has disconnected
+                            vInvalidClients.push_back(client);
+                            // the last client is moved into this position, so
+                            // the position is visited again
+                            m_connections.erase_at(i);
                         }
-                    } else {
-                        // The client couldn't be contacted, so asssume it has disconnected
-                        OnClientDisconnect(client);
-                        client.reset();
-                        bInvalidClientsExists = true;
                     }
                 }
-                // Erase not valid connections outside the loop
-                // Otherwise we would change the collection while we were iterrating through it <- NOT OK
-                if(bInvalidClientsExists) {
-                    m_deqConnections.erase(
-                        std::remove(begin(m_deqConnections), end(m_deqConnections), nullptr), end(m_deqConnections));
+
+                for (auto& client : vInvalidClients) {
+                    OnClientDisconnect(client);
                 }
             }
 
             // size_t is an unsigned integer
             // setting it to '-1' sets it to the maximum value
-            void Update(size_t nMaxMessages = -1, bool bWait = false) {
+            // Returns the number of messages handled
+            size_t Update(size_t nMaxMessages = -1, bool bWait = false) {
+
+                size_t nMessageCount = 0;
+                if constexpr (std::is_same_v<incoming_queue<owned_message<T, H>>, mpscqueue<owned_message<T, H>>>) {
+                    // The lock free queue (the default) is popped directly: a pop takes no
+                    // lock, so a batch would only add a move per message
+                    if (bWait) {
+                        m_qMessagesIn.wait();
+                    }
 
-                if (bWait) {
-                    m_qMessagesIn.wait();
+                    while (nMessageCount < nMaxMessages && !m_qMessagesIn.empty()) {
+                        owned_message<T, H> msg = m_qMessagesIn.pop_front();
+                        DispatchMessage(msg);
+                        nMessageCount++;
+                    }
+                } else {
+                    // only wait if there is nothing left over from the last batch
+                    if (bWait && m_deqBatchIn.empty()) {
+                        m_qMessagesIn.wait();
+                    }
+
+                    // Take every message waiting in the queue in one go (the queue is locked
+                    // once per batch, not twice per message)
+                    m_qMessagesIn.drain(m_deqBatchIn);
+
+                    // Process as many messages as you can up to the value
+                    // specified - the rest stays in the batch for the next Update
+                    while (nMessageCount < nMaxMessages && !m_deqBatchIn.empty()) {
+                        // Grab the front message (the oldest)
+                        DispatchMessage(m_deqBatchIn.front());
+                        m_deqBatchIn.pop_front();
+                        nMessageCount++;
+                    }
                 }
 
-                // Process as many messages as you can up to the value
-				// specified
-                size_t nMessageCount = 0;
-                while (nMessageCount < nMaxMessages && !m_qMessagesIn.empty()) {
+                return nMessageCount;
+            }
+            
+            // Snapshot of the server and of every connection - can be called from any thread
+            // The list of connections is only locked while it is copied, and the counters
+            // are read without stopping the I/O threads
+            server_stats GetStats() {
+                server_stats stats;
+
+                std::vector<std::shared_ptr<connection<T, H>>> vClients;
+                {
+                    std::scoped_lock lock(muxConnections);
+                    vClients.assign(m_connections.begin(), m_connections.end());
+                }
+
+                stats.nConnections = vClients.size();
+                stats.nQueueInDepth = m_qMessagesIn.count();
+                stats.nAccepted = m_nAccepted.load(std::memory_order_relaxed);
+                stats.nDenied = m_nDenied.load(std::memory_order_relaxed);
+                stats.nIdleTimeouts = m_nIdleTimeouts.load(std::memory_order_relaxed);
+                stats.nWriteTimeouts = m_nWriteTimeouts.load(std::memory_order_relaxed);
+                stats.nHeartbeats = m_nHeartbeats.load(std::memory_order_relaxed);
+
+                stats.vConnections.reserve(vClients.size());
+                stats.total.dIdleSeconds = vClients.empty() ? 0.0 : std::numeric_limits<double>::max();
+                for (auto& client : vClients) {
+                    stats.total.Add(stats.vConnections.emplace_back(client->GetStats()));
+                }
 
-                    // Grab the front message (the oldest)
-                    auto msg = m_qMessagesIn.pop_front();
+                // accept rate since the previous snapshot
+                std::scoped_lock lock(muxStats);
+                auto tNow = std::chrono::steady_clock::now();
+                double dElapsed = std::chrono::duration<double>(tNow - m_tLastStats).count();
+                stats.dAcceptRate = dElapsed > 0.0 ? (stats.nAccepted - m_nLastAccepted) / dElapsed : 0.0;
+                m_tLastStats = tNow;
+                m_nLastAccepted = stats.nAccepted;
 
-                    // Pass to message handler
-                    OnMessage(msg.remote, msg.msg);
+                return stats;
+            }
+
+        protected:
+            // A shard of a sharded_server: the acceptor shares the port with the acceptors of
+            // the other shards (SO_REUSEPORT), and the IDs of its clients are those of shard
+            // nShard out of 2^nShardBits (see connection_registry::SetShard)
+            server_interface(uint16_t port, dispatch_mode mode, uint32_t nShard, uint32_t nShardBits)
+                : m_asioAcceptor(m_asioContext), m_nDispatchMode(mode) {
+
+                m_address.port = port;
+                m_connections.SetShard(nShard, nShardBits);
+                Listen(asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port), nShardBits > 0);
+            }
 
-                    nMessageCount++;
+#if OLC_NET_HAS_COROUTINES
+            // A new client for Accept - the coroutine waiting for it goes on in a handler of
+            // its own, as this one holds the list of connections
+            void HandOver(std::shared_ptr<connection<T, H>> client) {
+                std::coroutine_handle<> hAcceptor;
+                {
+                    std::scoped_lock lock(muxAccept);
+                    m_qAccepted.push_back(std::move(client));
+                    hAcceptor = std::exchange(m_hAcceptor, nullptr);
+                }
+                if (hAcceptor) {
+                    asio::post(m_asioContext, [hAcceptor]() { hAcceptor.resume(); });
+                }
+            }
+#endif
+
+            // TIMEOUTS - the wheel holds an entry per client, with its key in the registry (not
+            // its ID: after 4095 reuses of a slot an ID is back, and the entry of a client that
+            // has gone would find the one that has the ID now), and the time the last heartbeat
+            // was sent to it
+            struct timeout_entry {
+                uint64_t nKey;
+                int64_t nHeartbeatSent;
+            };
+
+            // A new client is first looked at once the shortest of its timeouts has passed
+            // must hold muxTimeouts
+            std::chrono::steady_clock::time_point FirstTimeoutCheck() const {
+                std::chrono::milliseconds tFirst = std::chrono::milliseconds::max();
+                for (auto t : { m_timeoutOptions.idle, m_timeoutOptions.write, m_timeoutOptions.heartbeat }) {
+                    if (t.count() > 0) {
+                        tFirst = std::min(tFirst, t);
+                    }
                 }
+                return std::chrono::steady_clock::now() + tFirst;
+            }
 
-                    
+            // must hold muxConnections (and not muxTimeouts)
+            void ScheduleTimeouts(uint32_t nID) {
+                std::scoped_lock lock(muxTimeouts);
+                if (m_timeoutOptions.Enabled()) {
+                    m_timeoutWheel.Add(FirstTimeoutCheck(), { m_connections.KeyOf(nID), 0 });
+                }
             }
-            
+
+            // The wheel moves a tick at a time, from a single chain of handlers on the pool
+            void ArmTimeoutTimer() {
+                m_timeoutTimer.expires_after(m_timeoutWheel.GetTick());
+                m_timeoutTimer.async_wait([this](std::error_code ec) {
+                    if (!ec) {
+                        CheckTimeouts();
+                    }
+                });
+            }
+
+            // The clients whose entry is due: each is closed if one of its timeouts has passed,
+            // sent a heartbeat if it has been quiet, and put back in the wheel for the next
+            // time one of them could be due. A client closed by a timeout, or found closed by
+            // an error, is removed, and OnClientDisconnect is called for it
+            void CheckTimeouts() {
+                timeout_options options;
+                {
+                    std::scoped_lock lock(muxTimeouts);
+                    m_timeoutWheel.Advance(std::chrono::steady_clock::now(), m_vTimeoutsDue);
+                    options = m_timeoutOptions;
+                    if (!options.Enabled()) {
+                        m_vTimeoutsDue.clear();
+                        m_bTimeoutTimerArmed = false;
+                        return;
+                    }
+                }
+
+                m_vTimeoutClients.clear();
+                {
+                    std::scoped_lock lock(muxConnections);
+                    for (auto& entry : m_vTimeoutsDue) {
+                        m_vTimeoutClients.push_back(m_connections.find_key(entry.nKey));
+                    }
+                }
+
+                int64_t nIdle = std::chrono::nanoseconds(options.idle).count();
+                int64_t nWrite = std::chrono::nanoseconds(options.write).count();
+                int64_t nHeartbeat = std::chrono::nanoseconds(options.heartbeat).count();
+                int64_t nNow = connection_counters::Now();
+                std::vector<std::shared_ptr<connection<T, H>>> vClosed;
+                for (size_t i = 0; i < m_vTimeoutsDue.size(); i++) {
+                    auto& client = m_vTimeoutClients[i];
+                    timeout_entry entry = m_vTimeoutsDue[i];
+                    if (!client) {
+                        continue;
+                    }
+                    if (!client->IsConnected()) {
+                        vClosed.push_back(std::move(client));
+                        continue;
+                    }
+
+                    const connection_counters& counters = client->GetCounters();
+                    int64_t nLastRead = counters.nLastRead.load(std::memory_order_relaxed);
+                    int64_t nWriteStarted = counters.nWriteStarted.load(std::memory_order_relaxed);
+                    bool bIdle = nIdle > 0 && nNow - nLastRead >= nIdle;
+                    bool bWriteStalled = nWrite > 0 && nWriteStarted != 0 && nNow - nWriteStarted >= nWrite;
+                    if (bIdle || bWriteStalled) {
+                        (bIdle ? m_nIdleTimeouts : m_nWriteTimeouts).fetch_add(1, std::memory_order_relaxed);
+                        OLC_NET_LOG_INFO("[", client->GetID(), "] ", bIdle ? "Idle" : "Write", " timeout.");
+                        // the socket is closed from the strand of the connection, whose pending
+                        // handlers hold it until then - it can be removed now
+                        client->Disconnect();
+                        vClosed.push_back(std::move(client));
+                        continue;
+                    }
+                    if (nHeartbeat > 0 && nNow - nLastRead >= nHeartbeat && nNow - entry.nHeartbeatSent >= nHeartbeat) {
+                        client->SendHeartbeat();
+                        entry.nHeartbeatSent = nNow;
+                        m_nHeartbeats.fetch_add(1, std::memory_order_relaxed);
+                    }
+
+                    // when the next of its timeouts could be due (a write that has not started
+                    // yet can't time out before a whole timeout from now)
+                    int64_t nNext = std::numeric_limits<int64_t>::max();
+                    if (nIdle > 0) {
+                        nNext = std::min(nNext, nLastRead + nIdle);
+                    }
+                    if (nWrite > 0) {
+                        nNext = std::min(nNext, (nWriteStarted != 0 ? nWriteStarted : nNow) + nWrite);
+                    }
+                    if (nHeartbeat > 0) {
+                        nNext = std::min(nNext, std::max(nLastRead, entry.nHeartbeatSent) + nHeartbeat);
+                    }
+                    m_vTimeoutsNext.push_back({ nNext, entry });
+                }
+
+                {
+                    std::scoped_lock lock(muxTimeouts);
+                    for (auto& [nNext, entry] : m_vTimeoutsNext) {
+                        m_timeoutWheel.Add(std::chrono::steady_clock::time_point(std::chrono::nanoseconds(nNext)), entry);
+                    }
+                    ArmTimeoutTimer();
+                }
+                m_vTimeoutsDue.clear();
+                m_vTimeoutClients.clear();
+                m_vTimeoutsNext.clear();
+
+                // reported once the lists are unlocked, so OnClientDisconnect is free to
+                // message other clients
+                for (auto& client : vClosed) {
+                    bool bRemoved = false;
+                    {
+                        std::scoped_lock lock(muxConnections);
+                        if (m_connections.find(client->GetID()) == client) {
+                            m_connections.erase(client->GetID());
+                            bRemoved = true;
+                        }
+                    }
+                    if (bRemoved) {
+                        OnClientDisconnect(client);
+                    }
+                }
+            }
+
+            // A message taken from the incoming queue by Update: it is passed to the message
+            // handler, and then its body goes back to the connection that received it
+            void DispatchMessage(owned_message<T, H>& msg) {
+                OnMessage(msg.remote, msg.msg);
+                if (msg.remote) {
+                    msg.remote->RecycleBody(std::move(msg.msg.body));
+                }
+            }
+
+            // Opens the acceptor on an endpoint (TCP or Unix domain socket) - throws if it can't
+            // bReusePort lets other acceptors listen on the same port (the shards of a server)
+            template <typename Endpoint>
+            void Listen(const Endpoint& endpoint, bool bReusePort = false) {
+                stream_endpoint genericEndpoint(endpoint);
+                m_asioAcceptor.open(genericEndpoint.protocol());
+                if (m_address.scheme == transport::tcp) {
+                    m_asioAcceptor.set_option(asio::socket_base::reuse_address(true));
+#if OLC_NET_HAS_REUSEPORT
+                    if (bReusePort) {
+                        m_asioAcceptor.set_option(reuse_port(true));
+                    }
+#endif
+                }
+                m_asioAcceptor.bind(genericEndpoint);
+                m_asioAcceptor.listen();
+            }
+
+            // Returns true if the client can be messaged
+            // if it is not connceted anymore - it is removed from the server, and the function
+            // that takes care of a disconnected client is called, if it was this call that
+            // removed it (a client that has gone already, e.g. removed by a timeout or by
+            // MessageAllClients, was reported then)
+            bool ValidateClient(std::shared_ptr<connection<T, H>> client) {
+                if (!client) {
+                    return false;
+                }
+                if (client->IsConnected()) {
+                    return true;
+                }
+
+                // client is not longer valid => delete client
+                bool bRemoved = false;
+                {
+                    std::scoped_lock lock(muxConnections);
+                    if (m_connections.find(client->GetID()) == client) {
+                        m_connections.erase(client->GetID());
+                        bRemoved = true;
+                    }
+                }
+                if (bRemoved) {
+                    OnClientDisconnect(client);
+                }
+                return false;
+            }
+
         protected:
             // since we know this is a base class - we know that other classes will inherit it
             // protected gives similar to public access rights for classes that inherit the class
             // Called when a client connects, you can veto the connection by returning false
-            virtual bool OnClientConnect(std::shared_ptr<connection<T>> client) {
+            // What it sends is held until the connection has set up its transport
+            virtual bool OnClientConnect(std::shared_ptr<connection<T, H>> client) {
 
                 return false;
             }
 
             // Called when a client appears to have disconnected
-            virtual void OnClientDisconnect(std::shared_ptr<connection<T>> client) {
+            // It is called by the thread that found out: the one in Update, MessageClient or
+            // MessageAllClients, or a thread of the pool for a client that timed out (see
+            // SetTimeouts) - that one can run while Update is in OnMessage, so lock what
+            // OnClientDisconnect and OnMessage share
+            virtual void OnClientDisconnect(std::shared_ptr<connection<T, H>> client) {
                 // to remove a player when it disconnects
             }
 
             // Called when a message arrives
             // Tells the server what to do when a message arrives
-            virtual void OnMessage(std::shared_ptr<connection<T>> client, message<T>& msg) {
+            // In dispatch_mode::direct it is called by the threads of the pool, one message
+            // at a time per client, but for several clients at once
+            virtual void OnMessage(std::shared_ptr<connection<T, H>> client, message<T>& msg) {
 
             }
-        
-        protected:
 
-            // Thread Safe Queue for incoming messages
-            tsqueue<owned_message<T>> m_qMessagesIn;
+            // Called when the outgoing queue of a client crosses its watermarks, or is full
+            // Unlike OnMessage, it is called from the threads running asio, while the
+            // connection is in the middle of a Send - keep it short (e.g. stop sending
+            // to this client until it says low_watermark)
+            virtual void OnBackpressure(std::shared_ptr<connection<T, H>> client, backpressure_event event) {
 
-            // Container of active validated connections
-            std::deque<std::shared_ptr<connection<T>>> m_deqConnections;
+            }
+        
+        protected:
 
             // In order to work it needs a context -> a the context needs a thread
             // Order of declaration is important - it is also the order of initialisation
+            // (and the reverse of destruction: connections and queued messages hold
+            // sockets and strands that must be gone before the context is destroyed)
             asio::io_context m_asioContext;
-            std::thread m_threadContext;
+            // the context is run by a pool of threads, each connection keeps its 
+            // handlers in order with a strand of its own
+            std::vector<std::thread> m_vThreadPool;
+            // Stop is done once, by the first caller (the others wait for it)
+            std::mutex muxStop;
+            bool m_bStopped = false;
+            // the io_uring of the connections (io_engine::uring) - shared with them, as a handler
+            // still in the context holds its connection until the context itself is gone
+            std::shared_ptr<uring_engine> m_pUring;
+
+            // Thread Safe Queue for incoming messages
+            incoming_queue<owned_message<T, H>> m_qMessagesIn;
+            // Messages taken from the queue by Update (with tsqueue only), only used by the
+            // thread that calls Update
+            std::deque<owned_message<T, H>> m_deqBatchIn;
+
+            // Container of active validated connections, indexed by their ID
+            connection_registry<T, H> m_connections;
+            // protects the container, as it is used from the pool and from the user's thread
+            std::mutex muxConnections;
+            // given to every new connection (protected by muxConnections too)
+            send_queue_limits m_sendQueueLimits;
+            socket_options m_socketOptions;
+            // compression of what is sent to the clients (also read by MessageAllClients
+            // without the lock)
+            std::atomic<codec_id> m_nCodec = codec_id::none;
+            std::atomic<size_t> m_nCompressThreshold = 0;
 
             // One of the things that the server doesn't have is a socket of its own
             // It kind of does - but it's hidden from us by the asio library
             // We need to get the sockets of the connected clients
             // We can do this via an asio object called an acceptor
-            asio::ip::tcp::acceptor m_asioAcceptor;
+            // (it listens on TCP or on a Unix domain socket, m_address says which)
+            stream_acceptor m_asioAcceptor;
+            endpoint_address m_address;
+
+            // how OnMessage is called
+            dispatch_mode m_nDispatchMode = dispatch_mode::queued;
+
+#if OLC_NET_HAS_COROUTINES
+            // with dispatch_mode::coroutine: the clients Accept has not taken yet, and the
+            // coroutine waiting in it
+            std::mutex muxAccept;
+            std::deque<std::shared_ptr<connection<T, H>>> m_qAccepted;
+            std::coroutine_handle<> m_hAcceptor;
+            bool m_bAcceptStopped = false;
+#endif
+
+            // the UDP socket of the unreliable messages (see EnableDatagrams), and their types
+            std::unique_ptr<datagram_socket> m_pDatagrams;
+            std::vector<T> m_vUnreliableTypes;
+
+            // When to give up on a client, the wheel that holds them all, and the timer that
+            // moves it (only one of its handlers runs at a time: the vectors are theirs)
+            std::mutex muxTimeouts;
+            timeout_options m_timeoutOptions;
+            timer_wheel<timeout_entry> m_timeoutWheel;
+            asio::steady_timer m_timeoutTimer{ m_asioContext };
+            bool m_bTimeoutTimerArmed = false;
+            std::vector<timeout_entry> m_vTimeoutsDue;
+            std::vector<std::shared_ptr<connection<T, H>>> m_vTimeoutClients;
+            std::vector<std::pair<int64_t, timeout_entry>> m_vTimeoutsNext;
+            // clients closed by a timeout, and heartbeats sent
+            std::atomic<uint64_t> m_nIdleTimeouts = 0;
+            std::atomic<uint64_t> m_nWriteTimeouts = 0;
+            std::atomic<uint64_t> m_nHeartbeats = 0;
+
+            // connections accepted and denied, and what the previous GetStats saw
+            std::atomic<uint64_t> m_nAccepted = 0;
+            std::atomic<uint64_t> m_nDenied = 0;
+            std::mutex muxStats;
+            std::chrono::steady_clock::time_point m_tLastStats = std::chrono::steady_clock::now();
+            uint64_t m_nLastAccepted = 0;
 
             // every client in the system is represented by a numerical Identifier (nID)
             // the ID number is not relevant as long as it's unique for every connection
-            uint32_t nIDCounter = 10000;
-            // this information will be transmited to the clients when they connect
+            // the IDs are given by m_connections
                 
 
 
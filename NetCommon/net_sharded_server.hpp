@@ -0,0 +1,330 @@
+#pragma once
+
+#include "net_common.hpp"
+#include "net_server.hpp"
+#include "net_log.hpp"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace olc {
+
+    namespace net {
+
+        // A server made of shards, each a server_interface of its own: its own asio context
+        // run by one thread, its own acceptor, its own list of clients and its own queue of
+        // incoming messages. The acceptors all listen on the same port (SO_REUSEPORT) and the
+        // kernel spreads the new connections between them, so the shards accept at the same
+        // time, and a client stays on the thread of its shard for as long as it is connected
+        // - nothing is shared between the shards on the way of a message
+        //
+        // It is used like a server_interface (OnClientConnect, OnMessage, MessageClient,
+        // MessageAllClients...): the ID of a client says which shard it is on, and a message
+        // for all the clients goes to every shard. With dispatch_mode::direct, OnMessage is
+        // called by the thread of the shard of the client - several shards call it at once
+        //
+        // Where SO_REUSEPORT doesn't spread the connections (not Linux) there is one shard
+        // The datagrams (EnableDatagrams) and dispatch_mode::coroutine are not for shards
+        template <typename T, typename H = fixed_header>
+        class sharded_server {
+        public:
+            // The most shards a server can have (each of them can hold 2^20 / 64 clients then)
+            static constexpr size_t nMaxShards = 64;
+
+            // nShards 0 is a shard per core
+            sharded_server(uint16_t port, size_t nShards = 0, dispatch_mode mode = dispatch_mode::queued) {
+                if (nShards == 0) {
+                    nShards = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+                }
+                nShards = std::min(nShards, nMaxShards);
+#if !OLC_NET_HAS_REUSEPORT
+                if (nShards > 1) {
+                    OLC_NET_LOG_WARNING("[SERVER] No SO_REUSEPORT here, the server has one shard.");
+                    nShards = 1;
+                }
+#endif
+                // the shard is in the upper bits of the slot of an ID
+                while ((size_t(1) << m_nShardBits) < nShards) {
+                    m_nShardBits++;
+                }
+                for (size_t i = 0; i < nShards; i++) {
+                    m_vShards.push_back(std::make_unique<shard>(this, port, mode, uint32_t(i), m_nShardBits));
+                }
+            }
+
+            virtual ~sharded_server() {
+                Stop();
+            }
+
+            // Starts the thread of every shard
+            // bPinThreads keeps the thread of shard i on core i (Linux), so the clients of a
+            // shard are always handled by the same core
+            bool Start(bool bPinThreads = false) {
+                for (size_t i = 0; i < m_vShards.size(); i++) {
+                    if (!m_vShards[i]->Start(1)) {
+                        Stop();
+                        return false;
+                    }
+                    if (bPinThreads) {
+                        m_vShards[i]->PinThread(i);
+                    }
+                }
+                OLC_NET_LOG_INFO("[SERVER] Started with ", m_vShards.size(), " shard(s)!");
+                return true;
+            }
+
+            // Stops every shard - it can be called more than once, and a derived class calls it
+            // in its own destructor (see server_interface::Stop)
+            void Stop() {
+                for (auto& pShard : m_vShards) {
+                    pShard->Stop();
+                }
+            }
+
+            size_t GetShardCount() const {
+                return m_vShards.size();
+            }
+
+            // The shard a client is on
+            size_t ShardOf(uint32_t nClientID) const {
+                return connection_registry<T, H>::ShardOf(nClientID, m_nShardBits);
+            }
+
+            // Send a message to a specific client, through its shard
+            void MessageClient(std::shared_ptr<connection<T, H>> client, const message<T>& msg) {
+                if (client) {
+                    Shard(client->GetID()).MessageClient(client, msg);
+                }
+            }
+
+            void MessageClient(std::shared_ptr<connection<T, H>> client, message<T>&& msg) {
+                if (client) {
+                    Shard(client->GetID()).MessageClient(client, std::move(msg));
+                }
+            }
+
+            // Send a message to the client with this ID
+            void MessageClient(uint32_t nClientID, const message<T>& msg) {
+                Shard(nClientID).MessageClient(nClientID, msg);
+            }
+
+            void MessageClient(uint32_t nClientID, message<T>&& msg) {
+                Shard(nClientID).MessageClient(nClientID, std::move(msg));
+            }
+
+            // Send message to all clients of every shard - with option to ignore a client
+            // The body is copied (and compressed) once for all the shards
+            void MessageAllClients(const message<T>& msg, std::shared_ptr<connection<T, H>> pIgnoreClient = nullptr) {
+                MessageAllClients(shared_message<T>(msg), pIgnoreClient);
+            }
+
+            void MessageAllClients(message<T>&& msg, std::shared_ptr<connection<T, H>> pIgnoreClient = nullptr) {
+                MessageAllClients(shared_message<T>(std::move(msg)), pIgnoreClient);
+            }
+
+            void MessageAllClients(const shared_message<T>& msg, std::shared_ptr<connection<T, H>> pIgnoreClient = nullptr) {
+                codec_id codec = m_nCodec.load(std::memory_order_relaxed);
+                if (codec != codec_id::none && !msg.packed && msg.size() >= m_nCompressThreshold.load(std::memory_order_relaxed)
+                    && !m_vShards[0]->IsUnreliable(msg.header.id)) {
+                    shared_message<T> packedMsg = msg;
+                    packedMsg.pack(codec, 0);
+                    if (packedMsg.packed) {
+                        MessageAllClients(packedMsg, pIgnoreClient);
+                        return;
+                    }
+                }
+
+                for (auto& pShard : m_vShards) {
+                    pShard->MessageAllClients(msg, pIgnoreClient);
+                }
+            }
+
+            // Returns the client with this ID, nullptr if it is not connected (anymore)
+            std::shared_ptr<connection<T, H>> GetClient(uint32_t nClientID) {
+                return Shard(nClientID).GetClient(nClientID);
+            }
+
+            // With dispatch_mode::queued: handles the messages of every shard, up to
+            // nMaxMessages in all, from the thread that calls it. The shards take turns to go
+            // first, so a busy one doesn't hold up the others
+            // bWait waits until a shard has a message - it looks at each queue in turn for
+            // 1 ms, so dispatch_mode::direct is better for a server that waits for messages
+            // Returns the number of messages handled
+            size_t Update(size_t nMaxMessages = -1, bool bWait = false) {
+                size_t nShards = m_vShards.size();
+                size_t nMessageCount = 0;
+                while (true) {
+                    for (size_t i = 0; i < nShards && nMessageCount < nMaxMessages; i++) {
+                        nMessageCount += m_vShards[(m_nNextShard + i) % nShards]->Update(nMaxMessages - nMessageCount, false);
+                    }
+                    m_nNextShard = (m_nNextShard + 1) % nShards;
+                    if (nMessageCount > 0 || !bWait) {
+                        return nMessageCount;
+                    }
+                    m_vShards[m_nNextShard]->WaitForMessages(std::chrono::milliseconds(1));
+                }
+            }
+
+            // Limits of the outgoing queue of every client (see server_interface)
+            void SetSendQueueLimits(const send_queue_limits& limits) {
+                for (auto& pShard : m_vShards) {
+                    pShard->SetSendQueueLimits(limits);
+                }
+            }
+
+            // Options of the sockets of the clients (see server_interface)
+            void SetSocketOptions(const socket_options& options) {
+                for (auto& pShard : m_vShards) {
+                    pShard->SetSocketOptions(options);
+                }
+            }
+
+            // Compression of what is sent to the clients (see server_interface)
+            void SetCompression(codec_id codec = codec_id::lz, size_t nThreshold = 512) {
+                m_nCodec.store(codec, std::memory_order_relaxed);
+                m_nCompressThreshold.store(nThreshold, std::memory_order_relaxed);
+                for (auto& pShard : m_vShards) {
+                    pShard->SetCompression(codec, nThreshold);
+                }
+            }
+
+            // Timeouts of the clients (see server_interface) - every shard has a timer_wheel
+            // of its own, moved by its own thread
+            void SetTimeouts(const timeout_options& options, std::chrono::milliseconds tTick = std::chrono::milliseconds(100)) {
+                for (auto& pShard : m_vShards) {
+                    pShard->SetTimeouts(options, tTick);
+                }
+            }
+
+            // How the sockets are read and written (see server_interface) - with io_uring,
+            // every shard has a ring of its own. Call it before Start
+            bool SetIoEngine(io_engine engine) {
+                bool bDone = true;
+                for (auto& pShard : m_vShards) {
+                    bDone = pShard->SetIoEngine(engine) && bDone;
+                }
+                return bDone;
+            }
+
+            // Snapshot of the whole server: the counters of the shards added up
+            server_stats GetStats() {
+                server_stats stats;
+                stats.total.dIdleSeconds = std::numeric_limits<double>::max();
+                for (auto& pShard : m_vShards) {
+                    server_stats shardStats = pShard->GetStats();
+                    stats.nConnections += shardStats.nConnections;
+                    stats.nQueueInDepth += shardStats.nQueueInDepth;
+                    stats.nAccepted += shardStats.nAccepted;
+                    stats.nDenied += shardStats.nDenied;
+                    stats.dAcceptRate += shardStats.dAcceptRate;
+                    stats.nIdleTimeouts += shardStats.nIdleTimeouts;
+                    stats.nWriteTimeouts += shardStats.nWriteTimeouts;
+                    stats.nHeartbeats += shardStats.nHeartbeats;
+                    // a shard without clients has no idle time
+                    if (shardStats.nConnections > 0) {
+                        stats.total.Add(shardStats.total);
+                    }
+                    std::move(shardStats.vConnections.begin(), shardStats.vConnections.end(), std::back_inserter(stats.vConnections));
+                }
+                if (stats.nConnections == 0) {
+                    stats.total.dIdleSeconds = 0.0;
+                }
+                return stats;
+            }
+
+            // Snapshot of one shard (e.g. to see how the clients are spread)
+            server_stats GetShardStats(size_t nShard) {
+                return m_vShards[nShard]->GetStats();
+            }
+
+        protected:
+            // Called when a client connects, you can veto the connection by returning false
+            // (from the thread of the shard that accepted it)
+            virtual bool OnClientConnect(std::shared_ptr<connection<T, H>> client) {
+                return false;
+            }
+
+            // Called when a client appears to have disconnected (for a client that timed out,
+            // from the thread of its shard, see server_interface::OnClientDisconnect)
+            virtual void OnClientDisconnect(std::shared_ptr<connection<T, H>> client) {
+
+            }
+
+            // Called when a message arrives (see Update, and dispatch_mode::direct)
+            virtual void OnMessage(std::shared_ptr<connection<T, H>> client, message<T>& msg) {
+
+            }
+
+            // Called when the outgoing queue of a client crosses its watermarks, or is full
+            virtual void OnBackpressure(std::shared_ptr<connection<T, H>> client, backpressure_event event) {
+
+            }
+
+        private:
+            // A shard: a server_interface that leaves its events to the sharded_server
+            class shard : public server_interface<T, H> {
+            public:
+                shard(sharded_server* pOwner, uint16_t port, dispatch_mode mode, uint32_t nShard, uint32_t nShardBits)
+                    : server_interface<T, H>(port, mode, nShard, nShardBits), m_pOwner(pOwner) {}
+
+                // Waits for at most tTimeout for a message to handle
+                template <typename Rep, typename Period>
+                bool WaitForMessages(const std::chrono::duration<Rep, Period>& tTimeout) {
+                    return !this->m_deqBatchIn.empty() || this->m_qMessagesIn.wait_for(tTimeout);
+                }
+
+                // Keeps the thread of the shard on a core
+                void PinThread(size_t nCore) {
+#if defined(__linux__)
+                    size_t nCores = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+                    cpu_set_t cpuset;
+                    CPU_ZERO(&cpuset);
+                    CPU_SET(nCore % nCores, &cpuset);
+                    for (auto& thread : this->m_vThreadPool) {
+                        if (pthread_setaffinity_np(thread.native_handle(), sizeof(cpuset), &cpuset) != 0) {
+                            OLC_NET_LOG_WARNING("[SERVER] Can not pin a thread to core ", nCore % nCores);
+                        }
+                    }
+#endif
+                }
+
+            protected:
+                bool OnClientConnect(std::shared_ptr<connection<T, H>> client) override {
+                    return m_pOwner->OnClientConnect(client);
+                }
+
+                void OnClientDisconnect(std::shared_ptr<connection<T, H>> client) override {
+                    m_pOwner->OnClientDisconnect(client);
+                }
+
+                void OnMessage(std::shared_ptr<connection<T, H>> client, message<T>& msg) override {
+                    m_pOwner->OnMessage(client, msg);
+                }
+
+                void OnBackpressure(std::shared_ptr<connection<T, H>> client, backpressure_event event) override {
+                    m_pOwner->OnBackpressure(client, event);
+                }
+
+            private:
+                sharded_server* m_pOwner;
+            };
+
+            // the shard of a client, from its ID
+            shard& Shard(uint32_t nClientID) {
+                return *m_vShards[std::min<size_t>(ShardOf(nClientID), m_vShards.size() - 1)];
+            }
+
+        private:
+            std::vector<std::unique_ptr<shard>> m_vShards;
+            // the number of shards, rounded up to a power of 2, is 2^m_nShardBits
+            uint32_t m_nShardBits = 0;
+            // the shard Update starts with next time
+            size_t m_nNextShard = 0;
+            // compression of the broadcasts (the shards have the same)
+            std::atomic<codec_id> m_nCodec = codec_id::none;
+            std::atomic<size_t> m_nCompressThreshold = 0;
+        };
+    }
+}
@@ -0,0 +1,288 @@
+#pragma once
+#include "net_common.hpp"
+#include "net_transport.hpp"
+
+#if OLC_NET_HAS_LOCAL_TRANSPORT
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace olc {
+
+    namespace net {
+
+        // What a client writes on the Unix domain socket of a shm:// server, before anything
+        // else: the name of the shared memory it has made for the connection
+        struct shm_hello {
+            static constexpr uint32_t nMagicValue = 0x6F6C6331; // "olc1"
+
+            uint32_t nMagic = nMagicValue;
+            uint32_t nReserved = 0;
+            char sName[56] = {};
+        };
+
+        // Two rings of bytes in shared memory, one per direction, between the two processes of a
+        // connection (transport::shm). The client makes the memory, the server maps it once it
+        // knows its name, and it is removed as soon as both have it mapped (or when the client
+        // is gone, if the server never came)
+        //
+        // Each ring has one writer and one reader: the writer only moves the head, the reader
+        // only moves the tail, so they need no lock. The connection copies its gathered writes
+        // into its ring and parses what it reads from the other one, with the same framing as
+        // on a socket (so compression, control messages... work the same)
+        //
+        // A side that runs out of data (or of room) doesn't spin forever: it says so in the
+        // ring, checks one last time, and sleeps on the Unix domain socket. The other side
+        // sends it one byte there when that flag is set - the only system call of the ring
+        class shm_channel {
+        public:
+            // bytes of each ring (a power of 2) - a message bigger than this goes through in parts
+            static constexpr size_t nDefaultRingSize = 1024 * 1024;
+
+            shm_channel() = default;
+            shm_channel(const shm_channel&) = delete;
+
+            ~shm_channel() {
+#if OLC_NET_HAS_LOCAL_TRANSPORT
+                if (m_pMemory) {
+                    munmap(m_pMemory, m_nMapped);
+                }
+                if (m_bUnlink) {
+                    shm_unlink(m_hello.sName);
+                }
+#endif
+            }
+
+            // CLIENT - makes the memory of a new connection, and the hello that names it
+            bool Create(size_t nRingSize = nDefaultRingSize) {
+#if OLC_NET_HAS_LOCAL_TRANSPORT
+                // a power of 2, so a position in the ring is a mask away
+                size_t nSize = 4096;
+                while (nSize < nRingSize) {
+                    nSize *= 2;
+                }
+
+                static std::atomic<uint32_t> nNext = 0;
+                std::snprintf(m_hello.sName, sizeof(m_hello.sName), "/olc-net-%ld-%u",
+                    long(getpid()), nNext.fetch_add(1, std::memory_order_relaxed));
+
+                int fd = shm_open(m_hello.sName, O_CREAT | O_EXCL | O_RDWR, 0600);
+                if (fd < 0) {
+                    return false;
+                }
+                m_bUnlink = true;
+                size_t nMapped = MappedSize(nSize);
+                bool bMapped = ftruncate(fd, off_t(nMapped)) == 0 && Map(fd, nMapped);
+                close(fd);
+                if (!bMapped) {
+                    return false;
+                }
+
+                // the memory comes zeroed: the positions and the flags start at 0
+                Segment()->nMagic = shm_hello::nMagicValue;
+                Segment()->nRingSize = uint32_t(nSize);
+                Attach(0);
+                return true;
+#else
+                return false;
+#endif
+            }
+
+            // SERVER - maps the memory named in the hello of a client
+            bool Open(const shm_hello& hello) {
+#if OLC_NET_HAS_LOCAL_TRANSPORT
+                if (hello.nMagic != shm_hello::nMagicValue ||
+                    std::memchr(hello.sName, 0, sizeof(hello.sName)) == nullptr ||
+                    std::strncmp(hello.sName, "/olc-net-", 9) != 0) {
+                    return false;
+                }
+                m_hello = hello;
+
+                int fd = shm_open(m_hello.sName, O_RDWR, 0600);
+                if (fd < 0) {
+                    return false;
+                }
+                // both sides have it now - the name is not needed anymore
+                shm_unlink(m_hello.sName);
+
+                struct stat st;
+                bool bMapped = fstat(fd, &st) == 0 && size_t(st.st_size) > sizeof(segment_header) &&
+                    Map(fd, size_t(st.st_size));
+                close(fd);
+                if (!bMapped) {
+                    return false;
+                }
+
+                // the size of the rings comes from the other process, it is checked before use
+                size_t nSize = Segment()->nRingSize;
+                if (Segment()->nMagic != shm_hello::nMagicValue || nSize < 4096 || (nSize & (nSize - 1)) != 0 ||
+                    MappedSize(nSize) > m_nMapped) {
+                    return false;
+                }
+                Attach(1);
+                return true;
+#else
+                return false;
+#endif
+            }
+
+            const shm_hello& GetHello() const {
+                return m_hello;
+            }
+
+            // Copies up to nBytes into the ring we write, returns how many fitted
+            size_t Write(const uint8_t* pData, size_t nBytes) {
+                ring_header* r = m_pOut;
+                uint64_t nHead = r->nHead.load(std::memory_order_relaxed);
+                uint64_t nTail = r->nTail.load(std::memory_order_acquire);
+                // the positions come from the other process too: a bad one can't make us
+                // copy outside of the ring
+                size_t n = std::min<size_t>(nBytes, m_nRingSize - size_t(std::min<uint64_t>(nHead - nTail, m_nRingSize)));
+                CopyIn(m_pOutData, nHead, pData, n);
+                r->nHead.store(nHead + n, std::memory_order_release);
+                return n;
+            }
+
+            // Copies up to nBytes out of the ring we read, returns how many there were
+            size_t Read(uint8_t* pData, size_t nBytes) {
+                ring_header* r = m_pIn;
+                uint64_t nTail = r->nTail.load(std::memory_order_relaxed);
+                uint64_t nHead = r->nHead.load(std::memory_order_acquire);
+                size_t n = std::min<size_t>(nBytes, size_t(std::min<uint64_t>(nHead - nTail, m_nRingSize)));
+                CopyOut(m_pInData, nTail, pData, n);
+                r->nTail.store(nTail + n, std::memory_order_release);
+                return n;
+            }
+
+            // Before sleeping on the socket until the other side writes: false if it already
+            // has (then don't sleep). Once it has returned true, the next write wakes us
+            bool SleepRead() {
+                return Sleep(m_pIn->bReaderWaiting, [this]() {
+                    return m_pIn->nHead.load(std::memory_order_seq_cst) != m_pIn->nTail.load(std::memory_order_relaxed);
+                });
+            }
+
+            // Before sleeping on the socket until the other side makes room: false if it
+            // already has
+            bool SleepWrite() {
+                return Sleep(m_pOut->bWriterWaiting, [this]() {
+                    return m_pOut->nHead.load(std::memory_order_relaxed) - m_pOut->nTail.load(std::memory_order_seq_cst) < m_nRingSize;
+                });
+            }
+
+            // After a write: true if the other side sleeps until we write (wake it up)
+            bool WakeReader() {
+                return Wake(m_pOut->bReaderWaiting);
+            }
+
+            // After a read: true if the other side sleeps until we make room
+            bool WakeWriter() {
+                return Wake(m_pIn->bWriterWaiting);
+            }
+
+        private:
+            // the positions are the number of bytes written and read so far - they never
+            // wrap (at 2^64), so head - tail is what is in the ring
+            // Each one has a cache line of its own, so the two processes don't fight over it
+            struct ring_header {
+                alignas(64) std::atomic<uint64_t> nHead;
+                alignas(64) std::atomic<uint64_t> nTail;
+                alignas(64) std::atomic<uint32_t> bReaderWaiting;
+                alignas(64) std::atomic<uint32_t> bWriterWaiting;
+            };
+
+            struct segment_header {
+                alignas(64) uint32_t nMagic;
+                uint32_t nRingSize;
+            };
+
+            // the atomics are used by two processes: they must not hide a lock
+            static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+                "shared memory rings need lock free atomics");
+
+            // [segment_header][ring_header client -> server][ring_header server -> client][data][data]
+            static size_t MappedSize(size_t nRingSize) {
+                return sizeof(segment_header) + 2 * sizeof(ring_header) + 2 * nRingSize;
+            }
+
+            segment_header* Segment() {
+                return reinterpret_cast<segment_header*>(m_pMemory);
+            }
+
+#if OLC_NET_HAS_LOCAL_TRANSPORT
+            bool Map(int fd, size_t nSize) {
+                void* p = mmap(nullptr, nSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                if (p == MAP_FAILED) {
+                    return false;
+                }
+                m_pMemory = static_cast<uint8_t*>(p);
+                m_nMapped = nSize;
+                return true;
+            }
+#endif
+
+            // side 0 (the client) writes the first ring and reads the second, side 1 the opposite
+            void Attach(int nSide) {
+                m_nRingSize = Segment()->nRingSize;
+                uint8_t* pRings = m_pMemory + sizeof(segment_header);
+                uint8_t* pData = pRings + 2 * sizeof(ring_header);
+                ring_header* vRings[2] = { reinterpret_cast<ring_header*>(pRings), reinterpret_cast<ring_header*>(pRings) + 1 };
+                uint8_t* vData[2] = { pData, pData + m_nRingSize };
+
+                m_pOut = vRings[nSide];
+                m_pOutData = vData[nSide];
+                m_pIn = vRings[1 - nSide];
+                m_pInData = vData[1 - nSide];
+            }
+
+            // in at most two parts, when the bytes wrap around the end of the ring
+            void CopyIn(uint8_t* pRing, uint64_t nPos, const uint8_t* pData, size_t n) {
+                size_t nOffset = size_t(nPos) & (m_nRingSize - 1);
+                size_t nFirst = std::min(n, m_nRingSize - nOffset);
+                std::memcpy(pRing + nOffset, pData, nFirst);
+                std::memcpy(pRing, pData + nFirst, n - nFirst);
+            }
+
+            void CopyOut(const uint8_t* pRing, uint64_t nPos, uint8_t* pData, size_t n) {
+                size_t nOffset = size_t(nPos) & (m_nRingSize - 1);
+                size_t nFirst = std::min(n, m_nRingSize - nOffset);
+                std::memcpy(pData, pRing + nOffset, nFirst);
+                std::memcpy(pData + nFirst, pRing, n - nFirst);
+            }
+
+            // The flag is raised before the last look at the ring, and the other side moves its
+            // position before it looks at the flag: with both sequentially consistent, one of
+            // the two always sees the other, and a wake up can't be lost
+            template <typename F>
+            static bool Sleep(std::atomic<uint32_t>& bWaiting, F&& fnReady) {
+                bWaiting.store(1, std::memory_order_seq_cst);
+                if (fnReady()) {
+                    bWaiting.store(0, std::memory_order_relaxed);
+                    return false;
+                }
+                return true;
+            }
+
+            static bool Wake(std::atomic<uint32_t>& bWaiting) {
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                return bWaiting.load(std::memory_order_relaxed) != 0 && bWaiting.exchange(0, std::memory_order_acq_rel) != 0;
+            }
+
+        private:
+            shm_hello m_hello;
+            // the name is removed when the memory is gone, if the server hasn't done it
+            bool m_bUnlink = false;
+
+            uint8_t* m_pMemory = nullptr;
+            size_t m_nMapped = 0;
+            size_t m_nRingSize = 0;
+
+            ring_header* m_pOut = nullptr;
+            uint8_t* m_pOutData = nullptr;
+            ring_header* m_pIn = nullptr;
+            uint8_t* m_pInData = nullptr;
+        };
+    }
+}
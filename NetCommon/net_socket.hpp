@@ -0,0 +1,98 @@
+#pragma once
+#include "net_common.hpp"
+#include "net_transport.hpp"
+#include "net_log.hpp"
+
+// SO_REUSEPORT: several acceptors listen on the same port, and the kernel spreads the new
+// connections between them (see sharded_server). Only Linux balances them - elsewhere the
+// option exists, but one of the acceptors gets every connection
+#if defined(__linux__) && defined(SO_REUSEPORT)
+#define OLC_NET_HAS_REUSEPORT 1
+#else
+#define OLC_NET_HAS_REUSEPORT 0
+#endif
+
+namespace olc {
+
+    namespace net {
+
+        // Options of the socket of a connection - they are set as soon as the socket is
+        // connected (accepted by the server, or connected by the client)
+        // A buffer size of 0 leaves the one chosen by the operating system
+        //
+        // e.g. server.SetSocketOptions(socket_options::bulk());
+        struct socket_options {
+            // TCP_NODELAY: a write goes out at once. Without it (Nagle's algorithm) a small
+            // write waits until what was sent before has been acknowledged, and with delayed
+            // acks on the other side a request/response exchange can stall for ~40 ms
+            bool bNoDelay = true;
+            // SO_KEEPALIVE: the OS probes an idle connection, to notice a peer that is gone
+            bool bKeepAlive = false;
+            // SO_SNDBUF and SO_RCVBUF, in bytes
+            int nSendBuffer = 0;
+            int nReceiveBuffer = 0;
+
+            // The socket as the operating system makes it
+            static socket_options system() {
+                socket_options options;
+                options.bNoDelay = false;
+                return options;
+            }
+
+            // Every message goes out as soon as it is written - for request/response and
+            // game traffic (the default)
+            static socket_options low_latency() {
+                return socket_options();
+            }
+
+            // Big kernel buffers, so a fast sender doesn't wait for every window of the
+            // receiver - for big messages and streams. Nagle's algorithm stays off: the
+            // connection already gathers what is queued into one write (and Cork/Flush
+            // batches on demand), while Nagle would delay the small replies of the other side
+            static socket_options bulk() {
+                socket_options options;
+                options.nSendBuffer = 4 * 1024 * 1024;
+                options.nReceiveBuffer = 4 * 1024 * 1024;
+                return options;
+            }
+        };
+
+        // Sets the options on a connected socket - an option that can't be set is logged, and
+        // the socket keeps working without it
+        // A Unix domain socket only takes the buffer sizes (it has no Nagle, no keepalive)
+        inline void ApplySocketOptions(stream_socket& socket, const socket_options& options) {
+            asio::error_code ec;
+
+            if (IsTcpEndpoint(socket.local_endpoint(ec))) {
+                socket.set_option(asio::ip::tcp::no_delay(options.bNoDelay), ec);
+                if (ec) {
+                    OLC_NET_LOG_WARNING("[SOCKET] Can not set TCP_NODELAY: ", ec.message());
+                }
+
+                socket.set_option(asio::socket_base::keep_alive(options.bKeepAlive), ec);
+                if (ec) {
+                    OLC_NET_LOG_WARNING("[SOCKET] Can not set SO_KEEPALIVE: ", ec.message());
+                }
+            }
+
+            if (options.nSendBuffer > 0) {
+                socket.set_option(asio::socket_base::send_buffer_size(options.nSendBuffer), ec);
+                if (ec) {
+                    OLC_NET_LOG_WARNING("[SOCKET] Can not set SO_SNDBUF: ", ec.message());
+                }
+            }
+
+            if (options.nReceiveBuffer > 0) {
+                socket.set_option(asio::socket_base::receive_buffer_size(options.nReceiveBuffer), ec);
+                if (ec) {
+                    OLC_NET_LOG_WARNING("[SOCKET] Can not set SO_RCVBUF: ", ec.message());
+                }
+            }
+        }
+
+#if OLC_NET_HAS_REUSEPORT
+        // the option, to set on an acceptor before it is bound
+        using reuse_port = asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+#endif
+    }
+}
@@ -0,0 +1,297 @@
+#pragma once
+#include "net_common.hpp"
+
+namespace olc {
+
+    namespace net {
+
+        // Counters of a connection
+        // They are only ever written by the connection itself, from inside its strand, so
+        // there is a single writer: a relaxed load and store is enough to update them (no
+        // locked read-modify-write), and any other thread can read them without stopping
+        // the I/O threads
+        struct connection_counters {
+            std::atomic<uint64_t> nBytesIn = 0;
+            std::atomic<uint64_t> nBytesOut = 0;
+            std::atomic<uint64_t> nMessagesIn = 0;
+            std::atomic<uint64_t> nMessagesOut = 0;
+            // socket reads and writes issued
+            std::atomic<uint64_t> nReads = 0;
+            std::atomic<uint64_t> nWrites = 0;
+            std::atomic<uint64_t> nReadErrors = 0;
+            std::atomic<uint64_t> nWriteErrors = 0;
+            // messages and bytes waiting in the outgoing queue, now and at most
+            std::atomic<uint64_t> nQueueOut = 0;
+            std::atomic<uint64_t> nQueueOutHighWater = 0;
+            std::atomic<uint64_t> nQueueOutBytes = 0;
+            std::atomic<uint64_t> nQueueOutBytesHighWater = 0;
+            // what the backpressure policy did: messages dropped or replaced, connections
+            // closed, and how many times the queue went above its high watermark
+            std::atomic<uint64_t> nDroppedOldest = 0;
+            std::atomic<uint64_t> nDroppedNewest = 0;
+            std::atomic<uint64_t> nCoalesced = 0;
+            std::atomic<uint64_t> nOverflowDisconnects = 0;
+            std::atomic<uint64_t> nHighWatermarks = 0;
+            // messages sent compressed, and the bytes that it saved
+            std::atomic<uint64_t> nCompressed = 0;
+            std::atomic<uint64_t> nBytesSaved = 0;
+            // unreliable messages sent and received as datagrams, the ones received too late
+            // (after a newer one) and dropped, and the ones that went over TCP instead
+            std::atomic<uint64_t> nDatagramsOut = 0;
+            std::atomic<uint64_t> nDatagramsIn = 0;
+            std::atomic<uint64_t> nDatagramsStale = 0;
+            std::atomic<uint64_t> nUnreliableOverTcp = 0;
+            // over shared memory: the times the connection was woken up from the socket
+            // (the reads that found the ring ready without sleeping are not counted)
+            std::atomic<uint64_t> nRingWakeups = 0;
+            // with io_uring: the sends that found the socket full, and waited for it to be writable
+            std::atomic<uint64_t> nWriteStalls = 0;
+            // steady_clock time of the last read or write, in nanoseconds
+            std::atomic<int64_t> nLastActivity = Now();
+            // ...of the last read only, and of the start of the write in progress (0 if none)
+            std::atomic<int64_t> nLastRead = Now();
+            std::atomic<int64_t> nWriteStarted = 0;
+
+            static int64_t Now() {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+            }
+
+            // only for the single writer
+            static void Add(std::atomic<uint64_t>& counter, uint64_t n) {
+                counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+            }
+
+            void SetQueueOut(uint64_t n, uint64_t nBytes) {
+                nQueueOut.store(n, std::memory_order_relaxed);
+                if (n > nQueueOutHighWater.load(std::memory_order_relaxed)) {
+                    nQueueOutHighWater.store(n, std::memory_order_relaxed);
+                }
+                nQueueOutBytes.store(nBytes, std::memory_order_relaxed);
+                if (nBytes > nQueueOutBytesHighWater.load(std::memory_order_relaxed)) {
+                    nQueueOutBytesHighWater.store(nBytes, std::memory_order_relaxed);
+                }
+            }
+
+            void Touch() {
+                nLastActivity.store(Now(), std::memory_order_relaxed);
+            }
+
+            void TouchRead() {
+                int64_t nNow = Now();
+                nLastActivity.store(nNow, std::memory_order_relaxed);
+                nLastRead.store(nNow, std::memory_order_relaxed);
+            }
+        };
+
+        // A snapshot of the counters of one connection
+        struct connection_stats {
+            uint32_t nID = 0;
+            uint64_t nBytesIn = 0;
+            uint64_t nBytesOut = 0;
+            uint64_t nMessagesIn = 0;
+            uint64_t nMessagesOut = 0;
+            uint64_t nReads = 0;
+            uint64_t nWrites = 0;
+            uint64_t nReadErrors = 0;
+            uint64_t nWriteErrors = 0;
+            uint64_t nQueueOut = 0;
+            uint64_t nQueueOutHighWater = 0;
+            uint64_t nQueueOutBytes = 0;
+            uint64_t nQueueOutBytesHighWater = 0;
+            uint64_t nDroppedOldest = 0;
+            uint64_t nDroppedNewest = 0;
+            uint64_t nCoalesced = 0;
+            uint64_t nOverflowDisconnects = 0;
+            uint64_t nHighWatermarks = 0;
+            uint64_t nCompressed = 0;
+            uint64_t nBytesSaved = 0;
+            uint64_t nDatagramsOut = 0;
+            uint64_t nDatagramsIn = 0;
+            uint64_t nDatagramsStale = 0;
+            uint64_t nUnreliableOverTcp = 0;
+            uint64_t nRingWakeups = 0;
+            uint64_t nWriteStalls = 0;
+            // seconds since the last read or write
+            double dIdleSeconds = 0.0;
+
+            connection_stats() = default;
+
+            connection_stats(uint32_t id, const connection_counters& c) : nID(id) {
+                nBytesIn = c.nBytesIn.load(std::memory_order_relaxed);
+                nBytesOut = c.nBytesOut.load(std::memory_order_relaxed);
+                nMessagesIn = c.nMessagesIn.load(std::memory_order_relaxed);
+                nMessagesOut = c.nMessagesOut.load(std::memory_order_relaxed);
+                nReads = c.nReads.load(std::memory_order_relaxed);
+                nWrites = c.nWrites.load(std::memory_order_relaxed);
+                nReadErrors = c.nReadErrors.load(std::memory_order_relaxed);
+                nWriteErrors = c.nWriteErrors.load(std::memory_order_relaxed);
+                nQueueOut = c.nQueueOut.load(std::memory_order_relaxed);
+                nQueueOutHighWater = c.nQueueOutHighWater.load(std::memory_order_relaxed);
+                nQueueOutBytes = c.nQueueOutBytes.load(std::memory_order_relaxed);
+                nQueueOutBytesHighWater = c.nQueueOutBytesHighWater.load(std::memory_order_relaxed);
+                nDroppedOldest = c.nDroppedOldest.load(std::memory_order_relaxed);
+                nDroppedNewest = c.nDroppedNewest.load(std::memory_order_relaxed);
+                nCoalesced = c.nCoalesced.load(std::memory_order_relaxed);
+                nOverflowDisconnects = c.nOverflowDisconnects.load(std::memory_order_relaxed);
+                nHighWatermarks = c.nHighWatermarks.load(std::memory_order_relaxed);
+                nCompressed = c.nCompressed.load(std::memory_order_relaxed);
+                nBytesSaved = c.nBytesSaved.load(std::memory_order_relaxed);
+                nDatagramsOut = c.nDatagramsOut.load(std::memory_order_relaxed);
+                nDatagramsIn = c.nDatagramsIn.load(std::memory_order_relaxed);
+                nDatagramsStale = c.nDatagramsStale.load(std::memory_order_relaxed);
+                nUnreliableOverTcp = c.nUnreliableOverTcp.load(std::memory_order_relaxed);
+                nRingWakeups = c.nRingWakeups.load(std::memory_order_relaxed);
+                nWriteStalls = c.nWriteStalls.load(std::memory_order_relaxed);
+                dIdleSeconds = (connection_counters::Now() - c.nLastActivity.load(std::memory_order_relaxed)) * 1e-9;
+            }
+
+            // average number of messages carried by one write / parsed out of one read
+            double MessagesPerWrite() const {
+                return nWrites ? double(nMessagesOut) / nWrites : 0.0;
+            }
+
+            double MessagesPerRead() const {
+                return nReads ? double(nMessagesIn) / nReads : 0.0;
+            }
+
+            // Adds the counters of c to these (for the total of a server): the high waters
+            // are the highest, and the idle time the shortest
+            void Add(const connection_stats& c) {
+                nBytesIn += c.nBytesIn;
+                nBytesOut += c.nBytesOut;
+                nMessagesIn += c.nMessagesIn;
+                nMessagesOut += c.nMessagesOut;
+                nReads += c.nReads;
+                nWrites += c.nWrites;
+                nReadErrors += c.nReadErrors;
+                nWriteErrors += c.nWriteErrors;
+                nQueueOut += c.nQueueOut;
+                nQueueOutHighWater = std::max(nQueueOutHighWater, c.nQueueOutHighWater);
+                nQueueOutBytes += c.nQueueOutBytes;
+                nQueueOutBytesHighWater = std::max(nQueueOutBytesHighWater, c.nQueueOutBytesHighWater);
+                nDroppedOldest += c.nDroppedOldest;
+                nDroppedNewest += c.nDroppedNewest;
+                nCoalesced += c.nCoalesced;
+                nOverflowDisconnects += c.nOverflowDisconnects;
+                nHighWatermarks += c.nHighWatermarks;
+                nCompressed += c.nCompressed;
+                nBytesSaved += c.nBytesSaved;
+                nDatagramsOut += c.nDatagramsOut;
+                nDatagramsIn += c.nDatagramsIn;
+                nDatagramsStale += c.nDatagramsStale;
+                nUnreliableOverTcp += c.nUnreliableOverTcp;
+                nRingWakeups += c.nRingWakeups;
+                nWriteStalls += c.nWriteStalls;
+                dIdleSeconds = std::min(dIdleSeconds, c.dIdleSeconds);
+            }
+        };
+
+        // A snapshot of the whole server
+        struct server_stats {
+            size_t nConnections = 0;
+            // messages received and waiting for Update
+            size_t nQueueInDepth = 0;
+            uint64_t nAccepted = 0;
+            uint64_t nDenied = 0;
+            // connections accepted per second since the previous snapshot
+            double dAcceptRate = 0.0;
+            // clients closed as they sent nothing for timeout_options::idle, or didn't read
+            // for timeout_options::write, and the heartbeats sent to quiet ones
+            uint64_t nIdleTimeouts = 0;
+            uint64_t nWriteTimeouts = 0;
+            uint64_t nHeartbeats = 0;
+
+            // the sum of the counters of every connection
+            connection_stats total;
+            std::vector<connection_stats> vConnections;
+        };
+
+        // Latencies in nanoseconds, counted in buckets that grow exponentially: 16 buckets
+        // for every power of 2, so a percentile is within ~6% of the real value
+        // Any thread can add to it at any time, without locking
+        struct latency_histogram {
+            static constexpr size_t nSubBits = 4;
+            static constexpr size_t nBuckets = 64 << nSubBits;
+
+            latency_histogram() {
+                for (auto& bucket : vBuckets) {
+                    bucket.store(0, std::memory_order_relaxed);
+                }
+            }
+
+            void add(uint64_t nNanoseconds) {
+                vBuckets[Bucket(nNanoseconds)].fetch_add(1, std::memory_order_relaxed);
+            }
+
+            uint64_t count() const {
+                uint64_t nCount = 0;
+                for (auto& bucket : vBuckets) {
+                    nCount += bucket.load(std::memory_order_relaxed);
+                }
+                return nCount;
+            }
+
+            // p in [0, 1], in nanoseconds (the middle of the bucket it falls in)
+            double percentile(double p) const {
+                uint64_t nCount = count();
+                if (nCount == 0) {
+                    return 0.0;
+                }
+                uint64_t nRank = std::min(nCount - 1, uint64_t(p * nCount));
+                uint64_t nSeen = 0;
+                for (size_t i = 0; i < nBuckets; i++) {
+                    nSeen += vBuckets[i].load(std::memory_order_relaxed);
+                    if (nSeen > nRank) {
+                        return (double(LowerBound(i)) + double(LowerBound(i + 1))) / 2.0;
+                    }
+                }
+                return double(LowerBound(nBuckets - 1));
+            }
+
+            // values below 32 have a bucket each, above that the bucket is made of the
+            // position of the highest bit and the 4 bits that follow it
+            static size_t Bucket(uint64_t n) {
+                size_t nShift = 0;
+                while ((n >> nShift) >= (2u << nSubBits)) {
+                    nShift++;
+                }
+                return (nShift << nSubBits) + size_t(n >> nShift);
+            }
+
+            static uint64_t LowerBound(size_t nBucket) {
+                if (nBucket < (2u << nSubBits)) {
+                    return nBucket;
+                }
+                size_t nShift = (nBucket >> nSubBits) - 1;
+                return uint64_t(nBucket - (nShift << nSubBits)) << nShift;
+            }
+
+            std::atomic<uint64_t> vBuckets[nBuckets];
+        };
+
+        // A snapshot of a client_pool (a load generator)
+        struct client_pool_stats {
+            // connections opened so far, connected, failed to connect, lost once connected
+            size_t nStarted = 0;
+            size_t nConnected = 0;
+            size_t nFailed = 0;
+            size_t nDisconnected = 0;
+            // times a connection went through the whole of its script
+            uint64_t nScriptsCompleted = 0;
+            // replies that an Expect step was waiting for
+            uint64_t nReplies = 0;
+            // seconds since the pool started
+            double dElapsed = 0.0;
+            // per second since the pool started
+            double dMessagesOutRate = 0.0;
+            double dMessagesInRate = 0.0;
+            // time between a Send step and the reply of the Expect step that follows, in microseconds
+            double dLatencyP50 = 0.0;
+            double dLatencyP99 = 0.0;
+            double dLatencyP999 = 0.0;
+
+            // the sum of the counters of every connection
+            connection_stats total;
+        };
+    }
+}
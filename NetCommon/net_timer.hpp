@@ -0,0 +1,151 @@
+#pragma once
+#include "net_common.hpp"
+
+namespace olc {
+
+    namespace net {
+
+        // When the server gives up on a client (see server_interface::SetTimeouts)
+        // 0 turns each of them off
+        struct timeout_options {
+            // nothing received from the client for this long - it is closed
+            // (a half-open connection, e.g. the client machine is gone, never errors on its own)
+            std::chrono::milliseconds idle{ 0 };
+            // a write still not done after this long (the client doesn't read) - it is closed
+            std::chrono::milliseconds write{ 0 };
+            // nothing received from the client for this long - the server sends it a heartbeat,
+            // which every connection answers, so a client that is alive but has nothing to say
+            // is not taken for dead. Should be well under idle
+            std::chrono::milliseconds heartbeat{ 0 };
+
+            bool Enabled() const {
+                return idle.count() > 0 || write.count() > 0 || heartbeat.count() > 0;
+            }
+
+            // e.g. SetTimeouts(timeout_options::make(30s, 10s, 10s));
+            static timeout_options make(std::chrono::milliseconds idle, std::chrono::milliseconds write = std::chrono::milliseconds(0),
+                std::chrono::milliseconds heartbeat = std::chrono::milliseconds(0)) {
+                timeout_options options;
+                options.idle = idle;
+                options.write = write;
+                options.heartbeat = heartbeat;
+                return options;
+            }
+        };
+
+        // Hierarchical timing wheel - many timers for the price of one
+        // Time is counted in ticks. The first level has a slot per tick for the next 256 ticks,
+        // and each level above has 64 slots, each as long as the whole level below: with 4
+        // levels it reaches 256 * 64^3 ticks (with 100 ms ticks, 77 days; later deadlines wait
+        // in the last slot and are placed again). Add is O(1), and an entry is moved down a
+        // level at most once per level before it expires
+        //
+        // Entries can't be cancelled: whoever gets an entry back decides if it still means
+        // something (e.g. the server looks the connection up by its key in the registry, which
+        // a client that has taken the place of a closed one doesn't have)
+        //
+        // Not thread safe - the server protects it with a mutex
+        template <typename V>
+        class timer_wheel {
+        public:
+            using clock = std::chrono::steady_clock;
+
+            timer_wheel(clock::duration tTick = std::chrono::milliseconds(100))
+                : m_tTick(std::max<clock::duration>(tTick, std::chrono::milliseconds(1))), m_tStart(clock::now()) {}
+
+            clock::duration GetTick() const {
+                return m_tTick;
+            }
+
+            // Adds an entry that expires at tDeadline (at the tick after it, at the latest)
+            void Add(clock::time_point tDeadline, V value) {
+                int64_t nTicks = (tDeadline - m_tStart + m_tTick - clock::duration(1)) / m_tTick;
+                Insert({ uint64_t(std::max<int64_t>(nTicks, int64_t(m_nNow) + 1)), std::move(value) });
+                m_nSize++;
+            }
+
+            // Moves the wheel up to tNow, and appends the entries that expired to vExpired
+            void Advance(clock::time_point tNow, std::vector<V>& vExpired) {
+                uint64_t nTarget = uint64_t(std::max<int64_t>((tNow - m_tStart) / m_tTick, 0));
+                while (m_nNow < nTarget) {
+                    m_nNow++;
+                    // every time a level goes round, the next slot of the level above
+                    // is spread over it
+                    for (size_t nLevel = 1; nLevel < nLevels; nLevel++) {
+                        if ((m_nNow & LevelMask(nLevel - 1)) != 0) {
+                            break;
+                        }
+                        Cascade(nLevel, SlotOf(nLevel, m_nNow));
+                    }
+
+                    auto& vSlot = m_vSlots[0][m_nNow & nFirstMask];
+                    for (auto& entry : vSlot) {
+                        vExpired.push_back(std::move(entry.value));
+                    }
+                    m_nSize -= vSlot.size();
+                    // the slot keeps its capacity for the next time round
+                    vSlot.clear();
+                }
+            }
+
+            size_t size() const {
+                return m_nSize;
+            }
+
+        private:
+            static constexpr size_t nLevels = 4;
+            static constexpr size_t nFirstBits = 8;
+            static constexpr size_t nLevelBits = 6;
+            static constexpr uint64_t nFirstMask = (1u << nFirstBits) - 1;
+            static constexpr uint64_t nLevelMask = (1u << nLevelBits) - 1;
+
+            struct entry {
+                uint64_t nDeadline;
+                V value;
+            };
+
+            // the ticks covered by one slot of a level
+            static constexpr size_t LevelShift(size_t nLevel) {
+                return nLevel == 0 ? 0 : nFirstBits + (nLevel - 1) * nLevelBits;
+            }
+
+            // the ticks covered by a whole level, minus 1
+            static constexpr uint64_t LevelMask(size_t nLevel) {
+                return (uint64_t(1) << (nFirstBits + nLevel * nLevelBits)) - 1;
+            }
+
+            static size_t SlotOf(size_t nLevel, uint64_t nTick) {
+                return nLevel == 0 ? size_t(nTick & nFirstMask) : size_t((nTick >> LevelShift(nLevel)) & nLevelMask);
+            }
+
+            void Insert(entry&& e) {
+                uint64_t nDelta = e.nDeadline - m_nNow;
+                for (size_t nLevel = 0; nLevel < nLevels; nLevel++) {
+                    if (nDelta <= LevelMask(nLevel)) {
+                        m_vSlots[nLevel][SlotOf(nLevel, e.nDeadline)].push_back(std::move(e));
+                        return;
+                    }
+                }
+                // too far: it waits in the slot of the last level that is spread last, and is
+                // placed again from there
+                m_vSlots[nLevels - 1][SlotOf(nLevels - 1, m_nNow + LevelMask(nLevels - 1))].push_back(std::move(e));
+            }
+
+            void Cascade(size_t nLevel, size_t nSlot) {
+                std::vector<entry> vEntries = std::move(m_vSlots[nLevel][nSlot]);
+                m_vSlots[nLevel][nSlot].clear();
+                for (auto& e : vEntries) {
+                    Insert(std::move(e));
+                }
+            }
+
+            clock::duration m_tTick;
+            clock::time_point m_tStart;
+            // ticks since m_tStart the wheel has gone through
+            uint64_t m_nNow = 0;
+            size_t m_nSize = 0;
+            // the levels above the first only use 64 of their slots
+            std::vector<entry> m_vSlots[nLevels][nFirstMask + 1];
+        };
+    }
+}
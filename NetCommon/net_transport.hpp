@@ -0,0 +1,126 @@
+#pragma once
+#include "net_common.hpp"
+
+// Unix domain sockets (and the shared memory rings that use one to meet) are only
+// there on POSIX systems
+#if defined(ASIO_HAS_LOCAL_SOCKETS) && !defined(_WIN32)
+#define OLC_NET_HAS_LOCAL_TRANSPORT 1
+#else
+#define OLC_NET_HAS_LOCAL_TRANSPORT 0
+#endif
+
+namespace olc {
+
+    namespace net {
+
+        // A connection doesn't care what kind of stream its socket is: a generic stream socket
+        // can hold a TCP socket as well as a Unix domain socket
+        using stream_socket = asio::generic::stream_protocol::socket;
+        using stream_endpoint = asio::generic::stream_protocol::endpoint;
+        using stream_acceptor = asio::basic_socket_acceptor<asio::generic::stream_protocol>;
+
+        // What carries the bytes of a connection
+        enum class transport {
+            // TCP, to any host
+            tcp,
+            // a Unix domain socket, on the same host - no TCP/IP stack, no checksums
+            local,
+            // two rings in shared memory (one per direction), on the same host - the bytes
+            // never go through the kernel. A Unix domain socket is used to meet, to wake up
+            // the other side when it sleeps, and to notice when it is gone
+            shm
+        };
+
+        // Where a server listens, or a client connects:
+        //
+        //   tcp://host:port         (tcp://[::1]:60000 for an IPv6 address)
+        //   unix:///path/of/socket
+        //   shm:///path/of/socket
+        struct endpoint_address {
+            transport scheme = transport::tcp;
+            std::string host;
+            uint16_t port = 0;
+            std::string path;
+        };
+
+        // Reads an endpoint - false if it has no known scheme, or a bad port
+        inline bool ParseEndpoint(const std::string& sEndpoint, endpoint_address& address) {
+            size_t nScheme = sEndpoint.find("://");
+            if (nScheme == std::string::npos) {
+                return false;
+            }
+            std::string sScheme = sEndpoint.substr(0, nScheme);
+            std::string sRest = sEndpoint.substr(nScheme + 3);
+
+            if (sScheme == "unix" || sScheme == "shm") {
+                if (sRest.empty()) {
+                    return false;
+                }
+                address.scheme = sScheme == "unix" ? transport::local : transport::shm;
+                address.path = sRest;
+                return true;
+            }
+
+            if (sScheme != "tcp") {
+                return false;
+            }
+
+            size_t nColon = sRest.rfind(':');
+            if (nColon == std::string::npos || nColon + 1 == sRest.size() || nColon + 6 < sRest.size()) {
+                return false;
+            }
+            uint32_t nPort = 0;
+            for (size_t i = nColon + 1; i < sRest.size(); i++) {
+                if (sRest[i] < '0' || sRest[i] > '9') {
+                    return false;
+                }
+                nPort = nPort * 10 + uint32_t(sRest[i] - '0');
+            }
+            if (nPort > 65535) {
+                return false;
+            }
+
+            address.scheme = transport::tcp;
+            address.host = sRest.substr(0, nColon);
+            // an IPv6 address is written in brackets, so its colons are not taken for the port
+            if (address.host.size() >= 2 && address.host.front() == '[' && address.host.back() == ']') {
+                address.host = address.host.substr(1, address.host.size() - 2);
+            }
+            address.port = uint16_t(nPort);
+            return true;
+        }
+
+        // Is this the endpoint of a TCP socket (rather than of a Unix domain socket)?
+        inline bool IsTcpEndpoint(const stream_endpoint& endpoint) {
+            int nFamily = endpoint.protocol().family();
+            return nFamily == asio::ip::tcp::v4().family() || nFamily == asio::ip::tcp::v6().family();
+        }
+
+        // The TCP endpoint held by a generic one - false if it isn't a TCP endpoint
+        inline bool ToTcpEndpoint(const stream_endpoint& endpoint, asio::ip::tcp::endpoint& tcpEndpoint) {
+            if (!IsTcpEndpoint(endpoint) || endpoint.size() > tcpEndpoint.capacity()) {
+                return false;
+            }
+            std::memcpy(tcpEndpoint.data(), endpoint.data(), endpoint.size());
+            tcpEndpoint.resize(endpoint.size());
+            return true;
+        }
+
+        // How an endpoint is written in the log: address:port, or the path of the socket
+        inline std::string DescribeEndpoint(const stream_endpoint& endpoint) {
+            asio::ip::tcp::endpoint tcpEndpoint;
+            if (ToTcpEndpoint(endpoint, tcpEndpoint)) {
+                return tcpEndpoint.address().to_string() + ":" + std::to_string(tcpEndpoint.port());
+            }
+#if OLC_NET_HAS_LOCAL_TRANSPORT
+            asio::local::stream_protocol::endpoint localEndpoint;
+            if (endpoint.size() <= localEndpoint.capacity()) {
+                std::memcpy(localEndpoint.data(), endpoint.data(), endpoint.size());
+                localEndpoint.resize(endpoint.size());
+                return "unix:" + localEndpoint.path();
+            }
+#endif
+            return "unknown";
+        }
+    }
+}
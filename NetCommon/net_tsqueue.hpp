@@ -53,6 +53,15 @@ namespace olc {
                 cvBlocking.notify_one();
             }
 
+            // Adds an item to back of the Queue, without copying it
+            void push_back(T&& item){
+                std::scoped_lock lock(muxQueue);
+                deqQueue.emplace_back(std::move(item));
+
+                std::unique_lock<std::mutex> ul(muxBlocking);
+                cvBlocking.notify_one();
+            }
+
             // Adds an item to the front of the Queue
             void push_front(const T& item) {
                 std::scoped_lock lock(muxQueue);
@@ -80,12 +89,37 @@ namespace olc {
                 deqQueue.clear();
             }
 
+            // Moves every item of the Queue to the back of 'out', taking the lock only once
+            // If 'out' is empty the two deques are simply swapped - nothing is moved at all
+            // Returns the number of items taken
+            size_t drain(std::deque<T>& out) {
+                std::scoped_lock lock(muxQueue);
+                size_t nCount = deqQueue.size();
+                if (out.empty()) {
+                    std::swap(out, deqQueue);
+                } else {
+                    std::move(deqQueue.begin(), deqQueue.end(), std::back_inserter(out));
+                    deqQueue.clear();
+                }
+                return nCount;
+            }
+
             void wait() {
                 while (empty()) {
                     std::unique_lock<std::mutex> ul(muxBlocking);
                     cvBlocking.wait(ul);
                 }
             }
+
+            // Same, for at most tTimeout - returns false if the queue is still empty
+            template <typename Rep, typename Period>
+            bool wait_for(const std::chrono::duration<Rep, Period>& tTimeout) {
+                if (empty()) {
+                    std::unique_lock<std::mutex> ul(muxBlocking);
+                    cvBlocking.wait_for(ul, tTimeout);
+                }
+                return !empty();
+            }
             
 
             
@@ -0,0 +1,639 @@
+#pragma once
+#include "net_common.hpp"
+#include "net_log.hpp"
+#include <cerrno>
+
+// io_uring is Linux only (5.19 or newer here: the receives take their buffers from a
+// ring of buffers registered with the kernel)
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define OLC_NET_HAS_URING 1
+#endif
+#endif
+#ifndef OLC_NET_HAS_URING
+#define OLC_NET_HAS_URING 0
+#endif
+
+#if OLC_NET_HAS_URING
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace olc {
+
+    namespace net {
+
+        // What reads and writes the sockets of the connections (see SetIoEngine on the
+        // server and the client)
+        enum class io_engine {
+            // the reactor of asio (epoll on Linux): it waits until a socket is ready, then
+            // every read and write is a system call of its own (the default)
+            reactor,
+            // io_uring: the reads and writes are requests in a ring shared with the kernel,
+            // many of them go in with one system call and no system call at all is needed
+            // to read what they did
+            uring
+        };
+
+        // The two requests a connection can have in the ring
+        enum class uring_op : uint8_t {
+            receive = 0,
+            send = 1
+        };
+
+        // What an engine did - every io_uring_enter and every wake up of the eventfd is a
+        // system call, the requests and their completions are not
+        struct uring_stats {
+            uint64_t nSubmitted = 0;
+            uint64_t nEnters = 0;
+            uint64_t nWakeups = 0;
+            uint64_t nCompletions = 0;
+            // receives that found no free buffer in the ring
+            uint64_t nNoBuffers = 0;
+            bool bMultishot = false;
+        };
+
+        // An io_uring for the connections of a server (or of a client), on its asio context
+        //
+        // Each connection keeps one receive in the ring: a multishot receive where the kernel
+        // has it (6.0), which stays armed and completes once for every chunk that arrives, or
+        // a receive that is put back after each chunk. The kernel writes what it receives into
+        // buffers of a ring registered once with it (a buffer group), so the connection never
+        // gives it memory of its own - a receive still in the ring when the connection is gone
+        // can't write into freed memory. The connection copies each chunk into its receive
+        // buffer and hands the buffer back at once
+        // The gathered writes go in as one sendmsg request
+        //
+        // The requests made by the threads of the context are written into the ring and sent
+        // to the kernel together, by a flush posted to the context: a burst of reads and writes
+        // of many connections costs one io_uring_enter. The kernel signals the completions on
+        // an eventfd, which asio waits for next to the other sockets. They are read straight
+        // from the ring, and each one is posted to the strand of its connection
+        //
+        // A connection registers a handler for its completions and gets a key: the key holds
+        // a generation, so the completions of a connection that is gone are dropped (and their
+        // buffers given back to the kernel)
+        class uring_engine {
+        public:
+            // called with every completion of a connection, from the thread that reads the ring
+            // (it must not block, and must not call the engine: post to the strand instead)
+            using handler = std::function<void(uring_op, int32_t nResult, uint32_t nFlags)>;
+
+            uring_engine(asio::io_context& asioContext)
+                : m_asioContext(asioContext)
+#if OLC_NET_HAS_URING
+                , m_eventfd(asioContext)
+#endif
+            {
+
+            }
+
+            uring_engine(const uring_engine&) = delete;
+
+            ~uring_engine() {
+                Close();
+            }
+
+            // Sets up the ring, the buffers the kernel receives into (nBuffers of nBufferSize
+            // bytes, nBuffers a power of 2) and starts waiting for completions on the context
+            // false if io_uring can't be used here: not Linux, a kernel too old, or forbidden
+            // (e.g. by seccomp in a container) - the owner stays with the reactor then
+            bool Open(unsigned nEntries = 1024, unsigned nBuffers = 512, unsigned nBufferSize = 16 * 1024) {
+#if OLC_NET_HAS_URING
+                if (m_nRing >= 0 || nBuffers == 0 || (nBuffers & (nBuffers - 1)) != 0 || nBuffers > 32768) {
+                    return false;
+                }
+
+                // a multishot receive can complete many times for one request: the completion
+                // queue is bigger than the submission queue
+                io_uring_params params{};
+                params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+                params.cq_entries = nEntries * 4;
+                m_nRing = int(syscall(__NR_io_uring_setup, nEntries, &params));
+                if (m_nRing < 0) {
+                    OLC_NET_LOG_DEBUG("[URING] io_uring_setup: ", std::strerror(errno));
+                    return false;
+                }
+                // the requests must not need their memory anymore once they are submitted
+                if (!(params.features & IORING_FEAT_NODROP) || !(params.features & IORING_FEAT_SUBMIT_STABLE) ||
+                    !MapRings(params) || !Supports({ IORING_OP_RECV, IORING_OP_SENDMSG }) ||
+                    !RegisterBuffers(nBuffers, nBufferSize) || !RegisterEventfd()) {
+                    Close();
+                    return false;
+                }
+
+                m_bMultishot = true;
+                WaitForCompletions();
+                return true;
+#else
+                return false;
+#endif
+            }
+
+            // Closes the ring - the requests still in it are cancelled by the kernel
+            // The context must not be running (the owner has stopped it)
+            void Close() {
+#if OLC_NET_HAS_URING
+                if (m_eventfd.is_open()) {
+                    asio::error_code ec;
+                    m_eventfd.close(ec);
+                }
+                if (m_nRing >= 0) {
+                    close(m_nRing);
+                    m_nRing = -1;
+                }
+                Unmap(m_pSqRing, m_nSqRingBytes);
+                Unmap(m_pCqRing, m_nCqRingBytes);
+                Unmap(m_pSqes, m_nSqesBytes);
+                Unmap(m_pBufferRing, m_nBufferRingBytes);
+                Unmap(m_pBuffers, m_nBuffersBytes);
+#endif
+            }
+
+            bool IsOpen() const {
+                return m_nRing >= 0;
+            }
+
+            // Adds a connection, and returns the key of its requests
+            uint64_t Register(handler fnHandler) {
+                std::scoped_lock lock(m_muxSlots);
+                uint32_t nIndex;
+                if (!m_vFreeSlots.empty()) {
+                    nIndex = m_vFreeSlots.back();
+                    m_vFreeSlots.pop_back();
+                } else {
+                    nIndex = uint32_t(m_slots.size());
+                    m_slots.emplace_back();
+                }
+                slot& s = m_slots[nIndex];
+                s.fnHandler = std::move(fnHandler);
+                return MakeKey(nIndex, s.nGeneration);
+            }
+
+            // Removes a connection - what is still in the ring for it is dropped when it completes
+            void Unregister(uint64_t nKey) {
+                std::scoped_lock lock(m_muxSlots);
+                uint32_t nIndex = KeyIndex(nKey);
+                if (nKey == 0 || nIndex >= m_slots.size() || m_slots[nIndex].nGeneration != KeyGeneration(nKey)) {
+                    return;
+                }
+                slot& s = m_slots[nIndex];
+                s.fnHandler = nullptr;
+                // 0 is never a generation, so no key is ever 0
+                if (++s.nGeneration == 0) {
+                    s.nGeneration = 1;
+                }
+                m_vFreeSlots.push_back(nIndex);
+            }
+
+            // Puts a receive in the ring for the socket - false if it can't (the ring is closed)
+            bool Receive(uint64_t nKey, int fd) {
+#if OLC_NET_HAS_URING
+                std::scoped_lock lock(m_muxSubmit);
+                io_uring_sqe* sqe = NextSqe();
+                if (!sqe) {
+                    return false;
+                }
+                sqe->opcode = IORING_OP_RECV;
+                sqe->fd = fd;
+                sqe->ioprio = m_bMultishot.load(std::memory_order_relaxed) ? IORING_RECV_MULTISHOT : 0;
+                sqe->flags = IOSQE_BUFFER_SELECT;
+                sqe->buf_group = nBufferGroup;
+                sqe->user_data = nKey | uint64_t(uring_op::receive);
+                Submit();
+                return true;
+#else
+                return false;
+#endif
+            }
+
+            // Puts a send of the buffers in the ring, less the first nSkip bytes (already sent
+            // by a send that was cut short) - one send per connection at a time
+            bool Send(uint64_t nKey, int fd, const std::vector<asio::const_buffer>& vBuffers, size_t nSkip) {
+#if OLC_NET_HAS_URING
+                slot* pSlot;
+                {
+                    std::scoped_lock lock(m_muxSlots);
+                    uint32_t nIndex = KeyIndex(nKey);
+                    if (nIndex >= m_slots.size() || m_slots[nIndex].nGeneration != KeyGeneration(nKey)) {
+                        return false;
+                    }
+                    // the slots don't move, and only this connection sends with its slot
+                    pSlot = &m_slots[nIndex];
+                }
+
+                pSlot->vIovecs.clear();
+                for (const auto& buffer : vBuffers) {
+                    if (nSkip >= buffer.size()) {
+                        nSkip -= buffer.size();
+                        continue;
+                    }
+                    pSlot->vIovecs.push_back({ const_cast<uint8_t*>(static_cast<const uint8_t*>(buffer.data())) + nSkip, buffer.size() - nSkip });
+                    nSkip = 0;
+                }
+                pSlot->msg = {};
+                pSlot->msg.msg_iov = pSlot->vIovecs.data();
+                pSlot->msg.msg_iovlen = pSlot->vIovecs.size();
+
+                std::scoped_lock lock(m_muxSubmit);
+                io_uring_sqe* sqe = NextSqe();
+                if (!sqe) {
+                    return false;
+                }
+                sqe->opcode = IORING_OP_SENDMSG;
+                sqe->fd = fd;
+                sqe->addr = uint64_t(uintptr_t(&pSlot->msg));
+                sqe->len = 1;
+                sqe->msg_flags = MSG_NOSIGNAL;
+                sqe->user_data = nKey | uint64_t(uring_op::send);
+                Submit();
+                return true;
+#else
+                return false;
+#endif
+            }
+
+            // Sends the requests written into the ring to the kernel, now - a connection calls it
+            // before it closes its socket, so none of its requests can find another socket
+            // that got the same descriptor
+            void Flush() {
+#if OLC_NET_HAS_URING
+                std::scoped_lock lock(m_muxSubmit);
+                m_bFlushPosted = false;
+                while (m_nPending > 0 && m_nRing >= 0) {
+                    int nSubmitted = Enter(m_nPending, 0, 0);
+                    if (nSubmitted < 0) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+                        if (errno == EAGAIN || errno == EBUSY) {
+                            // the completion queue is full: try again once it has been read
+                            PostFlush();
+                        } else {
+                            OLC_NET_LOG_ERROR("[URING] io_uring_enter: ", std::strerror(errno));
+                        }
+                        return;
+                    }
+                    m_nPending -= unsigned(nSubmitted);
+                }
+#endif
+            }
+
+            // The bytes a receive completed with, nullptr if it has no buffer
+            const uint8_t* GetBuffer(uint32_t nFlags) const {
+#if OLC_NET_HAS_URING
+                if (!(nFlags & IORING_CQE_F_BUFFER)) {
+                    return nullptr;
+                }
+                return m_pBuffers + size_t(nFlags >> IORING_CQE_BUFFER_SHIFT) * m_nBufferSize;
+#else
+                return nullptr;
+#endif
+            }
+
+            // Hands the buffer of a completion back to the kernel (nothing if it has none)
+            void ReleaseBuffer(uint32_t nFlags) {
+#if OLC_NET_HAS_URING
+                if (!(nFlags & IORING_CQE_F_BUFFER)) {
+                    return;
+                }
+                std::scoped_lock lock(m_muxBuffers);
+                AddBuffer(uint16_t(nFlags >> IORING_CQE_BUFFER_SHIFT));
+                __atomic_store_n(&m_pBufferRing->tail, m_nBufferTail, __ATOMIC_RELEASE);
+#endif
+            }
+
+            // false once a multishot receive has completed for the last time - the connection
+            // puts a new receive in the ring then
+            static bool MoreToCome(uint32_t nFlags) {
+#if OLC_NET_HAS_URING
+                return (nFlags & IORING_CQE_F_MORE) != 0;
+#else
+                return false;
+#endif
+            }
+
+            // The kernel refused a multishot receive (older than 6.0): the receives are put
+            // back after every chunk from now on. true if they were multishot until now
+            bool DisableMultishot() {
+                bool bWas = m_bMultishot.exchange(false);
+                if (bWas) {
+                    OLC_NET_LOG_INFO("[URING] No multishot receive here, one receive per read.");
+                }
+                return bWas;
+            }
+
+            // Snapshot of the counters - can be called from any thread
+            uring_stats GetStats() const {
+                uring_stats stats;
+                stats.nSubmitted = m_nSubmitted.load(std::memory_order_relaxed);
+                stats.nEnters = m_nEnters.load(std::memory_order_relaxed);
+                stats.nWakeups = m_nWakeups.load(std::memory_order_relaxed);
+                stats.nCompletions = m_nCompletions.load(std::memory_order_relaxed);
+                stats.nNoBuffers = m_nNoBuffers.load(std::memory_order_relaxed);
+                stats.bMultishot = m_bMultishot.load(std::memory_order_relaxed);
+                return stats;
+            }
+
+        private:
+            // [generation: 32][slot: 31][uring_op: 1] - the key of a connection has its low bit
+            // at 0, the request adds the operation to it
+            static uint64_t MakeKey(uint32_t nIndex, uint32_t nGeneration) {
+                return (uint64_t(nGeneration) << 32) | (uint64_t(nIndex) << 1);
+            }
+
+            static uint32_t KeyIndex(uint64_t nKey) {
+                return uint32_t(nKey >> 1) & 0x7FFFFFFF;
+            }
+
+            static uint32_t KeyGeneration(uint64_t nKey) {
+                return uint32_t(nKey >> 32);
+            }
+
+#if OLC_NET_HAS_URING
+            int Enter(unsigned nSubmit, unsigned nWait, unsigned nFlags) {
+                m_nEnters.fetch_add(1, std::memory_order_relaxed);
+                return int(syscall(__NR_io_uring_enter, m_nRing, nSubmit, nWait, nFlags, nullptr, 0));
+            }
+
+            bool MapRings(const io_uring_params& params) {
+                m_nSqRingBytes = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+                m_nCqRingBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+                m_nSqesBytes = params.sq_entries * sizeof(io_uring_sqe);
+                m_pSqRing = Map(m_nSqRingBytes, IORING_OFF_SQ_RING);
+                m_pCqRing = Map(m_nCqRingBytes, IORING_OFF_CQ_RING);
+                m_pSqes = reinterpret_cast<io_uring_sqe*>(Map(m_nSqesBytes, IORING_OFF_SQES));
+                if (!m_pSqRing || !m_pCqRing || !m_pSqes) {
+                    return false;
+                }
+
+                m_pSqHead = reinterpret_cast<uint32_t*>(m_pSqRing + params.sq_off.head);
+                m_pSqTail = reinterpret_cast<uint32_t*>(m_pSqRing + params.sq_off.tail);
+                m_pSqFlags = reinterpret_cast<uint32_t*>(m_pSqRing + params.sq_off.flags);
+                m_nSqMask = *reinterpret_cast<uint32_t*>(m_pSqRing + params.sq_off.ring_mask);
+                m_nSqEntries = params.sq_entries;
+                m_pCqHead = reinterpret_cast<uint32_t*>(m_pCqRing + params.cq_off.head);
+                m_pCqTail = reinterpret_cast<uint32_t*>(m_pCqRing + params.cq_off.tail);
+                m_nCqMask = *reinterpret_cast<uint32_t*>(m_pCqRing + params.cq_off.ring_mask);
+                m_pCqes = reinterpret_cast<io_uring_cqe*>(m_pCqRing + params.cq_off.cqes);
+
+                // the entry i of the submission queue is always the request i
+                uint32_t* pArray = reinterpret_cast<uint32_t*>(m_pSqRing + params.sq_off.array);
+                for (uint32_t i = 0; i < params.sq_entries; i++) {
+                    pArray[i] = i;
+                }
+                m_nSqTail = *m_pSqTail;
+                return true;
+            }
+
+            uint8_t* Map(size_t nBytes, off_t nOffset) {
+                void* p = mmap(nullptr, nBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_nRing, nOffset);
+                return p == MAP_FAILED ? nullptr : static_cast<uint8_t*>(p);
+            }
+
+            template <typename P>
+            static void Unmap(P*& p, size_t nBytes) {
+                if (p) {
+                    munmap(p, nBytes);
+                    p = nullptr;
+                }
+            }
+
+            // Are these requests known to the kernel?
+            bool Supports(std::initializer_list<int> vOps) {
+                std::vector<uint8_t> vProbe(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+                io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(vProbe.data());
+                if (syscall(__NR_io_uring_register, m_nRing, IORING_REGISTER_PROBE, probe, 256) < 0) {
+                    return false;
+                }
+                for (int nOp : vOps) {
+                    if (nOp > probe->last_op || !(probe->ops[nOp].flags & IO_URING_OP_SUPPORTED)) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            // The memory the kernel receives into, and the ring it takes the buffers from
+            bool RegisterBuffers(unsigned nBuffers, unsigned nBufferSize) {
+                m_nBuffers = nBuffers;
+                m_nBufferSize = nBufferSize;
+                m_nBufferRingBytes = std::max<size_t>(nBuffers * sizeof(io_uring_buf), size_t(sysconf(_SC_PAGESIZE)));
+                m_nBuffersBytes = size_t(nBuffers) * nBufferSize;
+
+                void* pRing = mmap(nullptr, m_nBufferRingBytes, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+                void* pBuffers = mmap(nullptr, m_nBuffersBytes, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+                m_pBufferRing = pRing == MAP_FAILED ? nullptr : static_cast<io_uring_buf_ring*>(pRing);
+                m_pBuffers = pBuffers == MAP_FAILED ? nullptr : static_cast<uint8_t*>(pBuffers);
+                if (!m_pBufferRing || !m_pBuffers) {
+                    return false;
+                }
+
+                io_uring_buf_reg reg{};
+                reg.ring_addr = uint64_t(uintptr_t(m_pBufferRing));
+                reg.ring_entries = nBuffers;
+                reg.bgid = nBufferGroup;
+                if (syscall(__NR_io_uring_register, m_nRing, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+                    OLC_NET_LOG_DEBUG("[URING] No ring of buffers: ", std::strerror(errno));
+                    return false;
+                }
+
+                for (unsigned i = 0; i < nBuffers; i++) {
+                    AddBuffer(uint16_t(i));
+                }
+                __atomic_store_n(&m_pBufferRing->tail, m_nBufferTail, __ATOMIC_RELEASE);
+                return true;
+            }
+
+            // the kernel sees the buffer once the tail of the ring is written
+            void AddBuffer(uint16_t nBuffer) {
+                io_uring_buf* buf = reinterpret_cast<io_uring_buf*>(m_pBufferRing) + (m_nBufferTail & (m_nBuffers - 1));
+                buf->addr = uint64_t(uintptr_t(m_pBuffers + size_t(nBuffer) * m_nBufferSize));
+                buf->len = m_nBufferSize;
+                buf->bid = nBuffer;
+                m_nBufferTail++;
+            }
+
+            bool RegisterEventfd() {
+                int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                if (fd < 0) {
+                    return false;
+                }
+                if (syscall(__NR_io_uring_register, m_nRing, IORING_REGISTER_EVENTFD, &fd, 1) < 0) {
+                    close(fd);
+                    return false;
+                }
+                m_eventfd.assign(fd);
+                return true;
+            }
+
+            // The next free entry of the submission queue - if it is full, what is in it is
+            // sent to the kernel first. Called with m_muxSubmit held
+            io_uring_sqe* NextSqe() {
+                if (m_nRing < 0) {
+                    return nullptr;
+                }
+                if (m_nSqTail - __atomic_load_n(m_pSqHead, __ATOMIC_ACQUIRE) >= m_nSqEntries) {
+                    int nSubmitted = Enter(m_nPending, 0, 0);
+                    if (nSubmitted > 0) {
+                        m_nPending -= unsigned(nSubmitted);
+                    }
+                    if (m_nSqTail - __atomic_load_n(m_pSqHead, __ATOMIC_ACQUIRE) >= m_nSqEntries) {
+                        return nullptr;
+                    }
+                }
+                io_uring_sqe* sqe = &m_pSqes[m_nSqTail & m_nSqMask];
+                std::memset(sqe, 0, sizeof(*sqe));
+                return sqe;
+            }
+
+            // The request just written is made visible, and a flush is posted if there is none
+            // waiting already. Called with m_muxSubmit held
+            void Submit() {
+                m_nSqTail++;
+                __atomic_store_n(m_pSqTail, m_nSqTail, __ATOMIC_RELEASE);
+                m_nPending++;
+                m_nSubmitted.fetch_add(1, std::memory_order_relaxed);
+                if (!m_bFlushPosted) {
+                    PostFlush();
+                }
+            }
+
+            void PostFlush() {
+                m_bFlushPosted = true;
+                asio::post(m_asioContext, [this]() { Flush(); });
+            }
+
+            // ASYNC - the kernel writes to the eventfd when a request completes
+            void WaitForCompletions() {
+                m_eventfd.async_read_some(asio::buffer(&m_nEventCount, sizeof(m_nEventCount)),
+                    [this](std::error_code ec, std::size_t length) {
+                        if (ec) {
+                            // the engine is closed
+                            return;
+                        }
+                        m_nWakeups.fetch_add(1, std::memory_order_relaxed);
+                        Reap();
+                        WaitForCompletions();
+                    });
+            }
+
+            // Reads every completion in the ring - only one thread at a time does (the one
+            // that has the eventfd read)
+            void Reap() {
+                while (true) {
+                    uint32_t nHead = *m_pCqHead;
+                    uint32_t nTail = __atomic_load_n(m_pCqTail, __ATOMIC_ACQUIRE);
+                    if (nHead == nTail) {
+                        // completions that didn't fit in the ring wait in the kernel
+                        if (__atomic_load_n(m_pSqFlags, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW) {
+                            Enter(0, 0, IORING_ENTER_GETEVENTS);
+                            continue;
+                        }
+                        return;
+                    }
+
+                    {
+                        std::scoped_lock lock(m_muxSlots);
+                        for (; nHead != nTail; nHead++) {
+                            const io_uring_cqe& cqe = m_pCqes[nHead & m_nCqMask];
+                            Dispatch(cqe.user_data, cqe.res, cqe.flags);
+                        }
+                    }
+                    m_nCompletions.fetch_add(nTail - *m_pCqHead, std::memory_order_relaxed);
+                    __atomic_store_n(m_pCqHead, nHead, __ATOMIC_RELEASE);
+                }
+            }
+
+            // Called with m_muxSlots held
+            void Dispatch(uint64_t nUserData, int32_t nResult, uint32_t nFlags) {
+                uint32_t nIndex = KeyIndex(nUserData);
+                uring_op op = uring_op(nUserData & 1);
+                if (nResult == -ENOBUFS) {
+                    m_nNoBuffers.fetch_add(1, std::memory_order_relaxed);
+                }
+                if (nIndex < m_slots.size() && m_slots[nIndex].nGeneration == KeyGeneration(nUserData) && m_slots[nIndex].fnHandler) {
+                    m_slots[nIndex].fnHandler(op, nResult, nFlags);
+                } else {
+                    // the connection is gone
+                    ReleaseBuffer(nFlags);
+                }
+            }
+#endif
+
+        private:
+            // what the engine knows of a connection
+            struct slot {
+                uint32_t nGeneration = 1;
+                handler fnHandler;
+#if OLC_NET_HAS_URING
+                // the send in progress
+                std::vector<iovec> vIovecs;
+                msghdr msg{};
+#endif
+            };
+
+            // the receives all take their buffers from this group
+            static constexpr uint16_t nBufferGroup = 0;
+
+            asio::io_context& m_asioContext;
+            int m_nRing = -1;
+
+            // connections, indexed by their key (a deque: a slot doesn't move when more are added)
+            std::mutex m_muxSlots;
+            std::deque<slot> m_slots;
+            std::vector<uint32_t> m_vFreeSlots;
+
+            // the requests written and not sent to the kernel yet, and whether a flush is posted
+            std::mutex m_muxSubmit;
+            unsigned m_nPending = 0;
+            bool m_bFlushPosted = false;
+
+            std::atomic<bool> m_bMultishot = false;
+
+            std::atomic<uint64_t> m_nSubmitted = 0;
+            std::atomic<uint64_t> m_nEnters = 0;
+            std::atomic<uint64_t> m_nWakeups = 0;
+            std::atomic<uint64_t> m_nCompletions = 0;
+            std::atomic<uint64_t> m_nNoBuffers = 0;
+
+#if OLC_NET_HAS_URING
+            asio::posix::stream_descriptor m_eventfd;
+            uint64_t m_nEventCount = 0;
+
+            // the rings shared with the kernel
+            uint8_t* m_pSqRing = nullptr;
+            uint8_t* m_pCqRing = nullptr;
+            io_uring_sqe* m_pSqes = nullptr;
+            size_t m_nSqRingBytes = 0;
+            size_t m_nCqRingBytes = 0;
+            size_t m_nSqesBytes = 0;
+            uint32_t* m_pSqHead = nullptr;
+            uint32_t* m_pSqTail = nullptr;
+            uint32_t* m_pSqFlags = nullptr;
+            uint32_t m_nSqMask = 0;
+            uint32_t m_nSqEntries = 0;
+            uint32_t m_nSqTail = 0;
+            uint32_t* m_pCqHead = nullptr;
+            uint32_t* m_pCqTail = nullptr;
+            uint32_t m_nCqMask = 0;
+            io_uring_cqe* m_pCqes = nullptr;
+
+            // the buffers the kernel receives into, and the ring it takes them from
+            std::mutex m_muxBuffers;
+            io_uring_buf_ring* m_pBufferRing = nullptr;
+            uint8_t* m_pBuffers = nullptr;
+            size_t m_nBufferRingBytes = 0;
+            size_t m_nBuffersBytes = 0;
+            unsigned m_nBuffers = 0;
+            unsigned m_nBufferSize = 0;
+            uint16_t m_nBufferTail = 0;
+#endif
+        };
+    }
+}
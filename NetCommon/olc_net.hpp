@@ -2,8 +2,25 @@
 
 #include "net_common.hpp"
 #include "net_tsqueue.hpp"
+#include "net_mpscqueue.hpp"
+#include "net_codec.hpp"
+#include "net_header.hpp"
 #include "net_message.hpp"
+#include "net_pool.hpp"
 #include "net_client.hpp"
 #include "net_server.hpp"
+#include "net_sharded_server.hpp"
 #include "net_connection.hpp"
+#include "net_registry.hpp"
+#include "net_stats.hpp"
+#include "net_backpressure.hpp"
+#include "net_socket.hpp"
+#include "net_transport.hpp"
+#include "net_shm.hpp"
+#include "net_uring.hpp"
+#include "net_coro.hpp"
+#include "net_timer.hpp"
+#include "net_datagram.hpp"
+#include "net_client_pool.hpp"
+#include "net_log.hpp"
 
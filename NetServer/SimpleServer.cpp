@@ -15,6 +15,11 @@ class CustomServer : public olc::net::server_interface<CustomMsgTypes> {
         CustomServer(uint16_t nPort) : olc::net::server_interface<CustomMsgTypes>(nPort) {
 
         }
+
+        // the threads of the server call the handlers of this class, stop them before it goes
+        virtual ~CustomServer() {
+            Stop();
+        }
     
     protected:
         